@@ -0,0 +1,209 @@
+#include "dynamicresolution.h"
+
+
+// (re)make the framebuffer size x size:
+
+void
+DynamicResolution::Allocate( int size )
+{
+	if( allocatedSize == 0 )
+	{
+		glGenRenderbuffers( 1, &colorBuffer );
+		glGenRenderbuffers( 1, &depthBuffer );
+		glGenFramebuffers( 1, &framebuffer );
+	}
+
+	glBindRenderbuffer( GL_RENDERBUFFER, colorBuffer );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, size, size );
+
+	glBindRenderbuffer( GL_RENDERBUFFER, depthBuffer );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, depthBuffer );
+
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+		fprintf( stderr, "The dynamic resolution framebuffer is not complete: 0x%x\n", status );
+
+	allocatedSize = size;
+}
+
+
+// start drawing the size x size viewport at ( x, y ) of whatever is bound now into the
+//	offscreen framebuffer instead, cleared and with its viewport set:
+// returns how many pixels across it is drawing this frame
+
+int
+DynamicResolution::Begin( int x, int y, int size )
+{
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &outerDrawFramebuffer );
+	glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &outerReadFramebuffer );
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = viewport[3] = size;
+
+	if( size > allocatedSize )
+		Allocate( size );
+
+	renderSize = (int)ceilf( scale * (float)size );
+	if( renderSize < 1 )
+		renderSize = 1;
+
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+	glViewport( 0, 0, renderSize, renderSize );
+
+	// only the corner that gets drawn needs clearing:
+	glEnable( GL_SCISSOR_TEST );
+	glScissor( 0, 0, renderSize, renderSize );
+	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+	glDisable( GL_SCISSOR_TEST );
+
+	return renderSize;
+}
+
+
+// stretch what was drawn since Begin( ) over the viewport it stands in for, and go back
+//	to drawing there:
+
+void
+DynamicResolution::End( )
+{
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffer );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, outerDrawFramebuffer );
+	glBlitFramebuffer( 0, 0, renderSize, renderSize,
+		viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+		GL_COLOR_BUFFER_BIT, renderSize == viewport[2] ? GL_NEAREST : GL_LINEAR );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, outerReadFramebuffer );
+
+	glViewport( viewport[0], viewport[1], viewport[2], viewport[3] );
+}
+
+
+float
+DynamicResolution::GetLastMs( )
+{
+	return lastMs;
+}
+
+
+int
+DynamicResolution::GetRenderSize( )
+{
+	return renderSize;
+}
+
+
+float
+DynamicResolution::GetScale( )
+{
+	return scale;
+}
+
+
+float
+DynamicResolution::GetTargetMs( )
+{
+	return targetMs;
+}
+
+
+// whether Update( ) is steering by the gpu's times, rather than whole frames':
+
+bool
+DynamicResolution::GpuTimesMeasure( )
+{
+	return gpuTimesMeasure;
+}
+
+
+// needs a current GL context once Begin( ) is called, but not before:
+
+void
+DynamicResolution::Init( float _targetMs )
+{
+	allocatedSize = 0;
+	targetMs = _targetMs;
+	renderSize = 0;
+	gpuTimesMeasure = false;
+	Reset( );
+}
+
+
+// back to full resolution, forgetting the frame times so far:
+
+void
+DynamicResolution::Reset( )
+{
+	scale = 1.f;
+	settleFrames = RESOLUTION_SETTLE_FRAMES;
+	sampleSum = 0.f;
+	sampleCount = 0;
+	lastMs = 0.f;
+}
+
+
+void
+DynamicResolution::SetTargetMs( float ms )
+{
+	targetMs = ms;
+	settleFrames = 0;
+	sampleSum = 0.f;
+	sampleCount = 0;
+}
+
+
+// call once a frame, before Begin( ), with whether the gpu timer came back with a new
+//	time (gpuMs) and how long the last frame took altogether (frameMs):
+//
+// a software renderer does all its work in glFinish( ) or the buffer swap, so its
+//	timer queries come back as next to nothing -- until the gpu timer has measured
+//	something real, this steers by the whole frame time instead
+
+void
+DynamicResolution::Update( bool gpuSample, float gpuMs, float frameMs )
+{
+	float ms;
+	if( gpuSample  &&  gpuMs > 0.05f )
+		gpuTimesMeasure = true;
+	if( gpuTimesMeasure )
+	{
+		if( ! gpuSample )
+			return;
+		ms = gpuMs;
+	}
+	else
+	{
+		if( frameMs <= 0.f )
+			return;
+		ms = frameMs;
+	}
+
+	// skip the frames that were already drawn (or in flight) at the old scale:
+	if( settleFrames > 0 )
+	{
+		settleFrames--;
+		return;
+	}
+
+	sampleSum += ms;
+	sampleCount++;
+	if( sampleCount < RESOLUTION_SAMPLES )
+		return;
+
+	lastMs = sampleSum / (float)sampleCount;
+	sampleSum = 0.f;
+	sampleCount = 0;
+	if( fabsf( lastMs - targetMs ) <= RESOLUTION_DEAD_BAND * targetMs )
+		return;
+
+	float newScale = scale * powf( targetMs / lastMs, 0.5f * RESOLUTION_GAIN );
+	if( newScale < RESOLUTION_MIN_SCALE )	newScale = RESOLUTION_MIN_SCALE;
+	if( newScale > 1.f )			newScale = 1.f;
+	if( newScale != scale )
+	{
+		scale = newScale;
+		settleFrames = RESOLUTION_SETTLE_FRAMES;
+	}
+}
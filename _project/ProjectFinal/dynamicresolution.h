@@ -0,0 +1,84 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <stdio.h>
+#include <math.h>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include "glew.h"
+#include <GL/gl.h>
+#endif
+
+
+//********************************************************************************
+// renders the scene into an offscreen framebuffer at a fraction of the viewport's
+//	size, then stretches it back over the viewport with glBlitFramebuffer( )
+//
+// the fraction is steered each frame from measured frame times toward a target:
+//	the cost of filling the pixels goes with the square of the scale, so each
+//	adjustment moves the scale part of the way to scale * sqrt( target / measured )
+//
+// the framebuffer is made as big as the viewport and only a corner of it is drawn
+//	into, so changing the scale never reallocates anything
+//********************************************************************************
+
+
+// the scale never goes below this, however far over the target the frames are:
+
+const float RESOLUTION_MIN_SCALE = 0.25f;
+
+// how far (in log terms) each adjustment goes toward the estimated scale:
+
+const float RESOLUTION_GAIN = 0.5f;
+
+// frame times this close to the target (as a fraction of it) are left alone:
+
+const float RESOLUTION_DEAD_BAND = 0.05f;
+
+// frames averaged for each adjustment, after skipping the ones still in flight when
+//	the scale last changed:
+
+const int RESOLUTION_SAMPLES = 4;
+const int RESOLUTION_SETTLE_FRAMES = 4;
+
+
+class DynamicResolution
+{
+  private:
+	GLuint		framebuffer;
+	GLuint		colorBuffer;
+	GLuint		depthBuffer;
+	int		allocatedSize;		// the framebuffer is allocatedSize x allocatedSize
+
+	float		scale;			// fraction of the viewport drawn, along each side
+	float		targetMs;
+	int		renderSize;		// this frame's, from Begin( )
+	int		viewport[4];		// what End( ) stretches it over
+	GLint		outerDrawFramebuffer;	// where End( ) puts things back
+	GLint		outerReadFramebuffer;
+
+	bool		gpuTimesMeasure;	// whether the gpu timer has ever come back with a real time
+	int		settleFrames;		// samples left to skip since the last change
+	float		sampleSum;
+	int		sampleCount;
+	float		lastMs;			// the average the last adjustment was made from
+
+	void	Allocate( int );
+
+  public:
+	int	Begin( int, int, int );
+	void	End( );
+	float	GetLastMs( );
+	int	GetRenderSize( );
+	float	GetScale( );
+	float	GetTargetMs( );
+	bool	GpuTimesMeasure( );
+	void	Init( float );
+	void	Reset( );
+	void	SetTargetMs( float );
+	void	Update( bool, float, float );
+};
+
+#endif	// DYNAMICRESOLUTION_H
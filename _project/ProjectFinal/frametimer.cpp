@@ -0,0 +1,257 @@
+#include "frametimer.h"
+
+#include <algorithm>
+
+
+void
+FrameStat::Add( float ms )
+{
+	samples[next] = ms;
+	next = ( next + 1 ) % FRAME_HISTORY;
+	if( count < FRAME_HISTORY )
+		count++;
+}
+
+
+// add to the newest sample, instead of starting another one:
+
+void
+FrameStat::AddToLast( float ms )
+{
+	if( count == 0 )
+	{
+		Add( ms );
+		return;
+	}
+	samples[ ( next + FRAME_HISTORY - 1 ) % FRAME_HISTORY ] += ms;
+}
+
+
+float
+FrameStat::Average( )
+{
+	if( count == 0 )
+		return 0.;
+
+	float sum = 0.;
+	for( int i = 0; i < count; i++ )
+		sum += samples[i];
+	return sum / (float)count;
+}
+
+
+void
+FrameStat::Clear( )
+{
+	count = 0;
+	next = 0;
+}
+
+
+int
+FrameStat::GetCount( )
+{
+	return count;
+}
+
+
+const char *
+FrameStat::GetName( )
+{
+	return name;
+}
+
+
+// get the i'th oldest sample still in the window:
+
+float
+FrameStat::GetSample( int i )
+{
+	int oldest = ( count < FRAME_HISTORY ) ? 0 : next;
+	return samples[ ( oldest + i ) % FRAME_HISTORY ];
+}
+
+
+void
+FrameStat::Init( const char *_name )
+{
+	name = _name;
+	Clear( );
+}
+
+
+float
+FrameStat::Last( )
+{
+	if( count == 0 )
+		return 0.;
+
+	return samples[ ( next + FRAME_HISTORY - 1 ) % FRAME_HISTORY ];
+}
+
+
+// p is between 0. and 100.:
+
+float
+FrameStat::Percentile( float p )
+{
+	if( count == 0 )
+		return 0.;
+
+	float sorted[FRAME_HISTORY];
+	for( int i = 0; i < count; i++ )
+		sorted[i] = samples[i];
+
+	int k = (int)( ( p / 100.f ) * (float)( count - 1 ) + 0.5f );
+	std::nth_element( sorted, sorted + k, sorted + count );
+	return sorted[k];
+}
+
+
+CpuTimer::CpuTimer( FrameStat *_stat, bool _addToLast )
+{
+	stat = _stat;
+	addToLast = _addToLast;
+	start = std::chrono::high_resolution_clock::now( );
+}
+
+
+CpuTimer::~CpuTimer( )
+{
+	Stop( );
+}
+
+
+// it is ok to call this more than once -- only the first call records a sample:
+
+void
+CpuTimer::Stop( )
+{
+	if( stat == NULL )
+		return;
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now( ) - start;
+	if( addToLast )
+		stat->AddToLast( elapsed.count( ) );
+	else
+		stat->Add( elapsed.count( ) );
+	stat = NULL;
+}
+
+
+void
+GpuTimer::Begin( )
+{
+	int slot = frame % GPU_QUERY_LATENCY;
+
+	// if the query from GPU_QUERY_LATENCY frames ago still hasn't come back,
+	//	skip timing this frame rather than waiting on it:
+
+	active = ! pending[slot];
+	if( active )
+		glBeginQuery( GL_TIME_ELAPSED, queries[slot] );
+}
+
+
+// call this once per frame before Begin( ):
+// returns true if it added a new sample
+
+bool
+GpuTimer::Collect( )
+{
+	int slot = frame % GPU_QUERY_LATENCY;
+	if( ! pending[slot] )
+		return false;
+
+	GLint available = 0;
+	glGetQueryObjectiv( queries[slot], GL_QUERY_RESULT_AVAILABLE, &available );
+	if( available == 0 )
+		return false;
+
+	GLuint64 ns = 0;
+	glGetQueryObjectui64v( queries[slot], GL_QUERY_RESULT, &ns );
+	stat->Add( (float)ns / 1000000.f );
+	pending[slot] = false;
+	return true;
+}
+
+
+void
+GpuTimer::End( )
+{
+	if( active )
+	{
+		glEndQuery( GL_TIME_ELAPSED );
+		pending[ frame % GPU_QUERY_LATENCY ] = true;
+		active = false;
+	}
+	frame++;
+}
+
+
+// needs a current GL context:
+
+void
+GpuTimer::Init( FrameStat *_stat )
+{
+	stat = _stat;
+	glGenQueries( GPU_QUERY_LATENCY, queries );
+	for( int i = 0; i < GPU_QUERY_LATENCY; i++ )
+		pending[i] = false;
+	active = false;
+	frame = 0;
+}
+
+
+// write one row per frame, oldest first, with one column per stat,
+//	followed by the average and p99 of each column:
+
+bool
+WriteFrameStatsCsv( const char *filename, FrameStat *stats[ ], int numStats )
+{
+	FILE *fp = fopen( filename, "w" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot open '%s' for writing\n", filename );
+		return false;
+	}
+
+	int rows = 0;
+	fprintf( fp, "frame" );
+	for( int s = 0; s < numStats; s++ )
+	{
+		fprintf( fp, ",%s_ms", stats[s]->GetName( ) );
+		if( stats[s]->GetCount( ) > rows )
+			rows = stats[s]->GetCount( );
+	}
+	fprintf( fp, "\n" );
+
+	for( int i = 0; i < rows; i++ )
+	{
+		fprintf( fp, "%d", i );
+		for( int s = 0; s < numStats; s++ )
+		{
+			// stats that started late are aligned to the most recent frame:
+
+			int j = i - ( rows - stats[s]->GetCount( ) );
+			if( j >= 0 )
+				fprintf( fp, ",%.4f", stats[s]->GetSample( j ) );
+			else
+				fprintf( fp, "," );
+		}
+		fprintf( fp, "\n" );
+	}
+
+	// finish with the same summary rows the hud shows:
+
+	fprintf( fp, "avg" );
+	for( int s = 0; s < numStats; s++ )
+		fprintf( fp, ",%.4f", stats[s]->Average( ) );
+	fprintf( fp, "\np99" );
+	for( int s = 0; s < numStats; s++ )
+		fprintf( fp, ",%.4f", stats[s]->Percentile( 99.f ) );
+	fprintf( fp, "\n" );
+
+	fclose( fp );
+	return true;
+}
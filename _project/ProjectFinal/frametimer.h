@@ -0,0 +1,88 @@
+#ifndef FRAMETIMER_H
+#define FRAMETIMER_H
+
+#include <stdio.h>
+#include <chrono>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include "glew.h"
+#include <GL/gl.h>
+#endif
+
+
+// number of frames kept for the rolling statistics:
+
+const int FRAME_HISTORY = 240;
+
+// number of frames between issuing a gpu timer query and reading it back:
+// (reading it back any sooner would stall the cpu until the gpu catches up)
+
+const int GPU_QUERY_LATENCY = 4;
+
+
+// a rolling window of per-frame samples, in milliseconds:
+
+class FrameStat
+{
+  private:
+	const char *	name;
+	float		samples[FRAME_HISTORY];
+	int		count;
+	int		next;
+
+  public:
+	void	Add( float );
+	void	AddToLast( float );
+	float	Average( );
+	void	Clear( );
+	int	GetCount( );
+	const char *GetName( );
+	float	GetSample( int );
+	void	Init( const char * );
+	float	Last( );
+	float	Percentile( float );
+};
+
+
+// measures cpu time from construction until Stop( ) or the end of the enclosing scope:
+// (addToLast adds it to the last sample, for a frame that is timed in pieces)
+
+class CpuTimer
+{
+  private:
+	FrameStat *	stat;
+	bool		addToLast;
+	std::chrono::high_resolution_clock::time_point	start;
+
+  public:
+	CpuTimer( FrameStat *, bool = false );
+	~CpuTimer( );
+	void	Stop( );
+};
+
+
+// measures gpu time between Begin( ) and End( ) with GL_TIME_ELAPSED queries,
+// 	reading each result back GPU_QUERY_LATENCY frames later:
+
+class GpuTimer
+{
+  private:
+	FrameStat *	stat;
+	GLuint		queries[GPU_QUERY_LATENCY];
+	bool		pending[GPU_QUERY_LATENCY];
+	bool		active;
+	int		frame;
+
+  public:
+	void	Begin( );
+	bool	Collect( );
+	void	End( );
+	void	Init( FrameStat * );
+};
+
+
+bool	WriteFrameStatsCsv( const char *, FrameStat *[ ], int );
+
+#endif	// FRAMETIMER_H
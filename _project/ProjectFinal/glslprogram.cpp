@@ -64,18 +64,30 @@ GLSLProgram::GLSLProgram( )
 bool
 GLSLProgram::Create( char *file0, char *file1, char *file2, char *file3, char * file4, char *file5 )
 {
-	return CreateHelper( file0, file1, file2, file3, file4, file5, NULL );
+	TRACE_ZONE( "GLSLProgram::Create" );
+	return CreateHelper( true, file0, file1, file2, file3, file4, file5, NULL );
 }
 
 
-// this is the varargs version of the Create method
+// the same as Create( ), but returns as soon as the compile and link have been handed to the driver:
+// poll IsCreateDone( ) once per frame, then call FinishCreate( ) to get the result
+// with GL_KHR_parallel_shader_compile, the driver compiles on its own threads and
+//	IsCreateDone( ) never blocks -- without it, FinishCreate( ) waits for the compiler
 
 bool
-GLSLProgram::CreateHelper( char *file0, ... )
+GLSLProgram::BeginCreate( char *file0, char *file1, char *file2, char *file3, char * file4, char *file5 )
 {
-	GLsizei n = 0;
-	GLchar *buf;
+	TRACE_ZONE( "GLSLProgram::BeginCreate" );
+	return CreateHelper( false, file0, file1, file2, file3, file4, file5, NULL );
+}
+
+
+// this is the varargs version of the Create method
+// if wait is false, it stops after glLinkProgram( ) and leaves the rest to FinishCreate( )
 
+bool
+GLSLProgram::CreateHelper( bool wait, char *file0, ... )
+{
 	Valid = true;
 	Vshader = Fshader = 0;
 #ifdef GEOMETRY
@@ -90,12 +102,10 @@ GLSLProgram::CreateHelper( char *file0, ... )
 
 	AttributeLocs.clear();
 	UniformLocs.clear();
-
-	Program = glCreateProgram( );
-	CheckGlErrors( "glCreateProgram" );
-
-	va_list args;
-	va_start( args, file0 );
+	PendingShaders.clear();
+	PendingFiles.clear();
+	LoadedFromCache = false;
+	CacheFile[0] = '\0';
 
 	// This is a little dicey
 	// There is no way, using var args, to know how many arguments were passed
@@ -103,18 +113,64 @@ GLSLProgram::CreateHelper( char *file0, ... )
 	// If they don't, bad things will happen.
 	// But, this "should" work ok because the prototype for ::Create defaults all filenames after the first one to NULL
 
-	char *file = file0;
-	int type;
-	while( file != NULL )
+	std::vector<char *> files;
+	va_list args;
+	va_start( args, file0 );
+	for( char *file = file0; file != NULL; file = va_arg( args, char * ) )
+		files.push_back( file );
+	va_end( args );
+
+	// read all the shader sources up front:
+	// they get hashed for the program binary cache, and this way the binary that gets cached
+	//	is always the one that was compiled from exactly these sources
+
+	std::vector<std::string> sources( files.size( ) );
+	std::vector<bool> readOk( files.size( ) );
+	for( int f = 0; f < (int)files.size( ); f++ )
+	{
+		readOk[f] = ReadShaderSource( files[f], sources[f] );
+		if( ! readOk[f] )
+		{
+			fprintf( stderr, "Cannot open shader file '%s'\n", files[f] );
+			Valid = false;
+		}
+		else if( ! Defines.empty( ) )
+		{
+			InjectDefines( sources[f] );
+		}
+	}
+
+	Program = glCreateProgram( );
+	CheckGlErrors( "glCreateProgram" );
+
+	// see if this exact program has already been compiled and linked by this driver:
+
+	if( Valid  &&  BinaryCacheDir != NULL  &&  GetOSU( GL_NUM_PROGRAM_BINARY_FORMATS ) > 0 )
 	{
-		type = -1;
+		sprintf( CacheFile, "%s/%016llx.bin", BinaryCacheDir, HashProgramSources( files, sources ) );
+		if( LoadProgramBinary( CacheFile ) )
+		{
+			if( Verbose )
+				fprintf( stderr, "Shader Program loaded from '%s'.\n", CacheFile );
+			LoadedFromCache = true;
+			return wait ? FinishCreate( ) : Valid;
+		}
+
+		// ask for a binary we can save once this is linked:
+		glProgramParameteri( Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+	}
+
+	for( int f = 0; f < (int)files.size( ); f++ )
+	{
+		char *file = files[f];
+		int type = -1;
 		char *extension = GetExtension( file );
 		// fprintf( stderr, "File = '%s', extension = '%s'\n", file, extension );
 
 		int maxShaderTypes = sizeof(ShaderTypes) / sizeof(struct GLshadertype);
 		for( int i = 0; i < maxShaderTypes; i++ )
 		{
-			if( strcmp( extension, ShaderTypes[i].extension ) == 0 )
+			if( extension != NULL  &&  strcmp( extension, ShaderTypes[i].extension ) == 0 )
 			{
 				// fprintf( stderr, "Legal extension = '%s'\n", extension );
 				type = i;
@@ -123,7 +179,7 @@ GLSLProgram::CreateHelper( char *file0, ... )
 		}
 
 		GLuint shader;
-		bool SkipToNextVararg = false;
+		bool SkipToNextVararg = ! readOk[f];
 		if( type < 0 )
 		{
 			fprintf( stderr, "Unknown filename extension: '%s'\n", extension );
@@ -231,96 +287,111 @@ GLSLProgram::CreateHelper( char *file0, ... )
 		}
 
 
-		// read the shader source into a buffer:
+		// hand the shader source to GL:
+		// (the compile status isn't asked for until FinishCreate( ), so the compile can run
+		//	in the background if the driver is able to)
 
 		if( ! SkipToNextVararg )
 		{
-			FILE * in;
-			int length;
-			FILE * logfile;
+			GLchar *strings[2];
+			int n = 0;
+			strings[n] = (GLchar *)sources[f].c_str( );
+			n++;
 
-			in = fopen( file, "rb" );
-			if( in == NULL )
-			{
-				fprintf( stderr, "Cannot open shader file '%s'\n", file );
-				Valid = false;
-				SkipToNextVararg = true;
-			}
+			// Tell GL about the source:
 
-			if( ! SkipToNextVararg )
-			{
-				fseek( in, 0, SEEK_END );
-				length = ftell( in );
-				fseek( in, 0, SEEK_SET );		// rewind
+			glShaderSource( shader, n, (const GLchar **)strings, NULL );
+			CheckGlErrors( "Shader Source" );
 
-				buf = new GLchar[length+1];
-				fread( buf, sizeof(GLchar), length, in );
-				buf[length] = '\0';
-				fclose( in ) ;
+			// compile:
 
-				GLchar *strings[2];
-				int n = 0;
-				strings[n] = buf;
-				n++;
+			glCompileShader( shader );
+			CheckGlErrors( "CompileShader:" );
 
-				// Tell GL about the source:
+			glAttachShader( this->Program, shader );
+			PendingShaders.push_back( shader );
+			PendingFiles.push_back( file );
+		}
+	}
 
-				glShaderSource( shader, n, (const GLchar **)strings, NULL );
-				delete [ ] buf;
-				CheckGlErrors( "Shader Source" );
+	// link the entire shader program:
 
-				// compile:
+	glLinkProgram( Program );
+	CheckGlErrors( "Link Shader 1");
 
-				glCompileShader( shader );
-				GLint infoLogLen;
-				GLint compileStatus;
-				CheckGlErrors( "CompileShader:" );
-				glGetShaderiv( shader, GL_COMPILE_STATUS, &compileStatus );
+	if( wait )
+		return FinishCreate( );
 
-				if( compileStatus == 0 )
-				{
-					fprintf( stderr, "Shader '%s' did not compile.\n", file );
-					glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &infoLogLen );
-					if( infoLogLen > 0 )
-					{
-						GLchar *infoLog = new GLchar[infoLogLen+1];
-						glGetShaderInfoLog( shader, infoLogLen, NULL, infoLog);
-						infoLog[infoLogLen] = '\0';
-						logfile = fopen( "glsllog.txt", "w");
-						if( logfile != NULL )
-						{
-							fprintf( logfile, "\n%s\n", infoLog );
-							fclose( logfile );
-						}
-						fprintf( stderr, "\n%s\n", infoLog );
-						delete [ ] infoLog;
-					}
-					glDeleteShader( shader );
-					Valid = false;
-				}
-				else
-				{
-					if( Verbose )
-						fprintf( stderr, "Shader '%s' compiled.\n", file );
+	return Valid;
+}
 
-					glAttachShader( this->Program, shader );
-				}
-			}
-		}
 
+// true once the compile and link started by BeginCreate( ) are done:
 
+bool
+GLSLProgram::IsCreateDone( )
+{
+	if( LoadedFromCache  ||  PendingShaders.empty( )  ||  ! CanDoParallelCompile )
+		return true;
 
-		// go to the next vararg file:
+	GLint done = GL_TRUE;
+	glGetProgramiv( Program, GL_COMPLETION_STATUS_KHR, &done );
+	return done != GL_FALSE;
+}
 
-		file = va_arg( args, char * );
-	}
 
-	va_end( args );
+// check how the compile and link went, report any errors, and cache the program binary:
 
-	// link the entire shader program:
+bool
+GLSLProgram::FinishCreate( )
+{
+	TRACE_ZONE( "GLSLProgram::FinishCreate" );
 
-	glLinkProgram( Program );
-	CheckGlErrors( "Link Shader 1");
+	if( LoadedFromCache )
+		return ValidateProgram( );
+
+	FILE * logfile;
+	bool compiled = true;
+
+	for( int s = 0; s < (int)PendingShaders.size( ); s++ )
+	{
+		GLuint shader = PendingShaders[s];
+		GLint infoLogLen;
+		GLint compileStatus;
+		glGetShaderiv( shader, GL_COMPILE_STATUS, &compileStatus );
+
+		if( compileStatus == 0 )
+		{
+			fprintf( stderr, "Shader '%s' did not compile.\n", PendingFiles[s] );
+			glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &infoLogLen );
+			if( infoLogLen > 0 )
+			{
+				GLchar *infoLog = new GLchar[infoLogLen+1];
+				glGetShaderInfoLog( shader, infoLogLen, NULL, infoLog);
+				infoLog[infoLogLen] = '\0';
+				logfile = fopen( "glsllog.txt", "w");
+				if( logfile != NULL )
+				{
+					fprintf( logfile, "\n%s\n", infoLog );
+					fclose( logfile );
+				}
+				fprintf( stderr, "\n%s\n", infoLog );
+				delete [ ] infoLog;
+			}
+			Valid = false;
+			compiled = false;
+		}
+		else
+		{
+			if( Verbose )
+				fprintf( stderr, "Shader '%s' compiled.\n", PendingFiles[s] );
+		}
+
+		// the shader goes away with the program:
+		glDeleteShader( shader );
+	}
+	PendingShaders.clear( );
+	PendingFiles.clear( );
 
 	GLchar* infoLog;
 	GLint infoLogLen;
@@ -330,42 +401,392 @@ GLSLProgram::CreateHelper( char *file0, ... )
 
 	if( linkStatus == 0 )
 	{
-		glGetProgramiv( this->Program, GL_INFO_LOG_LENGTH, &infoLogLen );
-		fprintf( stderr, "Failed to link program -- Info Log Length = %d\n", infoLogLen );
-		if( infoLogLen > 0 )
+		// a shader that didn't compile has already said why:
+		if( compiled )
 		{
-			infoLog = new GLchar[infoLogLen+1];
-			glGetProgramInfoLog( this->Program, infoLogLen, NULL, infoLog );
-			infoLog[infoLogLen] = '\0';
-			fprintf( stderr, "Info Log:\n%s\n", infoLog );
-			delete [ ] infoLog;
+			glGetProgramiv( this->Program, GL_INFO_LOG_LENGTH, &infoLogLen );
+			fprintf( stderr, "Failed to link program -- Info Log Length = %d\n", infoLogLen );
+			if( infoLogLen > 0 )
+			{
+				infoLog = new GLchar[infoLogLen+1];
+				glGetProgramInfoLog( this->Program, infoLogLen, NULL, infoLog );
+				infoLog[infoLogLen] = '\0';
+				fprintf( stderr, "Info Log:\n%s\n", infoLog );
+				delete [ ] infoLog;
 
+			}
 		}
-		glDeleteProgram( Program );
+		Delete( );
+		Valid = false;
+		return Valid;
+	}
+
+	if( Verbose )
+		fprintf( stderr, "Shader Program linked.\n" );
+
+	// only cache programs that built cleanly:
+
+	if( Valid  &&  CacheFile[0] != '\0' )
+		SaveProgramBinary( CacheFile );
+
+	return ValidateProgram( );
+}
+
+
+// delete the GL program object:
+// (copies of this GLSLProgram share the same program object, so only delete it once)
+
+void
+GLSLProgram::Delete( )
+{
+	if( Program == 0 )
+		return;
+
+	if( CurrentProgram == (int)Program )
+	{
+		glUseProgram( 0 );
+		CurrentProgram = 0;
+	}
+	glDeleteProgram( Program );
+	Program = 0;
+}
+
+
+#ifdef COMPUTE
+// run the compute shader over this many work groups:
+
+void
+GLSLProgram::DispatchCompute( GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ )
+{
+	Use( );
+	glDispatchCompute( numGroupsX, numGroupsY, numGroupsZ );
+}
+#endif
+
+
+// validate the linked program:
+
+bool
+GLSLProgram::ValidateProgram( )
+{
+	GLint status;
+	glValidateProgram( Program );
+	glGetProgramiv( Program, GL_VALIDATE_STATUS, &status );
+	if( status == GL_FALSE )
+	{
+		fprintf( stderr, "Program is invalid.\n" );
 		Valid = false;
 	}
 	else
 	{
 		if( Verbose )
-			fprintf( stderr, "Shader Program linked.\n" );
-		// validate the program:
+			fprintf( stderr, "Shader Program validated.\n" );
+	}
+
+	return Valid;
+}
+
 
-		GLint status;
-		glValidateProgram( Program );
-		glGetProgramiv( Program, GL_VALIDATE_STATUS, &status );
-		if( status == GL_FALSE )
+// put a #define for each name in Defines right after the #version line
+//	(#version has to come first), then reset the line numbering so that
+//	compiler errors still point at the right line of the file:
+
+void
+GLSLProgram::InjectDefines( std::string &source )
+{
+	size_t at = 0;
+	size_t version = source.find( "#version" );
+	if( version != std::string::npos )
+	{
+		at = source.find( '\n', version );
+		at = ( at == std::string::npos ) ? source.size( ) : at + 1;
+	}
+
+	int line = 1;
+	for( size_t i = 0; i < at; i++ )
+	{
+		if( source[i] == '\n' )
+			line++;
+	}
+
+	std::string defines;
+	size_t start = 0;
+	while( ( start = Defines.find_first_not_of( " \t", start ) ) != std::string::npos )
+	{
+		size_t end = Defines.find_first_of( " \t", start );
+		std::string name = Defines.substr( start, end - start );
+
+		// NAME=VALUE becomes "#define NAME VALUE":
+		size_t equals = name.find( '=' );
+		if( equals != std::string::npos )
+			name[equals] = ' ';
+
+		defines += "#define " + name + "\n";
+		start = end;
+	}
+
+	char lineDirective[32];
+	sprintf( lineDirective, "#line %d\n", line );
+	if( at > 0  &&  source[at-1] != '\n' )
+		defines = "\n" + defines;
+
+	source.insert( at, defines + lineDirective );
+}
+
+
+static
+bool
+ReadFile( const char *file, std::string &contents )
+{
+	FILE *in = fopen( file, "rb" );
+	if( in == NULL )
+		return false;
+
+	fseek( in, 0, SEEK_END );
+	int length = ftell( in );
+	fseek( in, 0, SEEK_SET );		// rewind
+
+	contents.resize( length );
+	if( length > 0 )
+		length = (int)fread( &contents[0], sizeof(GLchar), length, in );
+	contents.resize( length );
+	fclose( in ) ;
+	return true;
+}
+
+
+bool
+GLSLProgram::ReadShaderSource( char *file, std::string &source )
+{
+	if( ! ReadFile( file, source ) )
+		return false;
+
+	int numIncludes = 0;
+	return ExpandIncludes( file, source, 0, numIncludes, 0 );
+}
+
+
+// replace each #include "name" line with the contents of that file (found in the same
+//	directory as the file doing the including), and put #line directives around it so that
+//	compiler errors still point at the right line -- the n'th file included is source
+//	string n, so its errors say "n:line" instead of "0:line"
+//
+// the #include's are expanded before the preprocessor runs, so one inside an #ifdef
+//	is read even when the #ifdef then throws it away
+
+bool
+GLSLProgram::ExpandIncludes( const char *file, std::string &source, int sourceNumber, int &numIncludes, int depth )
+{
+	std::string expanded;
+	int line = 1;
+	size_t start = 0;
+	while( start < source.size( ) )
+	{
+		size_t end = source.find( '\n', start );
+		end = ( end == std::string::npos ) ? source.size( ) : end + 1;
+		std::string text = source.substr( start, end - start );
+		start = end;
+
+		size_t first = text.find_first_not_of( " \t" );
+		if( first == std::string::npos  ||  text.compare( first, 8, "#include" ) != 0 )
 		{
-			fprintf( stderr, "Program is invalid.\n" );
-			Valid = false;
+			expanded += text;
+			line++;
+			continue;
 		}
-		else
+
+		size_t open = text.find( '"', first );
+		size_t close = ( open == std::string::npos ) ? open : text.find( '"', open + 1 );
+		if( close == std::string::npos )
 		{
-			if( Verbose )
-				fprintf( stderr, "Shader Program validated.\n" );
+			fprintf( stderr, "%s, line %d: #include needs a \"filename\"\n", file, line );
+			return false;
+		}
+
+		std::string path = file;
+		size_t slash = path.find_last_of( "/\\" );
+		path = ( slash == std::string::npos ? "" : path.substr( 0, slash + 1 ) ) + text.substr( open + 1, close - open - 1 );
+
+		std::string included;
+		if( depth >= MAX_INCLUDE_DEPTH  ||  ! ReadFile( path.c_str( ), included ) )
+		{
+			fprintf( stderr, "%s, line %d: cannot #include '%s'\n", file, line, path.c_str( ) );
+			return false;
 		}
+
+		int number = ++numIncludes;
+		if( ! ExpandIncludes( path.c_str( ), included, number, numIncludes, depth + 1 ) )
+			return false;
+		if( ! included.empty( )  &&  included[ included.size( ) - 1 ] != '\n' )
+			included += '\n';
+
+		char lineDirective[32];
+		sprintf( lineDirective, "#line 1 %d\n", number );
+		expanded += lineDirective + included;
+		line++;
+		sprintf( lineDirective, "#line %d %d\n", line, sourceNumber );
+		expanded += lineDirective;
 	}
 
-	return Valid;
+	source = expanded;
+	return true;
+}
+
+
+//********************************************************************************
+// program binary cache:
+//
+// a linked program is saved with glGetProgramBinary( ) in BinaryCacheDir, named by a
+//	hash of the shader sources and the driver that built it, and reloaded with
+//	glProgramBinary( ) the next time -- if the driver rejects the binary (e.g., it
+//	was updated), the program just gets compiled from source again
+//
+// set BinaryCacheDir to NULL to turn the cache off
+//********************************************************************************
+
+const char *	GLSLProgram::BinaryCacheDir = "shadercache";
+
+const unsigned int	PROGRAM_BINARY_MAGIC = 0x42504c47;	// "GLPB"
+
+
+// 64-bit FNV-1a:
+
+static
+unsigned long long
+HashBytes( unsigned long long hash, const char *bytes, size_t length )
+{
+	for( size_t i = 0; i < length; i++ )
+	{
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	// separate this field from the next one:
+	hash ^= 0xff;
+	hash *= 1099511628211ULL;
+	return hash;
+}
+
+
+static
+unsigned long long
+HashString( unsigned long long hash, const char *s )
+{
+	if( s == NULL )
+		s = "";
+	return HashBytes( hash, s, strlen( s ) );
+}
+
+
+unsigned long long
+GLSLProgram::HashProgramSources( std::vector<char *> &files, std::vector<std::string> &sources )
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	hash = HashString( hash, (const char *)glGetString( GL_VENDOR ) );
+	hash = HashString( hash, (const char *)glGetString( GL_RENDERER ) );
+	hash = HashString( hash, (const char *)glGetString( GL_VERSION ) );
+
+	for( int f = 0; f < (int)files.size( ); f++ )
+	{
+		// the extension picks the shader stage:
+		hash = HashString( hash, GetExtension( files[f] ) );
+		hash = HashBytes( hash, sources[f].c_str( ), sources[f].size( ) );
+	}
+
+	return hash;
+}
+
+
+bool
+GLSLProgram::LoadProgramBinary( const char *filename )
+{
+	FILE *fp = fopen( filename, "rb" );
+	if( fp == NULL )
+		return false;
+
+	unsigned int magic = 0;
+	GLenum format = 0;
+	GLint length = 0;
+	bool ok = fread( &magic, sizeof(magic), 1, fp ) == 1  &&  magic == PROGRAM_BINARY_MAGIC
+		&& fread( &format, sizeof(format), 1, fp ) == 1
+		&& fread( &length, sizeof(length), 1, fp ) == 1  &&  length > 0;
+
+	std::vector<char> binary;
+	if( ok )
+	{
+		binary.resize( length );
+		ok = fread( &binary[0], 1, length, fp ) == (size_t)length;
+	}
+	fclose( fp );
+
+	if( ! ok )
+		return false;
+
+	glProgramBinary( Program, format, &binary[0], length );
+	GLint linkStatus = 0;
+	glGetProgramiv( Program, GL_LINK_STATUS, &linkStatus );
+	glGetError( );			// a rejected binary is not an error worth reporting
+
+	if( linkStatus == 0  &&  Verbose )
+		fprintf( stderr, "The driver rejected cached program binary '%s'\n", filename );
+
+	return linkStatus != 0;
+}
+
+
+void
+GLSLProgram::SaveProgramBinary( const char *filename )
+{
+	GLint length = 0;
+	glGetProgramiv( Program, GL_PROGRAM_BINARY_LENGTH, &length );
+	if( length <= 0 )
+		return;
+
+	std::vector<char> binary( length );
+	GLenum format = 0;
+	glGetProgramBinary( Program, length, &length, &format, &binary[0] );
+	if( glGetError( ) != GL_NO_ERROR  ||  length <= 0 )
+		return;
+
+#ifdef WIN32
+	_mkdir( BinaryCacheDir );
+#else
+	mkdir( BinaryCacheDir, 0755 );
+#endif
+
+	// write it beside the cache file and rename it into place, so that another copy of
+	// the program never reads a half-written binary:
+
+	std::string tmpname = std::string( filename ) + ".tmp";
+	FILE *fp = fopen( tmpname.c_str( ), "wb" );
+	if( fp == NULL )
+	{
+		if( Verbose )
+			fprintf( stderr, "Cannot write program binary '%s'\n", filename );
+		return;
+	}
+
+	bool ok = fwrite( &PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC), 1, fp ) == 1;
+	ok = ok  &&  fwrite( &format, sizeof(format), 1, fp ) == 1;
+	ok = ok  &&  fwrite( &length, sizeof(length), 1, fp ) == 1;
+	ok = ok  &&  fwrite( &binary[0], 1, length, fp ) == (size_t)length;
+	ok = ( fclose( fp ) == 0 )  &&  ok;
+
+#ifdef WIN32
+	if( ok )
+		remove( filename );		// Windows will not rename over an existing file
+#endif
+	if( ! ok  ||  rename( tmpname.c_str( ), filename ) != 0 )
+	{
+		remove( tmpname.c_str( ) );
+		if( Verbose )
+			fprintf( stderr, "Cannot write program binary '%s'\n", filename );
+		return;
+	}
+
+	if( Verbose )
+		fprintf( stderr, "Shader Program saved to '%s'.\n", filename );
 }
 
 
@@ -461,6 +882,9 @@ void
 GLSLProgram::Init( )
 {
 	Verbose = false;
+	Program = 0;
+	LoadedFromCache = false;
+	CacheFile[0] = '\0';
 
 	const GLubyte* extensions = glGetString(GL_EXTENSIONS);
 	if( extensions != NULL )
@@ -485,6 +909,19 @@ GLSLProgram::Init( )
 		CanDoTessellationShaders = IsExtensionSupported( "GL_ARB_tessellation_shader" );
 		CanDoGeometryShaders     = IsExtensionSupported( "GL_ARB_geometry_shader4" )  ||  IsExtensionSupported( "GL_EXT_geometry_shader4" ) || IsExtensionSupported("GL_EXT_geometry_shader");
 		CanDoFragmentShaders     = IsExtensionSupported( "GL_ARB_fragment_shader" );
+
+		// newer drivers (e.g., mesa) stop listing the extensions once the stage is core:
+		int major = 0, minor = 0;
+		const char *version = (const char *)glGetString( GL_VERSION );
+		if( version != NULL )
+			sscanf( version, "%d.%d", &major, &minor );
+		int glVersion = 10*major + minor;
+		if( glVersion >= 20 )	CanDoVertexShaders = CanDoFragmentShaders = true;
+		if( glVersion >= 32 )	CanDoGeometryShaders = true;
+		if( glVersion >= 40 )	CanDoTessellationShaders = true;
+		if( glVersion >= 43 )	CanDoComputeShaders = true;
+
+		CanDoParallelCompile     = IsExtensionSupported( "GL_KHR_parallel_shader_compile" ) || IsExtensionSupported( "GL_ARB_parallel_shader_compile" );
 		fprintf( stderr, "This system can handle:\n" );
 	}
 	else
@@ -494,6 +931,7 @@ GLSLProgram::Init( )
 		CanDoTessellationShaders = true;
 		CanDoGeometryShaders     = true;
 		CanDoFragmentShaders     = true;
+		CanDoParallelCompile     = false;
 		fprintf( stderr, "Your system's OpenGL is not telling me what extensions you have.\n" );
 		fprintf( stderr, "So, I am going to assume that your system can handle:\n" );
 	}
@@ -504,6 +942,7 @@ GLSLProgram::Init( )
 	if( CanDoTessellationShaders )          fprintf( stderr, "\ttessellation control shaders \n" );
 	if( CanDoTessellationShaders )          fprintf( stderr, "\ttessellation evaluation shaders \n" );
 	if( CanDoComputeShaders )               fprintf( stderr, "\tcompute shaders \n");
+	if( CanDoParallelCompile )              fprintf( stderr, "\tparallel shader compiles \n");
 
 	fprintf( stderr, "\n" );
 }
@@ -523,6 +962,23 @@ GLSLProgram::IsNotValid( )
 }
 
 
+// the #define's to compile with, e.g. "MULTICOLOR UNLIT" or "OCTAVES=4":
+// (call this before Create( ) -- each set of defines is a separate program)
+
+void
+GLSLProgram::SetDefines( const char *defines )
+{
+	Defines = ( defines != NULL ) ? defines : "";
+}
+
+
+const char *
+GLSLProgram::GetDefines( )
+{
+	return Defines.c_str( );
+}
+
+
 void
 GLSLProgram::SetVerbose( bool v )
 {
@@ -786,6 +1242,14 @@ GLSLProgram::SetUniformVariable( char* name, int val )
 		switch( type )
 		{
 			case GL_INT:
+			case GL_BOOL:
+			// samplers are set to a texture unit number:
+			case GL_SAMPLER_1D:
+			case GL_SAMPLER_2D:
+			case GL_SAMPLER_3D:
+			case GL_SAMPLER_CUBE:
+			case GL_SAMPLER_1D_ARRAY:
+			case GL_SAMPLER_2D_ARRAY:
 				glUniform1i( loc, val );
 				break;
 
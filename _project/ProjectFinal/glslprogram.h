@@ -28,6 +28,12 @@ void	CheckGlErrors( const char* );
 #endif
 
 
+// from GL_KHR_parallel_shader_compile, which this glew.h predates:
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR	0x91B1
+#endif
+
+
 inline int GetOSU(int flag)
 {
 	int i;
@@ -67,8 +73,26 @@ inline int GetOSU(int flag)
 
 #include "glut.h"
 #include <map>
+#include <string>
+#include <vector>
 #include <stdarg.h>
 
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+
+// how deeply shader #include's can nest (this also stops a file from including itself forever):
+const int MAX_INCLUDE_DEPTH = 8;
+
+
+// zone tracing is only compiled in if the application #include's tracezones.cpp first:
+#ifndef TRACE_ZONE
+#define TRACE_ZONE( name )
+#endif
+
 
 //********************************************************************************
 // #define GLM to allow this to accept glm uniform variables:
@@ -101,6 +125,8 @@ class GLSLProgram
 {
   private:
 	std::map<char *, int>	AttributeLocs;
+	char			CacheFile[256];
+	std::string		Defines;
 #ifdef COMPUTE
 	char *			Cfile;
 	unsigned int		Cshader;
@@ -112,6 +138,9 @@ class GLSLProgram
 	unsigned int		Gshader;
 #endif
 	bool			IncludeGstap;
+	bool			LoadedFromCache;
+	std::vector<char *>	PendingFiles;
+	std::vector<GLuint>	PendingShaders;
 	GLuint			Program;
 #ifdef TESSELLATION
 	char *			TCfile;
@@ -131,23 +160,41 @@ class GLSLProgram
 	bool	CanDoComputeShaders;
 	bool	CanDoFragmentShaders;
 	bool	CanDoGeometryShaders;
+	bool	CanDoParallelCompile;
 	bool	CanDoTessellationShaders;
 	bool	CanDoVertexShaders;
 	int	CompileShader( GLuint );
-	bool	CreateHelper( char *, ... );
+	bool	CreateHelper( bool, char *, ... );
+	bool	ExpandIncludes( const char *, std::string &, int, int &, int );
 	int	GetAttributeLocation( char * );
 	int	GetUniformLocation( char * );
+	unsigned long long HashProgramSources( std::vector<char *> &, std::vector<std::string> & );
+	void	InjectDefines( std::string & );
+	bool	LoadProgramBinary( const char * );
+	bool	ReadShaderSource( char *, std::string & );
+	void	SaveProgramBinary( const char * );
+	bool	ValidateProgram( );
 
 
   public:
+	static const char *	BinaryCacheDir;		// where linked program binaries are cached, or NULL
+
 		GLSLProgram( );
 
+	bool	BeginCreate( char *, char * = NULL, char * = NULL, char * = NULL, char * = NULL, char * = NULL );
 	bool	Create( char *, char * = NULL, char * = NULL, char * = NULL, char * = NULL, char * = NULL );
+	void	Delete( );
 	void	DisableVertexAttribArray( const char * );
+#ifdef COMPUTE
+	void	DispatchCompute( GLuint, GLuint = 1, GLuint = 1 );
+#endif
 	void	EnableVertexAttribArray( const char * );
+	bool	FinishCreate( );
 	int	GetAttributeTypeAndSize( GLchar *, GLint *, GLenum * );
+	const char *GetDefines( );
 	int	GetUniformTypeAndSize(   GLchar *, GLint *, GLenum * );
 	void	Init( );
+	bool	IsCreateDone( );
 	bool	IsExtensionSupported( const char * );
 	bool	IsNotValid( );
 	bool	IsValid( );
@@ -172,6 +219,7 @@ class GLSLProgram
 	void	SetUniformVariable( char *, glm::mat4 );
 #endif
 
+	void	SetDefines( const char * );
 	void	SetVerbose( bool );
 	void	UnUse( );
 	void	Use( );
@@ -0,0 +1,209 @@
+#include "headless.h"
+
+
+void
+HeadlessContext::Bind( )
+{
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+	glDrawBuffer( GL_COLOR_ATTACHMENT0 );
+}
+
+
+bool
+HeadlessContext::Create( int _width, int _height )
+{
+	width = _width;
+	height = _height;
+	framebuffer = colorBuffer = depthBuffer = 0;
+
+	if( ! CreateContext( ) )
+		return false;
+
+	// there is no window system to hand us the gl function pointers,
+	//	so glew has to find them itself:
+
+	glewExperimental = GL_TRUE;
+	GLenum err = glewInit( );
+	if( err != GLEW_OK )
+	{
+		fprintf( stderr, "glewInit Error: %s\n", glewGetErrorString( err ) );
+		return false;
+	}
+	glGetError( );		// glewInit( ) can leave a harmless GL_INVALID_ENUM behind
+
+	fprintf( stderr, "Headless renderer: %s, OpenGL %s\n", glGetString( GL_RENDERER ), glGetString( GL_VERSION ) );
+
+	return CreateFramebuffer( );
+}
+
+
+#ifdef HEADLESS_OSMESA
+
+bool
+HeadlessContext::CreateContext( )
+{
+	const int attribs[ ] =
+	{
+		OSMESA_FORMAT,                OSMESA_RGBA,
+		OSMESA_DEPTH_BITS,            24,
+		OSMESA_PROFILE,               OSMESA_COMPAT_PROFILE,
+		OSMESA_CONTEXT_MAJOR_VERSION, 3,
+		OSMESA_CONTEXT_MINOR_VERSION, 3,
+		0
+	};
+
+	context = OSMesaCreateContextAttribs( attribs, NULL );
+	if( context == NULL )
+	{
+		fprintf( stderr, "Cannot create an OSMesa context\n" );
+		return false;
+	}
+
+	// osmesa needs a buffer to make the context current, even though we draw into the fbo:
+
+	osmesaBuffer = new unsigned char[ 4 * width * height ];
+	if( ! OSMesaMakeCurrent( context, osmesaBuffer, GL_UNSIGNED_BYTE, width, height ) )
+	{
+		fprintf( stderr, "Cannot make the OSMesa context current\n" );
+		return false;
+	}
+
+	return true;
+}
+
+#else
+
+bool
+HeadlessContext::CreateContext( )
+{
+	// prefer mesa's surfaceless platform, which needs neither a display server nor a gpu:
+
+	display = EGL_NO_DISPLAY;
+	const char *clientExtensions = eglQueryString( EGL_NO_DISPLAY, EGL_EXTENSIONS );
+	if( clientExtensions != NULL  &&  strstr( clientExtensions, "EGL_MESA_platform_surfaceless" ) != NULL )
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+		if( getPlatformDisplay != NULL )
+			display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL );
+	}
+	if( display == EGL_NO_DISPLAY )
+		display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint major, minor;
+	if( display == EGL_NO_DISPLAY  ||  ! eglInitialize( display, &major, &minor ) )
+	{
+		fprintf( stderr, "Cannot initialize an EGL display\n" );
+		return false;
+	}
+
+	if( ! eglBindAPI( EGL_OPENGL_API ) )
+	{
+		fprintf( stderr, "This EGL cannot create desktop OpenGL contexts\n" );
+		return false;
+	}
+
+	// the terrain shaders are "#version 330 compatibility":
+
+	const EGLint contextAttribs[ ] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION,       3,
+		EGL_CONTEXT_MINOR_VERSION,       3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	// we never draw into an egl surface, so any config will do:
+
+	const EGLint configAttribs[ ] =
+	{
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	EGLConfig config = NULL;
+	EGLint numConfigs = 0;
+	eglChooseConfig( display, configAttribs, &config, 1, &numConfigs );
+
+	context = eglCreateContext( display, numConfigs > 0 ? config : (EGLConfig)NULL, EGL_NO_CONTEXT, contextAttribs );
+	if( context == EGL_NO_CONTEXT )
+	{
+		fprintf( stderr, "Cannot create an EGL OpenGL context (error 0x%x)\n", eglGetError( ) );
+		return false;
+	}
+
+	if( ! eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) )
+	{
+		fprintf( stderr, "Cannot make the EGL context current (error 0x%x)\n", eglGetError( ) );
+		return false;
+	}
+
+	return true;
+}
+
+#endif
+
+
+bool
+HeadlessContext::CreateFramebuffer( )
+{
+	glGenRenderbuffers( 1, &colorBuffer );
+	glBindRenderbuffer( GL_RENDERBUFFER, colorBuffer );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+
+	glGenRenderbuffers( 1, &depthBuffer );
+	glBindRenderbuffer( GL_RENDERBUFFER, depthBuffer );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height );
+
+	glGenFramebuffers( 1, &framebuffer );
+	glBindFramebuffer( GL_FRAMEBUFFER, framebuffer );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, depthBuffer );
+
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		fprintf( stderr, "Headless framebuffer is incomplete (status 0x%x)\n", status );
+		return false;
+	}
+
+	Bind( );
+	return true;
+}
+
+
+void
+HeadlessContext::Destroy( )
+{
+	if( framebuffer != 0 )
+	{
+		glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+		glDeleteFramebuffers( 1, &framebuffer );
+		glDeleteRenderbuffers( 1, &colorBuffer );
+		glDeleteRenderbuffers( 1, &depthBuffer );
+		framebuffer = colorBuffer = depthBuffer = 0;
+	}
+
+#ifdef HEADLESS_OSMESA
+	OSMesaDestroyContext( context );
+	delete [ ] osmesaBuffer;
+#else
+	eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+	eglDestroyContext( display, context );
+	eglTerminate( display );
+#endif
+}
+
+
+int
+HeadlessContext::GetHeight( )
+{
+	return height;
+}
+
+
+int
+HeadlessContext::GetWidth( )
+{
+	return width;
+}
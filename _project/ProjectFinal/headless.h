@@ -0,0 +1,53 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "glew.h"
+#include <GL/gl.h>
+
+
+//********************************************************************************
+// an offscreen OpenGL context for running without a window, a display, or a gpu:
+//	uses an EGL surfaceless context by default (Mesa llvmpipe is fine),
+//	or OSMesa if HEADLESS_OSMESA is #define'd
+//
+// everything is rendered into a framebuffer object of the requested size
+//********************************************************************************
+
+
+class HeadlessContext
+{
+  private:
+	int		width, height;
+	GLuint		framebuffer;
+	GLuint		colorBuffer;
+	GLuint		depthBuffer;
+#ifdef HEADLESS_OSMESA
+	OSMesaContext	context;
+	unsigned char *	osmesaBuffer;
+#else
+	EGLDisplay	display;
+	EGLContext	context;
+#endif
+
+	bool	CreateContext( );
+	bool	CreateFramebuffer( );
+
+  public:
+	void	Bind( );
+	bool	Create( int, int );
+	void	Destroy( );
+	int	GetHeight( );
+	int	GetWidth( );
+};
+
+#endif	// HEADLESS_H
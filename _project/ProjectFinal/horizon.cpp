@@ -0,0 +1,226 @@
+#include <algorithm>
+
+#include "horizon.h"
+
+
+// how far under the floors the occluders reach -- far enough to fill the screen below them:
+
+const float OCCLUDER_DEPTH = 1000.f;
+
+
+// most points a box clipped to the near plane can have -- its 8 corners and its 12 edges:
+
+const int MAX_CLIPPED_POINTS = 20;
+
+
+// start a new frame, looking through mvp:
+
+void
+Horizon::Begin( glm::mat4 _mvp )
+{
+	mvp = _mvp;
+	for( int c = 0; c < (int)heights.size( ); c++ )
+		heights[c] = -1.f;		// nothing is covered but the bottom edge
+}
+
+
+// y on chain (left to right) at x, starting the search at segment *i:
+
+static float
+ChainAt( glm::vec2 *chain, int n, float x, int *i )
+{
+	while( *i < n - 2  &&  chain[*i+1].x < x )
+		(*i)++;
+
+	glm::vec2 a = chain[*i];
+	glm::vec2 b = chain[*i+1];
+	if( b.x <= a.x )
+		return a.y;
+	return a.y + ( x - a.x ) / ( b.x - a.x ) * ( b.y - a.y );
+}
+
+
+// raise the columns hull covers all the way across, where it reaches down to what
+//	is covered already:
+// (hull comes from ConvexHull( ), so it runs along the bottom from the leftmost point to
+//	the rightmost, then back along the top -- and over a column, a convex polygon is
+//	lowest at one of its sides, and highest at one of them too)
+
+void
+Horizon::CoverColumns( glm::vec2 *hull, int n )
+{
+	int right = 0;
+	for( int i = 1; i < n; i++ )
+	{
+		if( hull[i].x > hull[right].x )
+			right = i;
+	}
+
+	glm::vec2 *lower = hull;			// hull[0] .. hull[right]
+	int numLower = right + 1;
+	glm::vec2 upper[MAX_CLIPPED_POINTS+1];		// hull[0], hull[n-1] .. hull[right]
+	int numUpper = 0;
+	upper[numUpper++] = hull[0];
+	for( int i = n - 1; i >= right; i-- )
+		upper[numUpper++] = hull[i];
+
+	int columns = (int)heights.size( );
+	int c0 = (int)ceilf( ( hull[0].x + 1.f ) / 2.f * (float)columns );
+	int c1 = (int)floorf( ( hull[right].x + 1.f ) / 2.f * (float)columns ) - 1;
+	if( c0 < 0 )		c0 = 0;
+	if( c1 > columns - 1 )	c1 = columns - 1;
+	if( c0 > c1 )
+		return;
+
+	int li = 0, ui = 0;
+	float x = -1.f + 2.f * (float)c0 / (float)columns;
+	float lo0 = ChainAt( lower, numLower, x, &li );
+	float hi0 = ChainAt( upper, numUpper, x, &ui );
+	for( int c = c0; c <= c1; c++ )
+	{
+		x = -1.f + 2.f * (float)( c + 1 ) / (float)columns;
+		float lo1 = ChainAt( lower, numLower, x, &li );
+		float hi1 = ChainAt( upper, numUpper, x, &ui );
+
+		float lo = fmaxf( lo0, lo1 );
+		float hi = fminf( hi0, hi1 );
+		if( lo <= heights[c]  &&  hi > heights[c] )
+			heights[c] = hi;
+
+		lo0 = lo1;
+		hi0 = hi1;
+	}
+}
+
+
+// true if the box ( boxMin, boxMax ) is entirely under the horizon:
+// (a box that reaches nearer than the near plane, or is off the sides of the screen, never is)
+
+bool
+Horizon::Hides( glm::vec3 boxMin, glm::vec3 boxMax )
+{
+	int columns = (int)heights.size( );
+	float minX = 0.f, maxX = 0.f, maxY = 0.f;
+	for( int i = 0; i < 8; i++ )
+	{
+		glm::vec4 corner = glm::vec4(
+			( i & 1 ) ? boxMax.x : boxMin.x,
+			( i & 2 ) ? boxMax.y : boxMin.y,
+			( i & 4 ) ? boxMax.z : boxMin.z, 1.f );
+		glm::vec4 clip = mvp * corner;
+		if( clip.z < -clip.w )		// nearer than the near plane
+			return false;
+
+		float x = clip.x / clip.w;
+		float y = clip.y / clip.w;
+		minX = ( i == 0 ) ? x : fminf( minX, x );
+		maxX = ( i == 0 ) ? x : fmaxf( maxX, x );
+		maxY = ( i == 0 ) ? y : fmaxf( maxY, y );
+	}
+
+	if( maxX < -1.f  ||  minX > 1.f )
+		return false;
+
+	int c0 = (int)floorf( ( minX + 1.f ) / 2.f * (float)columns );
+	int c1 = (int)floorf( ( maxX + 1.f ) / 2.f * (float)columns );
+	if( c0 < 0 )		c0 = 0;
+	if( c1 > columns - 1 )	c1 = columns - 1;
+
+	for( int c = c0; c <= c1; c++ )
+	{
+		if( maxY >= heights[c] )
+			return false;
+	}
+	return true;
+}
+
+
+void
+Horizon::Init( int columns )
+{
+	heights.assign( columns, -1.f );
+	mvp = glm::mat4( 1.f );
+}
+
+
+// which side of the line from a to b p is on: > 0 on the left
+
+static float
+Cross( glm::vec2 a, glm::vec2 b, glm::vec2 p )
+{
+	return ( b.x - a.x ) * ( p.y - a.y ) - ( b.y - a.y ) * ( p.x - a.x );
+}
+
+
+// the convex hull of the n points (which get sorted), counterclockwise into hull[ ] (which
+//	needs room for n+1), by Andrew's monotone chain -- returns how many points it has:
+
+static int
+ConvexHull( glm::vec2 *points, int n, glm::vec2 *hull )
+{
+	std::sort( points, points + n, []( glm::vec2 a, glm::vec2 b ) { return a.x < b.x  ||  ( a.x == b.x  &&  a.y < b.y ); } );
+
+	int k = 0;
+	for( int i = 0; i < n; i++ )				// lower half
+	{
+		while( k >= 2  &&  Cross( hull[k-2], hull[k-1], points[i] ) <= 0.f )
+			k--;
+		hull[k++] = points[i];
+	}
+	for( int i = n - 2, lower = k + 1; i >= 0; i-- )	// upper half
+	{
+		while( k >= lower  &&  Cross( hull[k-2], hull[k-1], points[i] ) <= 0.f )
+			k--;
+		hull[k++] = points[i];
+	}
+	return k - 1;						// the last point is the first one again
+}
+
+
+// add everything under the floor of the box ( boxMin, boxMax ) to the horizon:
+// (clipped to the near plane first, so a floor that reaches behind the eye still counts)
+
+void
+Horizon::Occlude( glm::vec3 boxMin, glm::vec3 boxMax )
+{
+	glm::vec4 corners[8];
+	for( int i = 0; i < 8; i++ )
+	{
+		corners[i] = mvp * glm::vec4(
+			( i & 1 ) ? boxMax.x : boxMin.x,
+			( i & 2 ) ? boxMin.y : boxMin.y - OCCLUDER_DEPTH,
+			( i & 4 ) ? boxMax.z : boxMin.z, 1.f );
+	}
+
+	// the solid's corners in front of the near plane, and where its edges cross it:
+	glm::vec2 points[MAX_CLIPPED_POINTS];
+	int numPoints = 0;
+	for( int i = 0; i < 8; i++ )
+	{
+		glm::vec4 a = corners[i];
+		float da = a.z + a.w;		// >= 0 beyond the near plane
+		if( da >= 0.f )
+			points[numPoints++] = glm::vec2( a ) / a.w;
+
+		for( int axis = 1; axis < 8; axis <<= 1 )
+		{
+			if( i & axis )
+				continue;
+			glm::vec4 b = corners[ i | axis ];
+			float db = b.z + b.w;
+			if( ( da >= 0.f ) != ( db >= 0.f ) )
+			{
+				glm::vec4 p = a + ( da / ( da - db ) ) * ( b - a );
+				points[numPoints++] = glm::vec2( p ) / p.w;
+			}
+		}
+	}
+
+	if( numPoints >= 3 )
+	{
+		glm::vec2 hull[MAX_CLIPPED_POINTS+1];
+		int numHull = ConvexHull( points, numPoints, hull );
+		if( numHull >= 3 )
+			CoverColumns( hull, numHull );
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef HORIZON_H
+#define HORIZON_H
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+
+//********************************************************************************
+// a 1D screen-space horizon for occlusion culling a heightfield front to back:
+//	each column of the screen remembers how high up from the bottom it is
+//	already covered, and a box that projects entirely under that line is hidden
+//
+// the occluders are everything under the floors of boxes that bound pieces of the
+//	heightfield from below: when the eye is above the terrain, any ray that passes
+//	under the terrain somewhere has already hit it, so whatever it reaches farther on
+//	is hidden (it is up to the caller to only add an occluder before testing boxes
+//	farther away)
+//********************************************************************************
+
+
+class Horizon
+{
+  private:
+	std::vector<float>	heights;	// ndc y each column is covered up to, from the bottom
+	glm::mat4		mvp;		// model coordinates to clip coordinates
+
+	void	CoverColumns( glm::vec2 *, int );
+
+  public:
+	void	Begin( glm::mat4 );
+	bool	Hides( glm::vec3, glm::vec3 );
+	void	Init( int );
+	void	Occlude( glm::vec3, glm::vec3 );
+};
+
+#endif	// HORIZON_H
@@ -0,0 +1,132 @@
+// The terrain's height function, shared by the shaders that #include it
+// (GLSLProgram expands the #include).
+//
+// The including shader declares uModelMatrix and uViewMatrix first.
+//
+// Permutations:
+//   ADAPTIVE_OCTAVES -- fade out the octaves too small to see from here
+
+uniform float uOffsetX;
+uniform float uOffsetZ;
+
+#ifdef ADAPTIVE_OCTAVES
+uniform float uOctaveLodScale; // Pixels covered by one unit of height at a view distance of 1
+uniform float uOctaveError;    // Octaves shorter than this many pixels are faded out
+#endif
+
+// An integer hash of a lattice point (PCG, see terrainnoise.cpp), so the cpu
+// copy of the noise picks exactly the same gradients whatever the gpu's sin()
+// is like. The cell coordinates wrap around as uint's, the same as on the cpu.
+uint pcgHash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint hash(vec2 p)
+{
+    ivec2 cell = ivec2(p);  // (p is already a whole number)
+    return pcgHash(uint(cell.x) + pcgHash(uint(cell.y)));
+}
+
+// Sixteen directions around the unit circle, written out so that nothing is
+// left to the gpu's cos() and sin() (NOISE_GRADIENTS in terrainnoise.cpp)
+const vec2 GRADIENTS[16] = vec2[16](
+    vec2( 1.00000000,  0.00000000), vec2( 0.92387953,  0.38268343),
+    vec2( 0.70710678,  0.70710678), vec2( 0.38268343,  0.92387953),
+    vec2( 0.00000000,  1.00000000), vec2(-0.38268343,  0.92387953),
+    vec2(-0.70710678,  0.70710678), vec2(-0.92387953,  0.38268343),
+    vec2(-1.00000000,  0.00000000), vec2(-0.92387953, -0.38268343),
+    vec2(-0.70710678, -0.70710678), vec2(-0.38268343, -0.92387953),
+    vec2( 0.00000000, -1.00000000), vec2( 0.38268343, -0.92387953),
+    vec2( 0.70710678, -0.70710678), vec2( 0.92387953, -0.38268343));
+
+vec2 randomGradient(vec2 gridPoint)
+{
+    // The low bits of the hash pick one of the directions
+    return GRADIENTS[hash(gridPoint) & 15u];
+}
+
+float perlin(vec2 point)
+{
+    // Integer part of the coordinates (the "cell" that contains this point)
+    // Fractional part of the coordinates (how far into the cell the coordinates are)
+    vec2 gridPoint = floor(point);  
+    vec2 offset = point - gridPoint; 
+
+    // Get gradients (2D vector) for each corner of the "cell"
+    vec2 g00 = randomGradient(gridPoint + vec2(0.0, 0.0));
+    vec2 g10 = randomGradient(gridPoint + vec2(1.0, 0.0));
+    vec2 g01 = randomGradient(gridPoint + vec2(0.0, 1.0));
+    vec2 g11 = randomGradient(gridPoint + vec2(1.0, 1.0));
+
+    // Calculate dot product for coordinate and each corner (distance to each gradient)
+    float d00 = dot(g00, offset - vec2(0.0, 0.0));
+    float d10 = dot(g10, offset - vec2(1.0, 0.0));
+    float d01 = dot(g01, offset - vec2(0.0, 1.0));
+    float d11 = dot(g11, offset - vec2(1.0, 1.0));
+
+    // Interpolate between the values (linear interpolation)
+    float u = offset.x;  // X interpolation factor
+    float v = offset.y;  // Y interpolation factor
+
+    float nx0 = mix(d00, d10, u);
+    float nx1 = mix(d01, d11, u);
+
+    // Returns a value between -1 and +1
+    return mix(nx0, nx1, v);  // Final interpolation between the two results
+}
+
+// `octaves` can have a fraction, which fades the last octave in
+float perlinMultiOctave(vec2 point, float octaves, float persistence)
+{
+    float total = 0.0;
+    float frequency = 1.0;  // Base frequency (larger values for more zoomed-in noise)
+    float amplitude = 1.0;  // Base amplitude (larger values for more influence)
+
+    for (int i = 0; float(i) < octaves; i++) {
+        float weight = min(octaves - float(i), 1.0);  // 1 except for a fractional last octave
+        total += perlin(point * frequency) * amplitude * weight;  // Apply Perlin noise with frequency and amplitude
+        frequency *= 2;  // Double the frequency for next octave (zoom in)
+        amplitude *= persistence;  // Decrease the amplitude (less influence as octaves increase)
+    }
+
+    return total;
+}
+
+float getHeight(float x, float z, float scale, float octaves, float persistence)
+{
+    float height = perlinMultiOctave(vec2(x,z) * scale, octaves, persistence);
+    //return max(30 * height, -9);
+    return 30 * height;
+}
+
+// How many octaves are worth evaluating at grid position (x, z). Octave i is
+// 30 * 0.6^i tall, so it drops under uOctaveError pixels at i = f below; the
+// fraction fades the last octave out instead of popping it.
+// (AdaptiveOctaves() in the C++ code does the same thing to report the average)
+float getOctaves(float x, float z)
+{
+#ifdef ADAPTIVE_OCTAVES
+    vec4  pointEC  = uViewMatrix * uModelMatrix * vec4(x, 0., z, 1.);
+    float distance = max(length(pointEC.xyz), 0.001);
+    float f = log(uOctaveError * distance / (30. * uOctaveLodScale)) / log(0.6);
+    return clamp(f + 1., 1., 6.);
+#else
+    return 6.;
+#endif
+}
+
+// Height of the terrain at `position` in the noise's own coordinates (the
+// grid position plus the offset)
+float getNoiseHeight(vec2 position, float octaves)
+{
+    return getHeight(position.x, position.y, 0.01f, octaves, 0.6f);
+}
+
+// Height of the terrain at grid position (x, z)
+float getTerrainHeight(float x, float z)
+{
+    return getNoiseHeight(vec2(x+uOffsetX, z+uOffsetZ), getOctaves(x, z));
+}
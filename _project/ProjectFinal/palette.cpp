@@ -0,0 +1,60 @@
+#include "palette.h"
+
+
+// fill rgba with PALETTE_SIZE colors covering heights minHeight to maxHeight:
+// (entry i covers [ minHeight + i*step, minHeight + (i+1)*step ), so a hard stop that
+//	falls on an entry boundary switches colors at exactly that height)
+
+void
+BakePalette( const struct Palette *p, float minHeight, float maxHeight, float rgba[ ] )
+{
+	float step = ( maxHeight - minHeight ) / (float)PALETTE_SIZE;
+
+	for( int i = 0; i < PALETTE_SIZE; i++ )
+	{
+		// hard palettes look at the bottom of each entry, smooth ones at the middle:
+		float h = minHeight + ( (float)i + ( p->smooth ? 0.5f : 0.f ) ) * step;
+
+		int s = 0;
+		while( s + 1 < p->numStops  &&  p->stops[s+1].height <= h )
+			s++;
+
+		const struct PaletteStop *s0 = &p->stops[s];
+		const struct PaletteStop *s1 = ( s + 1 < p->numStops ) ? &p->stops[s+1] : s0;
+
+		float t = 0.f;
+		if( p->smooth  &&  s1 != s0  &&  h > s0->height )
+			t = ( h - s0->height ) / ( s1->height - s0->height );
+
+		rgba[4*i+0] = s0->r + t * ( s1->r - s0->r );
+		rgba[4*i+1] = s0->g + t * ( s1->g - s0->g );
+		rgba[4*i+2] = s0->b + t * ( s1->b - s0->b );
+		rgba[4*i+3] = 1.f;
+	}
+}
+
+
+// one layer per palette -- needs a current GL context:
+// (float texels, so the colors come back exactly as they are written in the palettes)
+
+GLuint
+CreatePaletteTexture( const struct Palette palettes[ ], int numPalettes, float minHeight, float maxHeight )
+{
+	float *texels = new float[ 4 * PALETTE_SIZE * numPalettes ];
+	for( int p = 0; p < numPalettes; p++ )
+		BakePalette( &palettes[p], minHeight, maxHeight, &texels[ 4 * PALETTE_SIZE * p ] );
+
+	GLuint tex;
+	glGenTextures( 1, &tex );
+	glBindTexture( GL_TEXTURE_1D_ARRAY, tex );
+	glTexImage2D( GL_TEXTURE_1D_ARRAY, 0, GL_RGBA32F, PALETTE_SIZE, numPalettes, 0, GL_RGBA, GL_FLOAT, texels );
+
+	// the blending is baked into the smooth palettes, so filtering would only blur the hard ones:
+	glTexParameteri( GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_1D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_1D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glBindTexture( GL_TEXTURE_1D_ARRAY, 0 );
+
+	delete [ ] texels;
+	return tex;
+}
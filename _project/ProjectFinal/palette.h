@@ -0,0 +1,46 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdio.h>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include "glew.h"
+#include <GL/gl.h>
+#endif
+
+
+//********************************************************************************
+// height-band color palettes, baked into one row each of a 1D texture array
+//	so the fragment shader colors by height with a single texture fetch
+//
+// a palette is a list of stops, each giving the color from its height up:
+//	hard palettes switch colors at each stop, smooth ones blend between them
+//********************************************************************************
+
+
+// number of entries in each palette:
+
+const int PALETTE_SIZE = 256;
+
+
+struct PaletteStop
+{
+	float	height;
+	float	r, g, b;
+};
+
+
+struct Palette
+{
+	const struct PaletteStop *	stops;		// sorted by height
+	int				numStops;
+	bool				smooth;
+};
+
+
+void	BakePalette( const struct Palette *, float, float, float [ ] );
+GLuint	CreatePaletteTexture( const struct Palette [ ], int, float, float );
+
+#endif	// PALETTE_H
@@ -206,6 +206,7 @@ float   OffsetX, OffsetZ;
 
 void	Animate();
 void	Display();
+void	DrawScene(GLsizei, GLsizei);
 void	DoAxesMenu(int);
 void	DoColorMenu(int);
 void	DoDepthBufferMenu(int);
@@ -216,9 +217,11 @@ void	DoMainMenu(int);
 void	DoProjectMenu(int);
 void	DoRasterString(float, float, float, char*);
 void	DoStrokeString(float, float, float, float, char*);
+void	DrawTimingHud();
 float	ElapsedSeconds();
 void	InitGraphics();
 void	InitLists();
+void	InitTerrain();
 void	InitMenus();
 void	Keyboard(unsigned char, int, int);
 void    KeyUp(unsigned char, int, int);
@@ -226,7 +229,10 @@ void    KeyDown(unsigned char, int, int);
 void	MouseButton(int, int, int, int);
 void	MouseMotion(int, int);
 void	Reset();
+void	UpdateShaderReload();
 void	Resize(int, int);
+int	RunHeadlessBenchmark(int, char*[]);
+int	RunTileDaemon(int, char*[]);
 void	Visibility(int);
 
 void			Axes(float);
@@ -315,14 +321,40 @@ TimeOfDaySeed()
 //#include "bmptotexture.cpp"
 //#include "loadobjfile.cpp"
 //#include "keytime.cpp"
+#define TRACE_ZONES // record zones for the chrome://tracing dump
+#include "tracezones.cpp"
 #define GEOMETRY // enable geometry shader
+#define TESSELLATION // enable tessellation shaders
+#define COMPUTE // enable compute shaders
 #include "glslprogram.cpp"
 //#include "vertexbufferobject.cpp"
+#include "frametimer.cpp"
+#include "shaderwatcher.cpp"
+#include "palette.cpp"
+#include "terrainnoise.cpp"
+#include "horizon.cpp"
+#include "terrainchunks.cpp"
+#include "dynamicresolution.cpp"
+#include "tilepool.cpp"
+#include "tilecodec.cpp"
+#include "tilecache.cpp"
+#include "tileshared.cpp"
+#include "tilestore.cpp"
+#include "tileservice.cpp"
+#include "terraintiles.cpp"
+#include "uploadring.cpp"
+#include "tileuploader.cpp"
+#ifdef HEADLESS
+#include "headless.cpp"
+#include "tilequeue.cpp"
+#endif
 
 // Mesh variables
 
 #define GRID_SIZE                 100
-#define GRID_RES_LOW              100 // min 2
+#ifndef GRID_RES_LOW
+#define GRID_RES_LOW              100 // min 2 -- can be set on the compile line to benchmark bigger meshes
+#endif
 
 #define SPEED_SCALE               100
 
@@ -330,13 +362,57 @@ TimeOfDaySeed()
 #define POS_COORDS_PER_VERT       3
 #define TEX_COORDS_PER_VERT       2
 
-GLSLProgram  Terrain;
+#define NUM_TERRAIN_VERTS         (VERTS_PER_CELL * GRID_RES_LOW * GRID_RES_LOW)
+
+#define TESS_PATCHES              16  // patches along each side of the grid in the tessellated path
+#define VERTS_PER_PATCH           4
+
+#define NUM_TERRAIN_PATCH_VERTS   (VERTS_PER_PATCH * TESS_PATCHES * TESS_PATCHES)
+
+#ifndef CHUNK_CELLS
+#define CHUNK_CELLS               16  // grid cells along each side of a chunk in the chunked path -- a power of 2
+#endif
+
+#ifndef HORIZON_COLUMNS
+#define HORIZON_COLUMNS           128 // screen columns the horizon culling keeps track of
+#endif
+
+#ifndef TILE_UPLOAD_BUDGET
+#define TILE_UPLOAD_BUDGET        (64 * 1024) // bytes of cpu tiles to send to the gpu per frame, at most
+#endif
+
+#ifndef TILE_GPU_CACHE_BYTES
+#define TILE_GPU_CACHE_BYTES      (256 * 1024) // cpu tiles the gpu has room for -- the window needs 64 of them
+#endif
+#define TILE_UPLOAD_RING_BYTES    (1024 * 1024) // staging for the uploads still in flight
+
+#ifndef RESOLUTION_TARGET_MS
+#define RESOLUTION_TARGET_MS      16.6f // frame time the dynamic resolution starts out aiming for
+#endif
+
+// Noise parameters (as in getTerrainHeight() in terrain.vert)
+
+#define NOISE_OCTAVES             6
+#define NOISE_PERSISTENCE         0.6f
+#define NOISE_HEIGHT              30.f
+
+GLSLProgram  TerrainBase;             // Init( )'ed once there is a context -- each variant starts as a copy of it
+GLSLProgram* Terrain = NULL;          // the variant for the current theme
+
+// Shader hot reload
+
+std::map<std::string, GLSLProgram*> PendingVariants;  // being rebuilt in the background while the old ones keep drawing
+
+const char*  TerrainShaderFiles[] = { "terrain.vert", "terrain.tcs", "terrain.tes", "terrain.geom", "terrain.frag", "terrain.comp", "noise.glsl" };
+ShaderWatcher TerrainShaderWatcher;
 
 GLuint       VertexBuffer;
 GLuint       TexCoordsBuffer;
+GLuint       PatchBuffer;
 
 GLfloat      VertexArray[POS_COORDS_PER_VERT * VERTS_PER_CELL * GRID_RES_LOW * GRID_RES_LOW];
 GLfloat      TexCoordsArray[TEX_COORDS_PER_VERT * VERTS_PER_CELL * GRID_RES_LOW * GRID_RES_LOW];
+GLfloat      PatchArray[POS_COORDS_PER_VERT * NUM_TERRAIN_PATCH_VERTS];
 
 // Input controls
 
@@ -362,17 +438,243 @@ enum ColorThemes
 	SYNTHWAVE,
 	TRON,
 	HEATMAP,
-	NORMAL_MAP
+	NORMAL_MAP,
+	HEATMAP_SMOOTH
 };
 
 int CurrentTheme = EARTH;
 
+// Shader permutations
+
+// the #define's each ColorThemes entry compiles the terrain shaders with:
+// (see the top of terrain.frag)
+const char*  ThemeDefines[] =
+{
+	"MULTICOLOR",             // EARTH
+	"",                       // SOLID
+	"UNLIT WIREFRAME",        // WIRE_LIGHT
+	"UNLIT WIREFRAME",        // WIRE_DARK
+	"UNLIT WIREFRAME",        // SYNTHWAVE
+	"UNLIT WIREFRAME",        // TRON
+	"MULTICOLOR",             // HEATMAP
+	"NORMAL_MAP UNLIT",       // NORMAL_MAP
+	"MULTICOLOR"              // HEATMAP_SMOOTH
+};
+const int    NUM_THEMES = sizeof(ThemeDefines) / sizeof(ThemeDefines[0]);
+
+std::map<std::string, GLSLProgram*> TerrainVariants;  // keyed by their #define's, so themes can share them
+
+// Height-band palettes (see palette.h)
+
+#define PALETTE_MIN_HEIGHT        -32.f   // Heights at the ends of the palettes -- anything
+#define PALETTE_MAX_HEIGHT         32.f   // beyond them gets the end colors
+
+const PaletteStop EarthStops[] =
+{
+	{ PALETTE_MIN_HEIGHT, .17f, .44f, .50f },  // water
+	{ -8.f,               .45f, .54f, .28f },  // grass
+	{  2.f,               .46f, .35f, .25f },  // rock
+	{  9.f,               1.0f, 1.0f, 1.0f }   // snow
+};
+
+const PaletteStop HeatmapStops[] =
+{
+	{ PALETTE_MIN_HEIGHT, 0.f, 0.f, 1.f },
+	{ -8.f,               0.f, 1.f, 0.f },
+	{  2.f,               1.f, 1.f, 0.f },
+	{  9.f,               1.f, 0.f, 0.f }
+};
+
+const PaletteStop SmoothHeatmapStops[] =
+{
+	{ -20.f, 0.f, 0.f, .5f },
+	{ -10.f, 0.f, 0.f, 1.f },
+	{  -3.f, 0.f, 1.f, 1.f },
+	{   2.f, 0.f, 1.f, 0.f },
+	{   7.f, 1.f, 1.f, 0.f },
+	{  13.f, 1.f, 0.f, 0.f },
+	{  20.f, .5f, 0.f, 0.f }
+};
+
+enum PaletteLayers
+{
+	EARTH_PALETTE,
+	HEATMAP_PALETTE,
+	HEATMAP_SMOOTH_PALETTE
+};
+
+const Palette ThemePalettes[] =
+{
+	{ EarthStops,         sizeof(EarthStops) / sizeof(EarthStops[0]),                 false },
+	{ HeatmapStops,       sizeof(HeatmapStops) / sizeof(HeatmapStops[0]),             false },
+	{ SmoothHeatmapStops, sizeof(SmoothHeatmapStops) / sizeof(SmoothHeatmapStops[0]), true  }
+};
+const int    NUM_PALETTES = sizeof(ThemePalettes) / sizeof(ThemePalettes[0]);
+
+GLuint       PaletteTexture;
+
+// Wireframe
+
+bool         LineModeWireframe = false;     // draw the wireframe themes with glPolygonMode( GL_LINE ) instead
+const float  WIREFRAME_LINE_WIDTH = 1.f;    // pixels
+
+// Flat shading
+
+bool         GeometryShaderOn = true;       // false = flat shade in terrain.vert/.frag without terrain.geom
+
+// Adaptive octaves
+
+bool         AdaptiveOctavesOn = false;     // fade out the octaves too small to see from each vertex
+float        OctaveErrorPixels = 1.f;       // error budget: octaves shorter than this many pixels are faded out
+float        AverageOctaves = NOISE_OCTAVES; // per vertex, in the last frame drawn
+
+#define OCTAVE_SAMPLES            4096      // vertices AverageAdaptiveOctaves( ) looks at
+
+// Tessellation
+
+bool         TessellationOn = false;        // draw a coarse grid of patches and let terrain.tcs split them up
+float        TessTrianglePixels = 8.f;      // how long terrain.tcs tries to make the triangle edges on screen
+
+float        AdaptiveOctaves(glm::mat4, float, float, float);
+float        AverageAdaptiveOctaves(glm::mat4, float);
+bool         BuildTerrainProgram(GLSLProgram*, bool);
+std::string  GetThemeDefines(int);
+GLSLProgram* GetTerrainVariant(const char*);
+
+// Heightmap pass
+
+bool         HeightmapPassOn = false;       // compute the heights once per grid point in terrain.comp, then just fetch them
+GLuint       HeightmapTexture;              // GRID_RES_LOW x GRID_RES_LOW heights, for any pass that wants them
+bool         HeightmapStale = true;         // recompute it even if nothing it depends on has changed
+int          HeightmapUpdates = 0;          // times it has been recomputed
+
+#define HEIGHTMAP_GROUP_SIZE      8         // as local_size_x and _y in terrain.comp
+
+std::string  GetHeightmapDefines();
+void         UpdateHeightmap(glm::mat4, glm::mat4, float);
+
+// Chunks
+
+bool         ChunksOn = false;              // draw the terrain as chunks with their own level of detail
+bool         MultiDrawOn = true;            // all the chunks in one glMultiDrawElementsIndirect( ) instead of one draw each
+float        ChunkCellPixels = 16.f;        // a chunk gets coarser once its cells would be smaller than this on screen
+TerrainChunks Chunks;
+int          TerrainDrawCalls = 0;          // in the last frame drawn
+
+// Horizon culling
+
+bool         HorizonCullingOn = false;      // skip the chunks hidden behind nearer ridges
+float        HorizonMargin = 0.5f;          // added to the chunks' height bounds, to be on the safe side (see TerrainChunks::Cull( ))
+Horizon      ChunkHorizon;
+int          HorizonChunks = 0;             // chunks tested in the last frame drawn
+int          HorizonCulled = 0;             // and how many of them were hidden
+long long    HorizonChunksTotal = 0;        // the same since the stats were last cleared
+long long    HorizonCulledTotal = 0;
+
+// Dynamic resolution
+
+bool         DynamicResolutionOn = false;   // draw the scene at whatever fraction of the viewport holds the target frame time
+DynamicResolution Resolution;
+double       ResolutionScaleTotal = 0.;     // summed over the frames drawn since the stats were last cleared
+int          ResolutionFrames = 0;
+
+// CPU tiles
+
+bool         CpuTilesOn = false;            // make the window's heights on the cpu too, a tile per chunk
+int          TileWorkers = -1;              // threads making them -- -1 for one less than the cores, 0 for none
+bool         TileWorkersStarted = false;
+TerrainTiles Tiles;
+#ifdef TILE_STORE_FILE
+const char*  TileStoreFile = TILE_STORE_FILE; // keep the tiles in this file, and look there before making any
+#else
+const char*  TileStoreFile = NULL;            // (#define TILE_STORE_FILE on the compile line for a kiosk that replays one world)
+#endif
+bool         TileSharedOn = false;          // share the tiles with the other viewers on this machine
+const char*  TileServiceSocket = NULL;      // ask the tile service daemon listening here for the tiles (--tile-service)
+
+void         StartTileWorkers();
+
+// Tile uploads
+
+bool         TileUploadsOn = false;         // send the cpu tiles to the gpu, and draw the chunks from them
+int          TileGpuCacheBytes = TILE_GPU_CACHE_BYTES;
+TileUploader Uploader;
+
+// Multiple views
+
+enum ViewCameras
+{
+	FLYOVER_CAMERA,                         // the one the mouse turns
+	MAP_CAMERA                              // looking straight down on the whole grid
+};
+
+#define MAP_CAMERA_HEIGHT         100.f     // above the highest the noise reaches
+
+struct TerrainView
+{
+	float        left, bottom, width, height;   // fractions of the square viewport
+	int          camera;                        // ViewCameras
+	int          theme;                         // ColorThemes, or -1 for CurrentTheme
+};
+
+bool         MultiViewOn = false;           // draw all of Views, fetching their heights from one heightmap pass a frame
+TerrainView  Views[] =
+{
+	{ 0.f,   0.f,   1.f,   1.f,   FLYOVER_CAMERA, -1 },         // the flyover, in the current theme
+	{ 0.65f, 0.65f, 0.35f, 0.35f, MAP_CAMERA,     HEATMAP },    // a map, top right
+	{ 0.f,   0.65f, 0.35f, 0.35f, FLYOVER_CAMERA, SYNTHWAVE }   // the flyover in another theme, top left
+};
+const int    MAX_VIEWS = sizeof(Views) / sizeof(Views[0]);
+int          NumViews = MAX_VIEWS;          // how many of them to draw
+
+void         DrawView(TerrainView*, GLint, GLint, GLsizei, bool);
+
+// Frame timing
+
+FrameStat    FrameTime;       // Time between successive calls to Display()
+FrameStat    UpdateTime;      // CPU time processing input
+FrameStat    UniformTime;     // CPU time setting matrices and theme uniforms
+FrameStat    DrawTime;        // CPU time submitting the terrain draw
+FrameStat    TerrainGpuTime;  // GPU time drawing the terrain
+
+FrameStat*   FrameStats[] = { &FrameTime, &UpdateTime, &UniformTime, &DrawTime, &TerrainGpuTime };
+const int    NUM_FRAME_STATS = sizeof(FrameStats) / sizeof(FrameStats[0]);
+
+GpuTimer     TerrainGpuTimer;
+
+bool         TimingHudOn = false;
+
+const char*  FRAME_STATS_CSV = "frametimes.csv";
+const char*  TRACE_JSON = "trace.json";
+
+// Headless benchmark
+
+#define HEADLESS_DEFAULT_SIZE     1024
+#define HEADLESS_DEFAULT_FRAMES   300
+#define HEADLESS_WARMUP_FRAMES    10
+#define HEADLESS_QUEUE_TEST_ITEMS 200000
+#define HEADLESS_CODEC_TEST_TILES 4096
+#define HEADLESS_CODEC_TEST_CELLS 1024
+
 
 // main program:
 
 int
 main(int argc, char* argv[])
 {
+	// the headless benchmark and the tile daemon never open a window, so look for them before
+	// glutInit( ) does:
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+			return RunHeadlessBenchmark(argc, argv);
+		if (strcmp(argv[i], "--tile-daemon") == 0)
+			return RunTileDaemon(argc, argv);
+		if (strcmp(argv[i], "--tile-service") == 0 && i + 1 < argc)
+			TileServiceSocket = argv[++i];
+	}
+
 	// turn on the glut package:
 	// (do this before checking argc and argv since glutInit might
 	// pull some command line arguments out)
@@ -442,11 +744,53 @@ Display()
 	if (DebugOn != 0)
 		fprintf(stderr, "Starting Display.\n");
 
+	TRACE_ZONE("Display");
+
 	// set which window we want to do the graphics into:
 	glutSetWindow(MainWindow);
 
-	// erase the background:
+	// draw into the back buffer:
 	glDrawBuffer(GL_BACK);
+
+	DrawScene(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+
+	// swap the double-buffered framebuffers:
+
+	TRACE_ZONE_BEGIN(swapZone, "Swap");
+	glutSwapBuffers();
+
+	// be sure the graphics buffer has been sent:
+	// note: be sure to use glFlush( ) here, not glFinish( ) !
+
+	glFlush();
+	TRACE_ZONE_END(swapZone);
+}
+
+
+// draw the terrain into the currently bound draw buffer:
+// (vx and vy are the size of the window or offscreen framebuffer)
+
+void
+DrawScene(GLsizei vx, GLsizei vy)
+{
+	// time since the last frame started:
+	static std::chrono::high_resolution_clock::time_point lastFrameStart;
+	std::chrono::high_resolution_clock::time_point frameStart = std::chrono::high_resolution_clock::now();
+	if (lastFrameStart.time_since_epoch().count() != 0)
+		FrameTime.Add(std::chrono::duration<float, std::milli>(frameStart - lastFrameStart).count());
+	lastFrameStart = frameStart;
+
+	// pick up any gpu timings that have come back from earlier frames:
+	bool gpuSample = TerrainGpuTimer.Collect();
+
+	// and steer the resolution by them:
+	if (DynamicResolutionOn)
+		Resolution.Update(gpuSample, TerrainGpuTime.Last(), FrameTime.Last());
+
+	// swap in edited shaders once they have finished building:
+	UpdateShaderReload();
+
+	// erase the background:
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	glEnable(GL_DEPTH_TEST);
@@ -457,11 +801,19 @@ Display()
 
 	// set the viewport to be a square centered in the window:
 
-	GLsizei vx = glutGet(GLUT_WINDOW_WIDTH);
-	GLsizei vy = glutGet(GLUT_WINDOW_HEIGHT);
 	GLsizei v = vx < vy ? vx : vy;			// minimum dimension
 	GLint xl = (vx - v) / 2;
 	GLint yb = (vy - v) / 2;
+
+	// or draw a smaller square offscreen, and stretch it over that one at the end:
+	if (DynamicResolutionOn)
+	{
+		v = Resolution.Begin(xl, yb, v);
+		xl = yb = 0;
+		ResolutionScaleTotal += Resolution.GetScale();
+		ResolutionFrames++;
+	}
+
 	glViewport(xl, yb, v, v);
 
 
@@ -530,6 +882,9 @@ Display()
 
 	// ===== Process input =====
 
+	CpuTimer updateTimer(&UpdateTime);
+	TRACE_ZONE_BEGIN(updateZone, "Update");
+
 	if (CurrentScrollMode == MANUAL)
 	{
 		if (wKeyDown) OffsetZ -= 1;
@@ -543,31 +898,134 @@ Display()
 		OffsetZ -= 1;
 	}
 
-	Terrain.SetUniformVariable("uOffsetX", OffsetX / SPEED_SCALE);
-	Terrain.SetUniformVariable("uOffsetZ", OffsetZ / SPEED_SCALE);
+	updateTimer.Stop();
+	TRACE_ZONE_END(updateZone);
+
+	// ===== Views =====
+
+	// one view, of the whole square -- or every one of Views, all drawn from one heightmap pass:
+	TerrainView mainView = { 0.f, 0.f, 1.f, 1.f, FLYOVER_CAMERA, -1 };
+	int numViews = MultiViewOn ? NumViews : 1;
+	GLfloat clearColor[4];
+
+	TerrainDrawCalls = 0;
+	TerrainGpuTimer.Begin();
+	for (int i = 0; i < numViews; i++)
+	{
+		DrawView(MultiViewOn ? &Views[i] : &mainView, xl, yb, v, i == 0);
+
+		// (the window around the views, and the timing overlay, go with the first one's theme)
+		if (i == 0 && numViews > 1)
+			glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	}
+	if (numViews > 1)
+	{
+		glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+		glViewport(xl, yb, v, v);
+	}
+	TerrainGpuTimer.End();
+
+	// ===== Upscale =====
+
+	if (DynamicResolutionOn)
+	{
+		TRACE_ZONE("Upscale");
+		Resolution.End();
+	}
+
+	// ===== Timing overlay =====
+
+	if (TimingHudOn)
+	{
+		TRACE_ZONE("Timing HUD");
+		DrawTimingHud();
+	}
+
+	// =====
+
+	// draw some gratuitous text that just rotates on top of the scene:
+	// i commented out the actual text-drawing calls -- put them back in if you have a use for them
+	// a good use for thefirst one might be to have your name on the screen
+	// a good use for the second one might be to have vertex numbers on the screen alongside each vertex
+
+	//glDisable( GL_DEPTH_TEST );
+	//glColor3f( 0.f, 1.f, 1.f );
+	//DoRasterString( 0.f, 1.f, 0.f, (char *)"Text That Moves" );
+
+
+	// draw some gratuitous text that is fixed on the screen:
+	//
+	// the projection matrix is reset to define a scene whose
+	// world coordinate system goes from 0-100 in each axis
+	//
+	// this is called "percent units", and is just a convenience
+	//
+	// the modelview matrix is reset to identity as we don't
+	// want to transform these coordinates
+
+	/*glDisable( GL_DEPTH_TEST );
+	glMatrixMode( GL_PROJECTION );
+	glLoadIdentity( );
+	gluOrtho2D( 0.f, 100.f,     0.f, 100.f );
+	glMatrixMode( GL_MODELVIEW );
+	glLoadIdentity( );
+	glColor3f( 1.f, 1.f, 1.f );*/
+	//DoRasterString( 5.f, 5.f, 0.f, (char *)"Text That Doesn't" );
+}
+
+
+// draw one view of the terrain, into its part of the square viewport at (xl, yb) that is v pixels across:
+// (first is the first view drawn this frame -- DrawScene( ) has started the gpu timer, and cleared the window)
+
+void
+DrawView(TerrainView* view, GLint xl, GLint yb, GLsizei v, bool first)
+{
+	GLint x = xl + (GLint)(view->left * (float)v);
+	GLint y = yb + (GLint)(view->bottom * (float)v);
+	GLsizei w = (GLsizei)(view->width * (float)v);
+	GLsizei h = (GLsizei)(view->height * (float)v);
+	glViewport(x, y, w, h);
+
+	// all the views fetch the one heightmap, which can't fade the octaves for any one of them:
+	bool tessellate = TessellationOn && !MultiViewOn;
+	bool adaptiveOctaves = AdaptiveOctavesOn && !MultiViewOn;
+
+	CpuTimer uniformTimer(&UniformTime, !first);
+	TRACE_ZONE_BEGIN(uniformZone, "Uniforms");
+
+	// each theme has its own specialized program:
+	int theme = (view->theme >= 0) ? view->theme : CurrentTheme;
+	Terrain = GetTerrainVariant(GetThemeDefines(theme).c_str());
+
+	Terrain->SetUniformVariable("uOffsetX", OffsetX / SPEED_SCALE);
+	Terrain->SetUniformVariable("uOffsetZ", OffsetZ / SPEED_SCALE);
 
 
 	// ===== Model =====
 
 	glm::mat4 modelMatrix = glm::mat4(1.0f); // Identity matrix
 
-	// Scale
-	modelMatrix = glm::scale(modelMatrix, glm::vec3(Scale, Scale, Scale));
+	// (the map looks straight down on the grid, however the flyover is turned)
+	if (view->camera == FLYOVER_CAMERA)
+	{
+		// Scale
+		modelMatrix = glm::scale(modelMatrix, glm::vec3(Scale, Scale, Scale));
 
-	// Rotate
-	modelMatrix = glm::rotate(modelMatrix, (float)glm::radians(Xrot), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around X-axis
-	modelMatrix = glm::rotate(modelMatrix, (float)glm::radians(Yrot), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around Y-axis
+		// Rotate
+		modelMatrix = glm::rotate(modelMatrix, (float)glm::radians(Xrot), glm::vec3(1.0f, 0.0f, 0.0f)); // Rotate around X-axis
+		modelMatrix = glm::rotate(modelMatrix, (float)glm::radians(Yrot), glm::vec3(0.0f, 1.0f, 0.0f)); // Rotate around Y-axis
+	}
 
 	// Translate
 	modelMatrix = glm::translate(modelMatrix, glm::vec3(-GRID_SIZE / (float)2, 0, -GRID_SIZE / (float)2));
 
 	// Set uniform
-	Terrain.SetUniformVariable("uModelMatrix", modelMatrix);
+	Terrain->SetUniformVariable("uModelMatrix", modelMatrix);
 
 	// ===== Normal =====
 
 	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
-	Terrain.SetUniformVariable("uNormalMatrix", normalMatrix);
+	Terrain->SetUniformVariable("uNormalMatrix", normalMatrix);
 
 	// ===== View (Camera) =====
 
@@ -575,188 +1033,282 @@ Display()
 	glm::vec3 cameraDir = glm::vec3(0.0f, 0.0f, -20.0f); // Target position
 	glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f); // Up vector
 
+	// the map's camera is high over the middle of the grid, with the way the flyover is headed at the top:
+	if (view->camera == MAP_CAMERA)
+	{
+		cameraPos = glm::vec3(0.0f, MAP_CAMERA_HEIGHT, 0.0f);
+		cameraDir = glm::vec3(0.0f, 0.0f, 0.0f);
+		cameraUp = glm::vec3(0.0f, 0.0f, -1.0f);
+	}
+
 	glm::mat4 viewMatrix = glm::lookAt(cameraPos, cameraDir, cameraUp);
-	Terrain.SetUniformVariable("uViewMatrix", viewMatrix);
+	Terrain->SetUniformVariable("uViewMatrix", viewMatrix);
 
 	// ===== Projection =====
 
-	glm::mat4 projectionMatrix = glm::perspective(glm::radians(70.f), 1.f, 0.1f, 1000.f);
-	Terrain.SetUniformVariable("uProjectionMatrix", projectionMatrix);
+	glm::mat4 projectionMatrix = glm::perspective(glm::radians(70.f), (float)w / (float)h, 0.1f, 1000.f);
+	if (view->camera == MAP_CAMERA)
+		projectionMatrix = glm::ortho(-GRID_SIZE / 2.f, GRID_SIZE / 2.f, -GRID_SIZE / 2.f, GRID_SIZE / 2.f, 0.1f, 1000.f);
+	Terrain->SetUniformVariable("uProjectionMatrix", projectionMatrix);
+
+	// pixels covered by one unit of (scaled) terrain at a view distance of 1:
+	float lodScale = Scale * (float)w / (2.f * tanf(glm::radians(70.f) / 2.f));
+
+	// ===== Adaptive octaves =====
+
+	if (adaptiveOctaves)
+	{
+		Terrain->SetUniformVariable("uOctaveLodScale", lodScale);
+		Terrain->SetUniformVariable("uOctaveError", OctaveErrorPixels);
+
+		AverageOctaves = AverageAdaptiveOctaves(viewMatrix * modelMatrix, lodScale);
+	}
+	else
+	{
+		AverageOctaves = NOISE_OCTAVES;
+	}
+
+	// ===== Tessellation =====
+
+	if (tessellate)
+	{
+		Terrain->SetUniformVariable("uTessLodScale", lodScale);
+		Terrain->SetUniformVariable("uTessTriangleSize", TessTrianglePixels);
+	}
+
+	// ===== CPU tiles =====
+
+	// (the first view steers them)
+	if (CpuTilesOn && first)
+	{
+		// when the uploads fall behind, leave the made tiles in the pool's queue, so the workers hold off
+		int collectLimit = -1;
+		if (TileUploadsOn)
+		{
+			int tileBytes = (CHUNK_CELLS + 1) * (CHUNK_CELLS + 1) * (int)sizeof(float);
+			collectLimit = std::max(Uploader.GetBudget() / tileBytes - Uploader.GetFrameDeferred(), 1);
+		}
+		Tiles.SetCollectLimit(collectLimit);
+		Tiles.Update(OffsetX / SPEED_SCALE, OffsetZ / SPEED_SCALE, GRID_SIZE, viewMatrix * modelMatrix);
+	}
+
+	// ===== Chunks =====
+
+	// (TerrainChunks::Draw( ) sets up its own vertices)
+	bool drawChunks = strstr(Terrain->GetDefines(), "CHUNKED") != NULL;
+	if (drawChunks)
+	{
+		// a chunk's cells are cellSize * lodScale / distance pixels across at lod 0:
+		float cellSize = GRID_SIZE / (float)(GRID_RES_LOW - 1);
+		Chunks.Update(OffsetX / SPEED_SCALE, OffsetZ / SPEED_SCALE, GRID_SIZE,
+			viewMatrix * modelMatrix, cellSize * lodScale / ChunkCellPixels);
+
+		HorizonChunks = Chunks.GetNumChunks();
+		HorizonCulled = 0;
+		if (HorizonCullingOn)
+			HorizonCulled = Chunks.Cull(&ChunkHorizon, projectionMatrix, HorizonMargin, AdaptiveOctavesOn);
+		HorizonChunksTotal += HorizonChunks;
+		HorizonCulledTotal += HorizonCulled;
+
+		// (after the culling, so only the chunks that get drawn use up the upload budget)
+		if (TileUploadsOn)
+			Uploader.Update(&Tiles, &Chunks);
+
+		Chunks.Upload();
+
+		Terrain->SetUniformVariable("uChunkCells", Chunks.GetCells());
+		Terrain->SetUniformVariable("uGridSize", (float)GRID_SIZE);
+	}
 
 	// ===== Terrain shader =====
 
 	// Set vertex attribute pointers
 	// Note: This could technically be done in InitGraphics(), but doing it here
 	// allows us to change the pointers if we were to have more object
-	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer);
-	Terrain.SetAttributePointer3fv("aVertex", 3, (GLfloat*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, tessellate ? PatchBuffer : VertexBuffer);
+	Terrain->SetAttributePointer3fv("aVertex", 3, (GLfloat*)0);
+	Terrain->EnableVertexAttribArray("aVertex");
 
-	glBindBuffer(GL_ARRAY_BUFFER, TexCoordsBuffer);
-	Terrain.SetAttributePointer3fv("aTexCoords", 2, (GLfloat*)0); // Modified GLSLProgram to be able to accept attribute size 2
+	if (!tessellate && !drawChunks)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, TexCoordsBuffer);
+		Terrain->SetAttributePointer3fv("aTexCoords", 2, (GLfloat*)0); // Modified GLSLProgram to be able to accept attribute size 2
+		Terrain->EnableVertexAttribArray("aTexCoords"); // (the variants don't all put the attributes in the same place)
+	}
 
 	// Set uniforms
-	Terrain.SetUniformVariable("uTime", 10 * ElapsedSeconds());
-	Terrain.SetUniformVariable("uNormalMap", 0);
-	Terrain.SetUniformVariable("uMultiColor", 0);
+	Terrain->SetUniformVariable("uTime", 10 * ElapsedSeconds());
+	Terrain->SetUniformVariable("uGridDelta", GRID_SIZE / (float)(GRID_RES_LOW - 1)); // (only without the geometry shader)
 
 	// Set conditional values
-	if (CurrentTheme == EARTH)
+	if (theme == EARTH)
 	{
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		glClearColor(.65f, .72f, .77f, 1.0);
 
-		Terrain.SetUniformVariable("uMultiColor", 1);
+		Terrain->SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.0f);
+		Terrain->SetUniformVariable("uPaletteLayer", (float)EARTH_PALETTE);
 
-		Terrain.SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.0f);
-		Terrain.SetUniformVariable("uColor0", .17f, .44f, .50f, 1.0f);
-		Terrain.SetUniformVariable("uColor1", .45f, .54f, .28f, 1.0f);
-		Terrain.SetUniformVariable("uColor2", .46f, .35f, .25f, 1.0f);
-		Terrain.SetUniformVariable("uColor3", 1.0f, 1.0f, 1.0f, 1.0f);
-
-		Terrain.SetUniformVariable("uKa", 0.4f);
-		Terrain.SetUniformVariable("uKd", 0.8f);
-		Terrain.SetUniformVariable("uKs", 0.2f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+		Terrain->SetUniformVariable("uKa", 0.4f);
+		Terrain->SetUniformVariable("uKd", 0.8f);
+		Terrain->SetUniformVariable("uKs", 0.2f);
+		Terrain->SetUniformVariable("uSh", 0.0f);
 	}
-	if (CurrentTheme == HEATMAP)
+	if (theme == HEATMAP)
 	{
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		glClearColor(.65f, .72f, .77f, 1.0);
 
-		Terrain.SetUniformVariable("uMultiColor", 1);
+		Terrain->SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.0f);
+		Terrain->SetUniformVariable("uPaletteLayer", (float)HEATMAP_PALETTE);
+
+		Terrain->SetUniformVariable("uKa", 0.2f);
+		Terrain->SetUniformVariable("uKd", 0.8f);
+		Terrain->SetUniformVariable("uKs", 0.2f);
+		Terrain->SetUniformVariable("uSh", 0.0f);
+	}
+	if (theme == HEATMAP_SMOOTH)
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		glClearColor(.65f, .72f, .77f, 1.0);
 
-		Terrain.SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.0f);
-		Terrain.SetUniformVariable("uColor0", 0.f, 0.f, 1.f, 1.0f);
-		Terrain.SetUniformVariable("uColor1", 0.f, 1.f, 0.f, 1.0f);
-		Terrain.SetUniformVariable("uColor2", 1.f, 1.f, 0.f, 1.0f);
-		Terrain.SetUniformVariable("uColor3", 1.0f, 0.f, 0.f, 1.0f);
+		Terrain->SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.0f);
+		Terrain->SetUniformVariable("uPaletteLayer", (float)HEATMAP_SMOOTH_PALETTE);
 
-		Terrain.SetUniformVariable("uKa", 0.2f);
-		Terrain.SetUniformVariable("uKd", 0.8f);
-		Terrain.SetUniformVariable("uKs", 0.2f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+		Terrain->SetUniformVariable("uKa", 0.2f);
+		Terrain->SetUniformVariable("uKd", 0.8f);
+		Terrain->SetUniformVariable("uKs", 0.2f);
+		Terrain->SetUniformVariable("uSh", 0.0f);
 	}
-	if (CurrentTheme == SOLID)
+	if (theme == SOLID)
 	{
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		//glClearColor(.65f, .72f, .77f, 1.0);
 		glClearColor(.7f, .7f, .7f, 1.0f);
 
-		Terrain.SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.0f);
+		Terrain->SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.0f);
 
-		Terrain.SetUniformVariable("uKa", 0.4f);
-		Terrain.SetUniformVariable("uKd", 0.8f);
-		Terrain.SetUniformVariable("uKs", 0.0f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+		Terrain->SetUniformVariable("uKa", 0.4f);
+		Terrain->SetUniformVariable("uKd", 0.8f);
+		Terrain->SetUniformVariable("uKs", 0.0f);
+		Terrain->SetUniformVariable("uSh", 0.0f);
 	}
-	if (CurrentTheme == WIRE_LIGHT)
+	if (theme == WIRE_LIGHT)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		glPolygonMode(GL_FRONT_AND_BACK, LineModeWireframe ? GL_LINE : GL_FILL);
 		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 
-		Terrain.SetUniformVariable("uBaseColor", .0f, 0.0f, 0.0f, 1.0f);
-
-		Terrain.SetUniformVariable("uKa", 1.0f);
-		Terrain.SetUniformVariable("uKd", 0.0f);
-		Terrain.SetUniformVariable("uKs", 0.0f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+		Terrain->SetUniformVariable("uBaseColor", .0f, 0.0f, 0.0f, 1.0f);
 	}
-	if (CurrentTheme == WIRE_DARK)
+	if (theme == WIRE_DARK)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		glPolygonMode(GL_FRONT_AND_BACK, LineModeWireframe ? GL_LINE : GL_FILL);
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-		Terrain.SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.f);
-
-		Terrain.SetUniformVariable("uKa", 1.0f);
-		Terrain.SetUniformVariable("uKd", 0.0f);
-		Terrain.SetUniformVariable("uKs", 0.0f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+		Terrain->SetUniformVariable("uBaseColor", 1.f, 1.f, 1.f, 1.f);
 	}
-	if (CurrentTheme == SYNTHWAVE)
+	if (theme == SYNTHWAVE)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		glPolygonMode(GL_FRONT_AND_BACK, LineModeWireframe ? GL_LINE : GL_FILL);
 		glClearColor(0.10f, 0.01f, 0.22f, 1.0f);
 
-		Terrain.SetUniformVariable("uBaseColor", .95f, 0.24f, 0.94f, 1.0f);
-
-		Terrain.SetUniformVariable("uKa", 1.0f);
-		Terrain.SetUniformVariable("uKd", 0.0f);
-		Terrain.SetUniformVariable("uKs", 0.0f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+		Terrain->SetUniformVariable("uBaseColor", .95f, 0.24f, 0.94f, 1.0f);
 	}
-	if (CurrentTheme == TRON)
+	if (theme == TRON)
 	{
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		glPolygonMode(GL_FRONT_AND_BACK, LineModeWireframe ? GL_LINE : GL_FILL);
 		glClearColor(.01f, .09f, .12f, 1.0f);
 
-		Terrain.SetUniformVariable("uBaseColor", .32f, 0.92f, 0.92f, 1.0f);
-
-		Terrain.SetUniformVariable("uKa", 1.0f);
-		Terrain.SetUniformVariable("uKd", 0.0f);
-		Terrain.SetUniformVariable("uKs", 0.0f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+		Terrain->SetUniformVariable("uBaseColor", .32f, 0.92f, 0.92f, 1.0f);
 	}
-	if (CurrentTheme == NORMAL_MAP)
+	if (theme == NORMAL_MAP)
 	{
-		Terrain.SetUniformVariable("uNormalMap", 1);
-
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+	}
 
-		Terrain.SetUniformVariable("uBaseColor", 1.0f, 1.0f, 1.0f, 1.0f);
+	// each view clears its own part of the window, in its own theme's color:
+	if (MultiViewOn)
+	{
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(x, y, w, h);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+	}
 
-		Terrain.SetUniformVariable("uKa", 0.0f);
-		Terrain.SetUniformVariable("uKd", 0.0f);
-		Terrain.SetUniformVariable("uKs", 0.0f);
-		Terrain.SetUniformVariable("uSh", 0.0f);
+	// the height-band palettes are all layers of one texture:
+	if (strstr(Terrain->GetDefines(), "MULTICOLOR") != NULL)
+	{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_1D_ARRAY, PaletteTexture);
+		Terrain->SetUniformVariable("uPalette", 0);
+		Terrain->SetUniformVariable("uPaletteMin", PALETTE_MIN_HEIGHT);
+		Terrain->SetUniformVariable("uPaletteMax", PALETTE_MAX_HEIGHT);
 	}
 
+	// the heights of the chunks' cpu tiles:
+	if (strstr(Terrain->GetDefines(), "TILE_HEIGHTS") != NULL)
+		Uploader.Bind();
 
-	// Draw
-	Terrain.Use();
-	glDrawArrays(GL_TRIANGLES, 0, 6 * GRID_RES_LOW * GRID_RES_LOW);
-	Terrain.UnUse();
+	// the heights terrain.comp worked out:
+	bool fetchHeights = strstr(Terrain->GetDefines(), "HEIGHTMAP") != NULL;
+	if (fetchHeights)
+	{
+		glActiveTexture(GL_TEXTURE1);	// uHeightmap's binding in terrain.vert
+		glBindTexture(GL_TEXTURE_2D, HeightmapTexture);
+		glActiveTexture(GL_TEXTURE0);
+	}
 
-	// =====
+	// the barycentric wireframe blends its anti-aliased edges over whatever is behind them:
+	// (every edge is the same color, so they don't need to be depth sorted)
+	bool blendEdges = strstr(Terrain->GetDefines(), "WIREFRAME") != NULL;
+	if (blendEdges)
+		Terrain->SetUniformVariable("uLineWidth", WIREFRAME_LINE_WIDTH);
 
-	// draw some gratuitous text that just rotates on top of the scene:
-	// i commented out the actual text-drawing calls -- put them back in if you have a use for them
-	// a good use for thefirst one might be to have your name on the screen
-	// a good use for the second one might be to have vertex numbers on the screen alongside each vertex
+	uniformTimer.Stop();
+	TRACE_ZONE_END(uniformZone);
 
-	//glDisable( GL_DEPTH_TEST );
-	//glColor3f( 0.f, 1.f, 1.f );
-	//DoRasterString( 0.f, 1.f, 0.f, (char *)"Text That Moves" );
+	// Draw
+	CpuTimer drawTimer(&DrawTime, !first);
+	TRACE_ZONE_BEGIN(drawZone, "Draw");
 
+	// (the views after the first find it up to date already)
+	if (fetchHeights)
+		UpdateHeightmap(modelMatrix, viewMatrix, lodScale);
 
-	// draw some gratuitous text that is fixed on the screen:
-	//
-	// the projection matrix is reset to define a scene whose
-	// world coordinate system goes from 0-100 in each axis
-	//
-	// this is called "percent units", and is just a convenience
-	//
-	// the modelview matrix is reset to identity as we don't
-	// want to transform these coordinates
+	if (blendEdges)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDepthMask(GL_FALSE);
+	}
 
-	/*glDisable( GL_DEPTH_TEST );
-	glMatrixMode( GL_PROJECTION );
-	glLoadIdentity( );
-	gluOrtho2D( 0.f, 100.f,     0.f, 100.f );
-	glMatrixMode( GL_MODELVIEW );
-	glLoadIdentity( );
-	glColor3f( 1.f, 1.f, 1.f );*/
-	//DoRasterString( 5.f, 5.f, 0.f, (char *)"Text That Doesn't" );
-
-	// swap the double-buffered framebuffers:
-
-	glutSwapBuffers();
+	Terrain->Use();
+	if (tessellate)
+	{
+		glPatchParameteri(GL_PATCH_VERTICES, VERTS_PER_PATCH);
+		glDrawArrays(GL_PATCHES, 0, NUM_TERRAIN_PATCH_VERTS);
+		TerrainDrawCalls += 1;
+	}
+	else if (drawChunks)
+	{
+		TerrainDrawCalls += Chunks.Draw(Terrain, MultiDrawOn);
+	}
+	else
+	{
+		glDrawArrays(GL_TRIANGLES, 0, NUM_TERRAIN_VERTS);
+		TerrainDrawCalls += 1;
+	}
+	Terrain->UnUse();
 
-	// be sure the graphics buffer has been sent:
-	// note: be sure to use glFlush( ) here, not glFinish( ) !
+	if (blendEdges)
+	{
+		glDisable(GL_BLEND);
+		glDepthMask(GL_TRUE);
+	}
 
-	glFlush();
+	drawTimer.Stop();
+	TRACE_ZONE_END(drawZone);
 }
 
 
@@ -838,6 +1390,7 @@ DoMainMenu(int id)
 		glutSetWindow(MainWindow);
 		glFinish();
 		glutDestroyWindow(MainWindow);
+		WriteChromeTrace(TRACE_JSON);
 		exit(0);
 		break;
 
@@ -911,6 +1464,166 @@ DoStrokeString(float x, float y, float z, float ht, char* s)
 }
 
 
+// draw the rolling frame timings in the upper-left corner of the window:
+
+void
+DrawTimingHud()
+{
+	glDisable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluOrtho2D(0.f, 100.f, 0.f, 100.f);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	// Use black or white text, whichever stands out against the theme's background
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	float luminance = 0.30f * clearColor[0] + 0.59f * clearColor[1] + 0.11f * clearColor[2];
+	if (luminance > 0.5f)
+		glColor3f(0.f, 0.f, 0.f);
+	else
+		glColor3f(1.f, 1.f, 1.f);
+
+	char line[128];
+	float y = 95.f;
+
+	float avgFrame = FrameTime.Average();
+	sprintf(line, "%.1f fps", avgFrame > 0.f ? 1000.f / avgFrame : 0.f);
+	DoRasterString(2.f, y, 0.f, line);
+	y -= 5.f;
+
+	for (int i = 0; i < NUM_FRAME_STATS; i++)
+	{
+		sprintf(line, "%s: %.2f ms avg, %.2f ms p99",
+			FrameStats[i]->GetName(), FrameStats[i]->Average(), FrameStats[i]->Percentile(99.f));
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (AdaptiveOctavesOn)
+	{
+		sprintf(line, "Octaves: %.2f per vertex (error budget %g px)", AverageOctaves, OctaveErrorPixels);
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (HeightmapPassOn || MultiViewOn)
+	{
+		sprintf(line, "Heightmap pass: %d updates", HeightmapUpdates);
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (MultiViewOn)
+	{
+		sprintf(line, "Views: %d, %d draw calls, all from the one heightmap", NumViews, TerrainDrawCalls);
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (TessellationOn)
+	{
+		sprintf(line, "Tessellation: %d x %d patches, %g px triangles", TESS_PATCHES, TESS_PATCHES, TessTrianglePixels);
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (ChunksOn && !TessellationOn)
+	{
+		sprintf(line, "Chunks: %d of %d x %d cells, %d draw call%s (%s)", Chunks.GetNumChunks(), CHUNK_CELLS, CHUNK_CELLS,
+			TerrainDrawCalls, TerrainDrawCalls == 1 ? "" : "s", MultiDrawOn ? "multi-draw indirect" : "one per chunk");
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (ChunksOn && !TessellationOn && HorizonCullingOn)
+	{
+		sprintf(line, "Horizon culling: %d of %d chunks rejected (%.0f%%, %.0f%% overall), %g margin",
+			HorizonCulled, HorizonChunks, 100.f * (float)HorizonCulled / (float)std::max(HorizonChunks, 1),
+			100.f * (float)HorizonCulledTotal / (float)std::max(HorizonChunksTotal, 1LL), HorizonMargin);
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (CpuTilesOn)
+	{
+		TilePool* pool = Tiles.GetPool();
+		sprintf(line, "CPU tiles: %d held, %d pending, %lld made by %d worker%s (%lld cancelled, %lld stolen)",
+			Tiles.GetNumTiles(), Tiles.GetNumPending(), pool->GetGenerated(), pool->GetNumWorkers(),
+			pool->GetNumWorkers() == 1 ? "" : "s", pool->GetCancelled(), pool->GetStolen());
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+		sprintf(line, "Tile queues: %d made waiting, %d messages unsent, %lld reprioritized, workers held back %.0f ms",
+			pool->GetNumDone(), pool->GetNumUnsent(), Tiles.GetReprioritized(), (double)pool->GetStalledMicroseconds() / 1000.);
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+		long long arrived = Tiles.GetPrefetchHits() + Tiles.GetPrefetchLate() + Tiles.GetPrefetchMisses();
+		TileCache* cache = Tiles.GetCache();
+		sprintf(line, "Tile cache: cpu %d of %d KB (%lld hits, %lld misses, %lld evicted)",
+			(int)(cache->GetBytes() / 1024), (int)(cache->GetBudget() / 1024), cache->GetHits(), cache->GetMisses(), cache->GetEvictions());
+		if (cache->IsPacking())
+			sprintf(line + strlen(line), " packed %.1f:1", (double)cache->GetRawBytes() / (double)std::max(cache->GetBytes(), 1LL));
+		if (TileUploadsOn)
+			sprintf(line + strlen(line), ", gpu %d of %d KB (%lld hits, %lld misses, %lld evicted)", Uploader.GetCacheBytes() / 1024,
+				Uploader.GetCacheBudget() / 1024, Uploader.GetHits(), Uploader.GetUploadedTiles(), Uploader.GetEvictions());
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+		TileStore* store = Tiles.GetStore();
+		if (store->IsOpen())
+		{
+			sprintf(line, "Tile store: %d of %d tiles, %lld loaded, %lld written, %lld skipped", store->GetNumRecords(),
+				store->GetCapacity(), store->GetLoaded(), store->GetStored(), store->GetSkipped());
+			DoRasterString(2.f, y, 0.f, line);
+			y -= 5.f;
+		}
+		TileClient* client = Tiles.GetClient();
+		if (client->IsConnected())
+		{
+			sprintf(line, "Tile service: %d asked, %lld received (%.1f MB, %lld batches in a memfd)", client->GetNumAsked(),
+				client->GetReceived(), (double)client->GetBytes() / 1.e6, client->GetMemfds());
+			DoRasterString(2.f, y, 0.f, line);
+			y -= 5.f;
+		}
+		TileShared* shared = Tiles.GetShared();
+		if (shared->IsOpen())
+		{
+			sprintf(line, "Shared tiles: %d of %d ready, %lld used, %lld published, %lld evicted, %lld skipped", shared->GetNumReady(),
+				shared->GetNumSlots(), shared->GetHits(), shared->GetPublished(), shared->GetEvictions(), shared->GetSkipped());
+			DoRasterString(2.f, y, 0.f, line);
+			y -= 5.f;
+		}
+		sprintf(line, "Tile prefetch: %d tiles ahead, %.0f%% hits (%lld hit, %lld late, %lld missed), %lld wasted",
+			Tiles.GetLookahead(), 100. * (double)Tiles.GetPrefetchHits() / (double)std::max(arrived, 1LL),
+			Tiles.GetPrefetchHits(), Tiles.GetPrefetchLate(), Tiles.GetPrefetchMisses(), Tiles.GetPrefetchWasted());
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (TileUploadsOn)
+	{
+		sprintf(line, "Tile uploads: %d on the gpu, %d of %d KB this frame, %d waiting (%s)", Uploader.GetNumResident(),
+			Uploader.GetFrameBytes() / 1024, Uploader.GetBudget() / 1024, Uploader.GetFrameDeferred(),
+			Uploader.IsPersistent() ? "persistent ring" : "glBufferSubData");
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	if (DynamicResolutionOn)
+	{
+		sprintf(line, "Resolution: %.0f%% (%d x %d), %.1f ms target, %.1f ms %s", 100.f * Resolution.GetScale(),
+			Resolution.GetRenderSize(), Resolution.GetRenderSize(), Resolution.GetTargetMs(), Resolution.GetLastMs(),
+			Resolution.GpuTimesMeasure() ? "on the gpu" : "per frame");
+		DoRasterString(2.f, y, 0.f, line);
+		y -= 5.f;
+	}
+
+	glEnable(GL_DEPTH_TEST);
+}
+
+
 // return the number of seconds since the start of the program:
 
 float
@@ -932,6 +1645,8 @@ void GenerateTerrainMesh(
 	float texCoordsArray[]
 )
 {
+	TRACE_ZONE("GenerateTerrainMesh");
+
 	// Width of single grid cell
 	float delta = gridSize / (resolution - 1);
 
@@ -1019,6 +1734,40 @@ void GenerateTerrainMesh(
 }
 
 
+// the coarse grid of patches for the tessellated path:
+// (4 corners per patch, in the order terrain.tcs and terrain.tes expect)
+
+void GenerateTerrainPatches(
+	float gridSize, // Physical height/width
+	int   patches, // Number of patches along each side
+	float patchArray[]
+)
+{
+	TRACE_ZONE("GenerateTerrainPatches");
+
+	// Width of a single patch
+	float delta = gridSize / patches;
+
+	int i = 0;
+	for (int z = 0; z < patches; z++)
+	{
+		for (int x = 0; x < patches; x++)
+		{
+			// Both patches on either side of an edge must see exactly the same
+			// corner positions, so each one comes from its grid index
+			float x0 = (x + 0) * delta;
+			float x1 = (x + 1) * delta;
+			float z0 = (z + 0) * delta;
+			float z1 = (z + 1) * delta;
+
+			patchArray[i++] = x0;	patchArray[i++] = 0.f;	patchArray[i++] = z0;
+			patchArray[i++] = x1;	patchArray[i++] = 0.f;	patchArray[i++] = z0;
+			patchArray[i++] = x1;	patchArray[i++] = 0.f;	patchArray[i++] = z1;
+			patchArray[i++] = x0;	patchArray[i++] = 0.f;	patchArray[i++] = z1;
+		}
+	}
+}
+
 
 // initialize the glut and OpenGL libraries:
 //	also setup callback functions
@@ -1029,6 +1778,8 @@ InitGraphics()
 	if (DebugOn != 0)
 		fprintf(stderr, "Starting InitGraphics.\n");
 
+	TRACE_ZONE("InitGraphics");
+
 	// request the display modes:
 	// ask for red-green-blue-alpha color, double-buffering, and z-buffering:
 
@@ -1116,6 +1867,22 @@ InitGraphics()
 
 	// all other setups go here, such as GLSLProgram and KeyTime setups:
 
+	InitTerrain();
+
+	// rebuild the terrain shaders whenever one of them is saved:
+
+	TerrainShaderWatcher.Start(TerrainShaderFiles, sizeof(TerrainShaderFiles) / sizeof(TerrainShaderFiles[0]));
+}
+
+
+// create the terrain mesh, shader program, vertex buffers, and frame timers:
+// (this needs a current OpenGL context, but not a glut window)
+
+void
+InitTerrain()
+{
+	TRACE_ZONE("InitTerrain");
+
 	// Create mesh vertex array with normals and texture coordinates
 
 	GenerateTerrainMesh(
@@ -1125,6 +1892,12 @@ InitGraphics()
 		TexCoordsArray
 	);
 
+	GenerateTerrainPatches(
+		GRID_SIZE,
+		TESS_PATCHES,
+		PatchArray
+	);
+
 	//// Print vertex array values
 
 	//for (int i = 0; i < POS_COORDS_PER_VERT * VERTS_PER_CELL * (GRID_RES_LOW - 1) * (GRID_RES_LOW - 1); i++)
@@ -1143,22 +1916,32 @@ InitGraphics()
 	//}
 	//std::cout << '\n';
 
+	// Init frame timers
+	FrameTime.Init("Frame");
+	UpdateTime.Init("Update");
+	UniformTime.Init("Uniforms");
+	DrawTime.Init("Draw");
+	TerrainGpuTime.Init("Terrain GPU");
+	TerrainGpuTimer.Init(&TerrainGpuTime);
+
 	// Init shader program
-	Terrain.Init();
+	TerrainBase.Init();
 
-	// Compile, generate error messages, download executable to GPU
-	bool valid = Terrain.Create("terrain.vert", "terrain.geom", "terrain.frag");
-	if (!valid)
-	{
-		fprintf(stderr, "Yuch! The shader did not compile.\n");
-	}
-	else
-	{
-		fprintf(stderr, "Woo-Hoo! The shader compiled.\n");
-	}
+	// Compile every theme's variant up front, so switching themes never waits on the compiler
+	// (switching modes compiles on first use -- after that, the variant comes from the binary cache)
+	for (int t = 0; t < NUM_THEMES; t++)
+		GetTerrainVariant(GetThemeDefines(t).c_str());
+	if (HeightmapPassOn || MultiViewOn)
+		GetTerrainVariant(GetHeightmapDefines().c_str());
+	Terrain = GetTerrainVariant(GetThemeDefines(CurrentTheme).c_str());
+
+	// Bake the height-band palettes
+	PaletteTexture = CreatePaletteTexture(ThemePalettes, NUM_PALETTES, PALETTE_MIN_HEIGHT, PALETTE_MAX_HEIGHT);
 
 	// Set uniforms
 
+	TRACE_ZONE("Upload terrain buffers");
+
 	// Generate VBO handles
 	glGenBuffers(1, &VertexBuffer);
 
@@ -1167,12 +1950,338 @@ InitGraphics()
 	// Send vertex VBO send data
 	glBindBuffer(GL_ARRAY_BUFFER, VertexBuffer); // Dock
 	glBufferData(GL_ARRAY_BUFFER, sizeof(VertexArray), VertexArray, GL_STATIC_DRAW);
-	Terrain.EnableVertexAttribArray("aVertex");
 
 	// Send tex coords VBO data
 	glBindBuffer(GL_ARRAY_BUFFER, TexCoordsBuffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(TexCoordsArray), TexCoordsArray, GL_STATIC_DRAW);
-	Terrain.EnableVertexAttribArray("aTexCoords");
+
+	// Make room for the heightmap pass
+	glGenTextures(1, &HeightmapTexture);
+	glBindTexture(GL_TEXTURE_2D, HeightmapTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32F, GRID_RES_LOW, GRID_RES_LOW);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Send the patch corners for the tessellated path
+	glGenBuffers(1, &PatchBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, PatchBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PatchArray), PatchArray, GL_STATIC_DRAW);
+
+	// The shared grid every chunk draws
+	Chunks.Init(CHUNK_CELLS, GRID_SIZE / (float)(GRID_RES_LOW - 1));
+	ChunkHorizon.Init(HORIZON_COLUMNS);
+
+	// (the dynamic resolution's framebuffer waits until the first frame it is on for)
+	Resolution.Init(RESOLUTION_TARGET_MS);
+
+	// (and the tile workers until the cpu tiles are first turned on)
+	if (CpuTilesOn)
+		StartTileWorkers();
+
+	// Room on the gpu for the cpu tiles
+	if (GLEW_ARB_shader_storage_buffer_object)
+		Uploader.Init(CHUNK_CELLS, TileGpuCacheBytes, TILE_UPLOAD_RING_BYTES, TILE_UPLOAD_BUDGET);
+}
+
+
+// start the threads that make the cpu tiles, once:
+
+void
+StartTileWorkers()
+{
+	if (TileWorkersStarted)
+		return;
+
+	int workers = TileWorkers;
+	if (workers < 0)
+		workers = std::max((int)std::thread::hardware_concurrency() - 1, 1);	// leave a core for the GL thread
+	Tiles.Init(CHUNK_CELLS, GRID_SIZE / (float)(GRID_RES_LOW - 1), workers);
+	// (a viewer of the tile service leaves the store to the daemon -- and makes its own tiles
+	// without one if the daemon goes away)
+	if (TileStoreFile != NULL && TileServiceSocket == NULL)
+		Tiles.OpenStore(TileStoreFile);
+	if (TileSharedOn)
+		TileSharedOn = Tiles.OpenShared(TILE_SHARED_NAME);
+	if (TileServiceSocket != NULL)
+		Tiles.ConnectService(TileServiceSocket);
+	TileWorkersStarted = true;
+}
+
+
+// the #define's for drawing a theme in the current modes:
+
+std::string
+GetThemeDefines(int theme)
+{
+	std::string defines = ThemeDefines[theme];
+
+	// line mode draws the edges with the rasterizer instead of the shader:
+	if (LineModeWireframe && defines.find("WIREFRAME") != std::string::npos)
+		defines = "UNLIT";
+
+	// (the views all draw the whole grid from the one heightmap -- see DrawView( ))
+	bool tessellate = TessellationOn && !MultiViewOn;
+	bool chunks = ChunksOn && !MultiViewOn;
+	bool adaptiveOctaves = AdaptiveOctavesOn && !MultiViewOn;
+
+	// the tessellated triangles and the chunks share their vertices, so only the geometry shader can flat shade them:
+	if (tessellate)
+		defines += " TESSELLATION";
+	else if (chunks)
+		defines += " CHUNKED";
+	else if (!GeometryShaderOn)
+		defines += " NO_GEOMETRY_SHADER";
+
+	// (the tessellated vertices fall between the grid points, and the chunks reach past the heightmap)
+	if ((HeightmapPassOn || MultiViewOn) && !tessellate && !chunks)
+		defines += " HEIGHTMAP";
+
+	// (the cpu tiles only have all the octaves)
+	if (TileUploadsOn && chunks && !tessellate && !adaptiveOctaves)
+		defines += " TILE_HEIGHTS";
+
+	if (adaptiveOctaves)
+		defines += " ADAPTIVE_OCTAVES";
+
+	return defines;
+}
+
+
+// the #define's for terrain.comp in the current modes:
+
+std::string
+GetHeightmapDefines()
+{
+	std::string defines = "HEIGHTMAP_PASS";
+
+	if (AdaptiveOctavesOn && !MultiViewOn)
+		defines += " ADAPTIVE_OCTAVES";
+
+	return defines;
+}
+
+
+// recompute the heightmap if anything it depends on has changed since the last time:
+// (the offset, and with ADAPTIVE_OCTAVES, the view too -- never with more than one view)
+
+void
+UpdateHeightmap(glm::mat4 modelMatrix, glm::mat4 viewMatrix, float lodScale)
+{
+	static std::vector<float> lastKey;
+
+	bool adaptiveOctaves = AdaptiveOctavesOn && !MultiViewOn;
+
+	std::vector<float> key;
+	key.push_back(OffsetX);
+	key.push_back(OffsetZ);
+	if (adaptiveOctaves)
+	{
+		key.insert(key.end(), &modelMatrix[0][0], &modelMatrix[0][0] + 16);
+		key.insert(key.end(), &viewMatrix[0][0], &viewMatrix[0][0] + 16);
+		key.push_back(lodScale);
+		key.push_back(OctaveErrorPixels);
+	}
+
+	if (!HeightmapStale && key == lastKey)
+		return;
+
+	TRACE_ZONE("Heightmap pass");
+
+	GLSLProgram* heightmap = GetTerrainVariant(GetHeightmapDefines().c_str());
+	heightmap->SetUniformVariable("uOffsetX", OffsetX / SPEED_SCALE);
+	heightmap->SetUniformVariable("uOffsetZ", OffsetZ / SPEED_SCALE);
+	heightmap->SetUniformVariable("uGridDelta", GRID_SIZE / (float)(GRID_RES_LOW - 1));
+	if (adaptiveOctaves)
+	{
+		heightmap->SetUniformVariable("uModelMatrix", modelMatrix);
+		heightmap->SetUniformVariable("uViewMatrix", viewMatrix);
+		heightmap->SetUniformVariable("uOctaveLodScale", lodScale);
+		heightmap->SetUniformVariable("uOctaveError", OctaveErrorPixels);
+	}
+
+	glBindImageTexture(0, HeightmapTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	int groups = (GRID_RES_LOW + HEIGHTMAP_GROUP_SIZE - 1) / HEIGHTMAP_GROUP_SIZE;
+	heightmap->DispatchCompute(groups, groups);
+
+	// the vertex shader reads it with texelFetch( ):
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	lastKey = key;
+	HeightmapStale = false;
+	HeightmapUpdates++;
+}
+
+
+// the number of octaves terrain.vert evaluates at grid position (x, z) with ADAPTIVE_OCTAVES:
+// (the same as getOctaves( ) there)
+
+float
+AdaptiveOctaves(glm::mat4 modelView, float lodScale, float x, float z)
+{
+	glm::vec4 pointEC = modelView * glm::vec4(x, 0.f, z, 1.f);
+	float distance = glm::length(glm::vec3(pointEC));
+	if (distance < 0.001f)
+		distance = 0.001f;
+
+	float f = logf(OctaveErrorPixels * distance / (NOISE_HEIGHT * lodScale)) / logf(NOISE_PERSISTENCE);
+	return glm::clamp(f + 1.f, 1.f, (float)NOISE_OCTAVES);
+}
+
+
+// the average number of octaves per vertex, from a sample of the mesh's vertices:
+
+float
+AverageAdaptiveOctaves(glm::mat4 modelView, float lodScale)
+{
+	TRACE_ZONE("AverageAdaptiveOctaves");
+
+	int stride = NUM_TERRAIN_VERTS / OCTAVE_SAMPLES;
+	if (stride < 1)
+		stride = 1;
+
+	float sum = 0.f;
+	int n = 0;
+	for (int i = 0; i < NUM_TERRAIN_VERTS; i += stride)
+	{
+		sum += AdaptiveOctaves(modelView, lodScale, VertexArray[3 * i + 0], VertexArray[3 * i + 2]);
+		n++;
+	}
+
+	return sum / (float)n;
+}
+
+
+// compile the terrain shaders with the #define's already set in program:
+// (if wait is false, this just starts the compile -- see GLSLProgram::BeginCreate( ))
+
+bool
+BuildTerrainProgram(GLSLProgram* program, bool wait)
+{
+	if (strstr(program->GetDefines(), "HEIGHTMAP_PASS") != NULL)
+	{
+		if (wait)
+			return program->Create("terrain.comp");
+		return program->BeginCreate("terrain.comp");
+	}
+
+	if (strstr(program->GetDefines(), "TESSELLATION") != NULL)
+	{
+		if (wait)
+			return program->Create("terrain.vert", "terrain.tcs", "terrain.tes", "terrain.geom", "terrain.frag");
+		return program->BeginCreate("terrain.vert", "terrain.tcs", "terrain.tes", "terrain.geom", "terrain.frag");
+	}
+
+	if (strstr(program->GetDefines(), "NO_GEOMETRY_SHADER") != NULL)
+	{
+		if (wait)
+			return program->Create("terrain.vert", "terrain.frag");
+		return program->BeginCreate("terrain.vert", "terrain.frag");
+	}
+
+	if (wait)
+		return program->Create("terrain.vert", "terrain.geom", "terrain.frag");
+	return program->BeginCreate("terrain.vert", "terrain.geom", "terrain.frag");
+}
+
+
+// the terrain program compiled with these #define's, compiling it the first time it is asked for:
+
+GLSLProgram*
+GetTerrainVariant(const char* defines)
+{
+	std::map<std::string, GLSLProgram*>::iterator pos = TerrainVariants.find(defines);
+	if (pos != TerrainVariants.end())
+		return pos->second;
+
+	GLSLProgram* program = new GLSLProgram(TerrainBase);
+	program->SetDefines(defines);
+
+	// Compile, generate error messages, download executable to GPU
+	bool valid = BuildTerrainProgram(program, true);
+	if (!valid)
+	{
+		fprintf(stderr, "Yuch! The shader did not compile (\"%s\").\n", defines);
+	}
+	else
+	{
+		fprintf(stderr, "Woo-Hoo! The shader compiled (\"%s\").\n", defines);
+	}
+
+	TerrainVariants[defines] = program;
+	return program;
+}
+
+
+// start rebuilding the terrain shaders when the watcher says they changed,
+//	and swap the new programs in once the driver has finished compiling and linking all of them:
+// (a shader with errors just reports them -- the old programs keep drawing)
+
+void
+UpdateShaderReload()
+{
+	std::map<std::string, GLSLProgram*>::iterator pos;
+
+	if (PendingVariants.empty())
+	{
+		if (!TerrainShaderWatcher.TakeChanged())
+			return;
+
+		TRACE_ZONE("Begin shader reload");
+
+		// start from copies so the new programs keep their #define's and what Init( ) found out about this gl:
+		for (pos = TerrainVariants.begin(); pos != TerrainVariants.end(); pos++)
+		{
+			GLSLProgram* pending = new GLSLProgram(*pos->second);
+			BuildTerrainProgram(pending, false);
+			PendingVariants[pos->first] = pending;
+		}
+		return;
+	}
+
+	for (pos = PendingVariants.begin(); pos != PendingVariants.end(); pos++)
+	{
+		if (!pos->second->IsCreateDone())
+			return;
+	}
+
+	TRACE_ZONE("Finish shader reload");
+
+	bool valid = true;
+	for (pos = PendingVariants.begin(); pos != PendingVariants.end(); pos++)
+	{
+		if (!pos->second->FinishCreate())
+			valid = false;
+	}
+
+	// swap all of them or none of them, so the themes never disagree:
+	// (the variants are overwritten in place, so Terrain stays pointing at the right one)
+	for (pos = PendingVariants.begin(); pos != PendingVariants.end(); pos++)
+	{
+		if (valid)
+		{
+			TerrainVariants[pos->first]->Delete();
+			*TerrainVariants[pos->first] = *pos->second;
+		}
+		else
+		{
+			pos->second->Delete();
+		}
+		delete pos->second;
+	}
+	PendingVariants.clear();
+
+	if (!valid)
+	{
+		fprintf(stderr, "Yuch! The edited shader did not compile -- still using the old one.\n");
+		return;
+	}
+
+	fprintf(stderr, "Woo-Hoo! Reloaded the edited shader.\n");
+
+	// the heightmap may have come from the old terrain.comp:
+	HeightmapStale = true;
 }
 
 
@@ -1247,6 +2356,7 @@ InitMenus()
 	glutAddMenuEntry("Synthwave", SYNTHWAVE);
 	glutAddMenuEntry("TRON", TRON);
 	glutAddMenuEntry("Heat Map", HEATMAP);
+	glutAddMenuEntry("Heat Map (smooth)", HEATMAP_SMOOTH);
 	glutAddMenuEntry("Normal Map", NORMAL_MAP);
 
 	int scrollmenu = glutCreateMenu(DoScrollMenu);
@@ -1318,6 +2428,188 @@ void KeyDown(unsigned char key, int x, int y)
 	if (key == 's') sKeyDown = true;
 	if (key == 'd') dKeyDown = true;
 
+	// Timing overlay and CSV dump
+	if (key == 'h') TimingHudOn = !TimingHudOn;
+	if (key == 'c')
+	{
+		if (WriteFrameStatsCsv(FRAME_STATS_CSV, FrameStats, NUM_FRAME_STATS))
+			fprintf(stderr, "Wrote frame timings to '%s'\n", FRAME_STATS_CSV);
+	}
+
+	// Zone trace dump
+	if (key == 't') WriteChromeTrace(TRACE_JSON);
+
+	// Switch between flat shading in the geometry shader and without it
+	if (key == 'g')
+	{
+		GeometryShaderOn = !GeometryShaderOn;
+		fprintf(stderr, "Flat shading: %s\n", GeometryShaderOn ? "geometry shader" : "flat varyings + dFdx/dFdy");
+	}
+
+	// Adaptive octaves and their error budget
+	if (key == 'o')
+	{
+		AdaptiveOctavesOn = !AdaptiveOctavesOn;
+		fprintf(stderr, "Adaptive octaves: %s\n", AdaptiveOctavesOn ? "on" : "off");
+	}
+	if (key == '[' || key == ']')
+	{
+		OctaveErrorPixels *= (key == ']') ? 2.f : 0.5f;
+		fprintf(stderr, "Octave error budget: %g pixels\n", OctaveErrorPixels);
+	}
+
+	// Compute the heights once per grid point in terrain.comp
+	if (key == 'm')
+	{
+		if (!GLEW_VERSION_4_3 && !GLEW_ARB_compute_shader)
+			fprintf(stderr, "This OpenGL cannot do compute shaders\n");
+		else
+			HeightmapPassOn = !HeightmapPassOn;
+		fprintf(stderr, "Heightmap pass: %s\n", HeightmapPassOn ? "on" : "off");
+	}
+
+	// Several views, all drawn from one heightmap pass
+	if (key == 'v')
+	{
+		if (!GLEW_VERSION_4_3 && !GLEW_ARB_compute_shader)
+			fprintf(stderr, "This OpenGL cannot do compute shaders\n");
+		else
+			MultiViewOn = !MultiViewOn;
+		fprintf(stderr, "Views: %d\n", MultiViewOn ? NumViews : 1);
+	}
+
+	// Tessellated patches and how small terrain.tcs makes their triangles
+	if (key == 'e')
+	{
+		if (!GLEW_VERSION_4_0 && !GLEW_ARB_tessellation_shader)
+			fprintf(stderr, "This OpenGL cannot do tessellation shaders\n");
+		else
+			TessellationOn = !TessellationOn;
+		fprintf(stderr, "Tessellation: %s\n", TessellationOn ? "on" : "off");
+	}
+	if (key == ',' || key == '.')
+	{
+		TessTrianglePixels *= (key == '.') ? 2.f : 0.5f;
+		fprintf(stderr, "Tessellated triangles: %g pixels\n", TessTrianglePixels);
+	}
+
+	// Chunks, and whether they go in one multi-draw or one draw each
+	if (key == 'k')
+	{
+		if (!GLEW_ARB_shader_storage_buffer_object || !GLEW_ARB_shader_draw_parameters)
+			fprintf(stderr, "This OpenGL cannot look up the chunks in terrain.vert\n");
+		else
+			ChunksOn = !ChunksOn;
+		fprintf(stderr, "Chunks: %s\n", ChunksOn ? "on" : "off");
+	}
+	if (key == 'i')
+	{
+		if (!GLEW_VERSION_4_3 && !GLEW_ARB_multi_draw_indirect)
+			fprintf(stderr, "This OpenGL cannot do glMultiDrawElementsIndirect( )\n");
+		else
+			MultiDrawOn = !MultiDrawOn;
+		fprintf(stderr, "Chunk draws: %s\n", MultiDrawOn ? "multi-draw indirect" : "one per chunk");
+	}
+
+	// Horizon culling of the chunks, and the margin on their height bounds
+	if (key == 'z')
+	{
+		HorizonCullingOn = !HorizonCullingOn;
+		HorizonChunksTotal = HorizonCulledTotal = 0;
+		fprintf(stderr, "Horizon culling: %s%s\n", HorizonCullingOn ? "on" : "off", ChunksOn ? "" : " (once the chunks are on)");
+	}
+	if (key == '-' || key == '=')
+	{
+		HorizonMargin *= (key == '=') ? 2.f : 0.5f;
+		fprintf(stderr, "Horizon culling margin: %g\n", HorizonMargin);
+	}
+
+	// Dynamic resolution, and the frame time it aims for
+	if (key == 'r')
+	{
+		if (!GLEW_VERSION_3_0 && !GLEW_ARB_framebuffer_object)
+			fprintf(stderr, "This OpenGL cannot do framebuffer objects\n");
+		else
+			DynamicResolutionOn = !DynamicResolutionOn;
+		Resolution.Reset();
+		ResolutionScaleTotal = 0.;
+		ResolutionFrames = 0;
+		fprintf(stderr, "Dynamic resolution: %s\n", DynamicResolutionOn ? "on" : "off");
+	}
+	if (key == ';' || key == '\'')
+	{
+		Resolution.SetTargetMs(Resolution.GetTargetMs() * ((key == '\'') ? 2.f : 0.5f));
+		fprintf(stderr, "Dynamic resolution target: %g ms\n", Resolution.GetTargetMs());
+	}
+
+	// Heights made on the cpu by the tile workers
+	if (key == 'u')
+	{
+		CpuTilesOn = !CpuTilesOn;
+		if (CpuTilesOn)
+			StartTileWorkers();
+		fprintf(stderr, "CPU tiles: %s (%d workers)\n", CpuTilesOn ? "on" : "off", Tiles.GetPool()->GetNumWorkers());
+	}
+
+	// Send the cpu tiles to the gpu (which needs them made), and how much of them per frame
+	if (key == 'y')
+	{
+		if (!GLEW_ARB_shader_storage_buffer_object)
+			fprintf(stderr, "This OpenGL cannot read the tiles in terrain.vert\n");
+		else
+			TileUploadsOn = !TileUploadsOn;
+		if (TileUploadsOn && !CpuTilesOn)
+		{
+			CpuTilesOn = true;
+			StartTileWorkers();
+		}
+		fprintf(stderr, "Tile uploads: %s%s\n", TileUploadsOn ? "on" : "off", ChunksOn ? "" : " (once the chunks are on)");
+	}
+	// How far ahead of the window to make the cpu tiles
+	if (key == '(' || key == ')')
+	{
+		Tiles.SetLookahead(std::max(Tiles.GetLookahead() + ((key == ')') ? 1 : -1), 0));
+		fprintf(stderr, "Tile prefetch: %d tiles ahead\n", Tiles.GetLookahead());
+	}
+
+	if (key == '{' || key == '}')
+	{
+		Uploader.SetBudget((key == '}') ? 2 * Uploader.GetBudget() : std::max(Uploader.GetBudget() / 2, 1024));
+		fprintf(stderr, "Tile upload budget: %d KB per frame\n", Uploader.GetBudget() / 1024);
+	}
+	// Share the cpu tiles with the other viewers on this machine
+	if (key == 'n')
+	{
+		TileSharedOn = !TileSharedOn;
+		if (!TileSharedOn)
+			Tiles.CloseShared();
+		else
+		{
+			if (!CpuTilesOn)
+			{
+				CpuTilesOn = true;
+				StartTileWorkers();
+			}
+			// (workers started before, with the tiles then turned off, are still running without it)
+			if (TileWorkersStarted && !Tiles.GetShared()->IsOpen())
+				TileSharedOn = Tiles.OpenShared(TILE_SHARED_NAME);
+		}
+		fprintf(stderr, "Shared tiles: %s\n", TileSharedOn ? "on" : "off");
+	}
+	// Keep the cpu tiles that leave the window packed to 16 bits a height or less
+	if (key == 'b')
+	{
+		Tiles.GetCache()->SetPacking(!Tiles.GetCache()->IsPacking());
+		fprintf(stderr, "Tile cache packing: %s\n", Tiles.GetCache()->IsPacking() ? "on" : "off");
+	}
+
+	// Switch the wireframe themes between shader edges and glPolygonMode( GL_LINE )
+	if (key == 'l')
+	{
+		LineModeWireframe = !LineModeWireframe;
+		fprintf(stderr, "Wireframe: %s\n", LineModeWireframe ? "glPolygonMode( GL_LINE )" : "barycentric edges");
+	}
+
 	if (key == ESCAPE) DoMainMenu(QUIT);
 }
 
@@ -1445,6 +2737,371 @@ Reset()
 }
 
 
+// render a fixed number of frames into an offscreen framebuffer along a scripted
+// flyover and print the throughput:
+//
+//	--headless [--size WxH] [--frames N] [--theme N] [--line-mode] [--no-gs]
+//		[--adaptive-octaves P] [--tessellation P] [--heightmap] [--views N] [--chunks] [--no-mdi] [--horizon M]
+//		[--dynamic-resolution MS] [--cpu-tiles N] [--tile-uploads B] [--prefetch T]
+//		[--cpu-cache KB] [--pack-cache] [--gpu-cache KB] [--tile-store file] [--shared-tiles] [--tile-service socket] [--fly-speed S] [--revisit N] [--ppm file]
+//	--headless --queue-test P
+//	--headless --codec-test
+//
+// --line-mode draws the wireframe themes with glPolygonMode( GL_LINE )
+// --no-gs flat shades without the geometry shader
+// --adaptive-octaves P fades out octaves shorter than P pixels
+// --tessellation P draws tessellated patches, aiming for triangle edges P pixels long
+// --heightmap computes the heights in a compute shader pass and fetches them in terrain.vert
+// --views N draws the first N of Views (a map, and the flyover in another theme, over the flyover),
+//	all fetching the heights from that one pass
+// --chunks draws the terrain as chunks, all with one glMultiDrawElementsIndirect( )
+// --no-mdi draws the chunks with one glDrawElements( ) each instead
+// --horizon M culls the chunks hidden behind nearer ones, with a margin of M on their height bounds
+// --dynamic-resolution MS draws at whatever fraction of the size keeps the frames to MS milliseconds
+// --cpu-tiles N makes the heights on the cpu as well, with N worker threads (0 makes them on this one)
+// --tile-uploads B sends the cpu tiles to the gpu, at most B bytes a frame, and draws the chunks from them
+// --prefetch T makes the cpu tiles as far as T tiles ahead of the window, the way it is flying (0 for none)
+// --cpu-cache KB keeps up to KB of cpu tiles that have left the window, in case it comes back (0 for none)
+// --pack-cache packs the cpu tiles in that cache (see tilecodec.h), fitting more of them into it
+// --gpu-cache KB gives the uploaded tiles KB on the gpu, keeping them there after they leave the window
+// --tile-store keeps the cpu tiles in a file, and looks there before making any
+// --shared-tiles shares the cpu tiles with the other viewers on this machine, through shared memory
+// --tile-service asks the tile daemon listening on socket for the cpu tiles (see RunTileDaemon( )),
+//	and leaves the tile store to it
+// --fly-speed S flies S times as fast, to bring new terrain in sooner
+// --revisit N flies back and forth, turning around every N frames, instead of straight on
+// --ppm saves the last frame so the output of different modes can be compared
+// --queue-test P draws nothing: it stress tests the tile queues with P producer threads and
+//	times them against a mutex
+// --codec-test draws nothing: it packs the tiles made with the standard noise, at the chunks' size
+//	and at 1024 x 1024 cells, and reports how small they got and how fast they unpack
+
+int
+RunHeadlessBenchmark(int argc, char* argv[])
+{
+#ifndef HEADLESS
+	fprintf(stderr, "The headless benchmark was not compiled in -- rebuild with HEADLESS #define'd\n");
+	return 1;
+#else
+	int width = HEADLESS_DEFAULT_SIZE;
+	int height = HEADLESS_DEFAULT_SIZE;
+	int frames = HEADLESS_DEFAULT_FRAMES;
+	char* ppmFile = NULL;
+	float resolutionTargetMs = RESOLUTION_TARGET_MS;
+	float flySpeed = 1.f;
+	int revisitFrames = 0;
+	int uploadBudget = TILE_UPLOAD_BUDGET;
+	int maxUploadBytes = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--queue-test") == 0 && i + 1 < argc)
+		{
+			int producers = std::max(atoi(argv[++i]), 1);
+			if (!TileQueueStressTest(producers, HEADLESS_QUEUE_TEST_ITEMS))
+				return 1;
+			TileQueueBenchmark(producers, HEADLESS_QUEUE_TEST_ITEMS);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--codec-test") == 0)
+		{
+			TileCodecBenchmark(CHUNK_CELLS, GRID_SIZE / (float)(GRID_RES_LOW - 1), HEADLESS_CODEC_TEST_TILES);
+			TileCodecBenchmark(HEADLESS_CODEC_TEST_CELLS, GRID_SIZE / (float)(GRID_RES_LOW - 1), 4);
+			return 0;
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--theme") == 0 && i + 1 < argc)
+			CurrentTheme = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--line-mode") == 0)
+			LineModeWireframe = true;
+		else if (strcmp(argv[i], "--no-gs") == 0)
+			GeometryShaderOn = false;
+		else if (strcmp(argv[i], "--adaptive-octaves") == 0 && i + 1 < argc)
+		{
+			AdaptiveOctavesOn = true;
+			OctaveErrorPixels = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--tessellation") == 0 && i + 1 < argc)
+		{
+			TessellationOn = true;
+			TessTrianglePixels = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--heightmap") == 0)
+			HeightmapPassOn = true;
+		else if (strcmp(argv[i], "--views") == 0 && i + 1 < argc)
+		{
+			MultiViewOn = true;
+			NumViews = std::min(std::max(atoi(argv[++i]), 1), MAX_VIEWS);
+		}
+		else if (strcmp(argv[i], "--chunks") == 0)
+			ChunksOn = true;
+		else if (strcmp(argv[i], "--no-mdi") == 0)
+			MultiDrawOn = false;
+		else if (strcmp(argv[i], "--horizon") == 0 && i + 1 < argc)
+		{
+			HorizonCullingOn = true;
+			HorizonMargin = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--dynamic-resolution") == 0 && i + 1 < argc)
+		{
+			DynamicResolutionOn = true;
+			resolutionTargetMs = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--tile-uploads") == 0 && i + 1 < argc)
+		{
+			CpuTilesOn = TileUploadsOn = true;
+			uploadBudget = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc)
+			Tiles.SetLookahead(atoi(argv[++i]));
+		else if (strcmp(argv[i], "--cpu-cache") == 0 && i + 1 < argc)
+			Tiles.SetCacheBudget(1024LL * atoi(argv[++i]));
+		else if (strcmp(argv[i], "--pack-cache") == 0)
+			Tiles.GetCache()->SetPacking(true);
+		else if (strcmp(argv[i], "--gpu-cache") == 0 && i + 1 < argc)
+			TileGpuCacheBytes = 1024 * atoi(argv[++i]);
+		else if (strcmp(argv[i], "--tile-store") == 0 && i + 1 < argc)
+			TileStoreFile = argv[++i];
+		else if (strcmp(argv[i], "--shared-tiles") == 0)
+			TileSharedOn = true;
+		else if (strcmp(argv[i], "--tile-service") == 0 && i + 1 < argc)
+			TileServiceSocket = argv[++i];
+		else if (strcmp(argv[i], "--fly-speed") == 0 && i + 1 < argc)
+			flySpeed = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--revisit") == 0 && i + 1 < argc)
+			revisitFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--cpu-tiles") == 0 && i + 1 < argc)
+		{
+			CpuTilesOn = true;
+			TileWorkers = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--ppm") == 0 && i + 1 < argc)
+			ppmFile = argv[++i];
+	}
+
+	if (width <= 0 || height <= 0 || frames <= 0 || CurrentTheme < 0 || CurrentTheme >= NUM_THEMES ||
+	    (DynamicResolutionOn && resolutionTargetMs <= 0.f))
+	{
+		fprintf(stderr, "Usage: %s --headless [--size WxH] [--frames N] [--theme N] [--line-mode] [--no-gs] [--adaptive-octaves P] [--tessellation P] [--heightmap] [--views N] [--chunks] [--no-mdi] [--horizon M] [--dynamic-resolution MS] [--cpu-tiles N] [--tile-uploads B] [--prefetch T] [--cpu-cache KB] [--pack-cache] [--gpu-cache KB] [--tile-store file] [--shared-tiles] [--tile-service socket] [--fly-speed S] [--revisit N] [--ppm file]\n", argv[0]);
+		fprintf(stderr, "       %s --headless --queue-test P\n", argv[0]);
+		fprintf(stderr, "       %s --headless --codec-test\n", argv[0]);
+		return 1;
+	}
+
+	HeadlessContext context;
+	if (!context.Create(width, height))
+		return 1;
+
+	Reset();
+	InitTerrain();
+	Resolution.SetTargetMs(resolutionTargetMs);
+	Uploader.SetBudget(uploadBudget);
+
+	std::chrono::high_resolution_clock::time_point start;
+
+	// count the triangles the last frame actually drew, since tessellation decides that on the gpu:
+	GLuint primitivesQuery;
+	GLuint triangles = 0;
+	glGenQueries(1, &primitivesQuery);
+
+	for (int f = -HEADLESS_WARMUP_FRAMES; f < frames; f++)
+	{
+		// start the clock and the rolling stats once the warmup frames are done
+		if (f == 0)
+		{
+			glFinish();
+			for (int i = 0; i < NUM_FRAME_STATS; i++)
+				FrameStats[i]->Clear();
+			HeightmapUpdates = 0;
+			HorizonChunksTotal = HorizonCulledTotal = 0;
+			ResolutionScaleTotal = 0.;
+			ResolutionFrames = 0;
+			start = std::chrono::high_resolution_clock::now();
+		}
+
+		// Scripted flyover: scroll forward like the AUTO scroll mode while weaving side to side
+		// (or back and forth over the same ground, to see what the tile caches save)
+		int travel = f;
+		if (revisitFrames > 0)
+		{
+			int leg = ((f % (2 * revisitFrames)) + 2 * revisitFrames) % (2 * revisitFrames);
+			travel = (leg < revisitFrames) ? leg : 2 * revisitFrames - leg;
+		}
+		OffsetZ = -flySpeed * (float)travel;
+		OffsetX = 50.f * sinf((float)f / 60.f);
+
+		if (f == frames - 1)
+			glBeginQuery(GL_PRIMITIVES_GENERATED, primitivesQuery);
+
+		DrawScene(width, height);
+
+		if (f == frames - 1)
+			glEndQuery(GL_PRIMITIVES_GENERATED);
+		if (f >= 0 && TileUploadsOn)
+			maxUploadBytes = std::max(maxUploadBytes, Uploader.GetFrameBytes());
+
+		// nothing swaps buffers for us, so wait for each frame to actually finish
+		glFinish();
+	}
+
+	glGetQueryObjectuiv(primitivesQuery, GL_QUERY_RESULT, &triangles);
+	glDeleteQueries(1, &primitivesQuery);
+
+	float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+
+	int vertices = TessellationOn ? NUM_TERRAIN_PATCH_VERTS : NUM_TERRAIN_VERTS;	// as submitted, before tessellation
+	if (ChunksOn && !TessellationOn)
+		vertices = Chunks.GetNumIndices();
+	if (MultiViewOn)
+		vertices = NumViews * NUM_TERRAIN_VERTS;	// (every view draws the whole grid)
+	fprintf(stderr, "Headless benchmark: %d frames at %dx%d, theme %d%s%s, %d vertices per frame\n",
+		frames, width, height, CurrentTheme, LineModeWireframe ? " (line mode)" : "",
+		MultiViewOn ? " (several views)" : TessellationOn ? " (tessellated)" : ChunksOn ? " (chunked)" : GeometryShaderOn ? "" : " (no geometry shader)", vertices);
+	fprintf(stderr, "  %10.1f frames/s\n", (float)frames / seconds);
+	fprintf(stderr, "  %10.3f M vertices/s\n", (float)frames * (float)vertices / seconds / 1000000.f);
+	fprintf(stderr, "  %10.3f ms/frame\n", 1000.f * seconds / (float)frames);
+	fprintf(stderr, "  %10u triangles in the last frame", triangles);
+	if (TessellationOn)
+		fprintf(stderr, " (%g pixel edges)", TessTrianglePixels);
+	fprintf(stderr, "\n");
+	if (HeightmapPassOn || MultiViewOn)
+		fprintf(stderr, "  %10d heightmap passes\n", HeightmapUpdates);
+	if (MultiViewOn)
+		fprintf(stderr, "  %10d views, %.2f heightmap passes/frame between them\n", NumViews, (float)HeightmapUpdates / (float)frames);
+	fprintf(stderr, "  %10d draw calls/frame", TerrainDrawCalls);
+	if (ChunksOn && !TessellationOn && !MultiViewOn)
+		fprintf(stderr, " (%d chunks, %s)", Chunks.GetNumChunks(), MultiDrawOn ? "multi-draw indirect" : "one draw each");
+	fprintf(stderr, "\n");
+	if (ChunksOn && !TessellationOn && !MultiViewOn && HorizonCullingOn)
+		fprintf(stderr, "  %10.1f%% of the chunks horizon culled (%lld of %lld, margin %g)\n",
+			100.f * (float)HorizonCulledTotal / (float)std::max(HorizonChunksTotal, 1LL), HorizonCulledTotal, HorizonChunksTotal, HorizonMargin);
+	if (DynamicResolutionOn)
+		fprintf(stderr, "  %10.1f%% resolution on average (%.0f%% in the last frame, %g ms target, %s times)\n",
+			100. * ResolutionScaleTotal / (double)std::max(ResolutionFrames, 1), 100.f * Resolution.GetScale(),
+			Resolution.GetTargetMs(), Resolution.GpuTimesMeasure() ? "gpu" : "frame");
+	if (CpuTilesOn)
+	{
+		// (wait for the last frame's tiles, so the checksum covers the same ones however many workers there are)
+		Tiles.Finish();
+		TilePool* pool = Tiles.GetPool();
+		fprintf(stderr, "  %10lld tiles made by %d worker%s (%lld cancelled, %lld stolen, %.3f ms each), checksum %08x\n",
+			pool->GetGenerated(), pool->GetNumWorkers(), pool->GetNumWorkers() == 1 ? "" : "s", pool->GetCancelled(),
+			pool->GetStolen(), (double)pool->GetBusyMicroseconds() / 1000. / (double)std::max(pool->GetGenerated(), 1LL),
+			Tiles.GetChecksum());
+		fprintf(stderr, "  %10lld tiles reprioritized, workers held back %.1f ms by a full done queue\n",
+			Tiles.GetReprioritized(), (double)pool->GetStalledMicroseconds() / 1000.);
+		long long arrived = Tiles.GetPrefetchHits() + Tiles.GetPrefetchLate() + Tiles.GetPrefetchMisses();
+		fprintf(stderr, "  %10.1f%% of the tiles coming into the window made ahead (%lld hit, %lld late, %lld missed, %lld wasted, %d tiles ahead)\n",
+			100. * (double)Tiles.GetPrefetchHits() / (double)std::max(arrived, 1LL), Tiles.GetPrefetchHits(),
+			Tiles.GetPrefetchLate(), Tiles.GetPrefetchMisses(), Tiles.GetPrefetchWasted(), Tiles.GetLookahead());
+		TileCache* cache = Tiles.GetCache();
+		fprintf(stderr, "  %10lld cpu tile cache hits (%lld misses, %lld evicted, %.1f of %.1f KB", cache->GetHits(),
+			cache->GetMisses(), cache->GetEvictions(), (double)cache->GetBytes() / 1024., (double)cache->GetBudget() / 1024.);
+		if (cache->IsPacking())
+			fprintf(stderr, ", packed %.2f:1", (double)cache->GetRawBytes() / (double)std::max(cache->GetBytes(), 1LL));
+		fprintf(stderr, ")\n");
+		TileStore* store = Tiles.GetStore();
+		if (store->IsOpen())
+		{
+			store->Poll();
+			fprintf(stderr, "  %10lld tiles loaded from the store (%lld written so far, %lld skipped, %d of %d records used)\n",
+				store->GetLoaded(), store->GetStored(), store->GetSkipped(), store->GetNumRecords(), store->GetCapacity());
+		}
+		TileClient* client = Tiles.GetClient();
+		if (client->IsConnected() || client->GetReceived() > 0)
+			fprintf(stderr, "  %10lld tiles from the tile service (%.1f MB, %lld batches in a memfd)%s\n", client->GetReceived(),
+				(double)client->GetBytes() / 1.e6, client->GetMemfds(), client->IsConnected() ? "" : ", until it went away");
+		TileShared* shared = Tiles.GetShared();
+		if (shared->IsOpen())
+			fprintf(stderr, "  %10lld tiles used from the shared cache (%lld published, %lld evicted, %lld skipped, %d of %d ready)\n",
+				shared->GetHits(), shared->GetPublished(), shared->GetEvictions(), shared->GetSkipped(), shared->GetNumReady(),
+				shared->GetNumSlots());
+	}
+	if (TileUploadsOn)
+		fprintf(stderr, "  %10lld tiles uploaded (%.1f KB, at most %.1f KB in a frame of a %.1f KB budget, %s)\n",
+			Uploader.GetUploadedTiles(), (double)Uploader.GetUploadedBytes() / 1024., (double)maxUploadBytes / 1024.,
+			(double)Uploader.GetBudget() / 1024., Uploader.IsPersistent() ? "persistent ring" : "glBufferSubData");
+	if (TileUploadsOn)
+		fprintf(stderr, "  %10lld gpu tile cache hits (%lld misses, %lld evicted, %.1f of %.1f KB)\n", Uploader.GetHits(),
+			Uploader.GetUploadedTiles(), Uploader.GetEvictions(), (double)Uploader.GetCacheBytes() / 1024.,
+			(double)Uploader.GetCacheBudget() / 1024.);
+	fprintf(stderr, "  %10.2f octaves/vertex", AverageOctaves);
+	if (AdaptiveOctavesOn && !MultiViewOn)
+		fprintf(stderr, " (error budget %g pixels)", OctaveErrorPixels);
+	fprintf(stderr, "\n");
+	for (int i = 0; i < NUM_FRAME_STATS; i++)
+	{
+		fprintf(stderr, "  %-12s %8.3f ms avg, %8.3f ms p99 (last %d frames)\n",
+			FrameStats[i]->GetName(), FrameStats[i]->Average(), FrameStats[i]->Percentile(99.f), FrameStats[i]->GetCount());
+	}
+
+	if (ppmFile != NULL)
+	{
+		unsigned char* pixels = new unsigned char[3 * width * height];
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+		FILE* fp = fopen(ppmFile, "wb");
+		if (fp == NULL)
+		{
+			fprintf(stderr, "Cannot open '%s' for writing\n", ppmFile);
+		}
+		else
+		{
+			// ppm rows go top to bottom, gl rows go bottom to top
+			fprintf(fp, "P6\n%d %d\n255\n", width, height);
+			for (int y = height - 1; y >= 0; y--)
+				fwrite(&pixels[3 * width * y], 1, 3 * width, fp);
+			fclose(fp);
+		}
+		delete[] pixels;
+	}
+
+	WriteChromeTrace(TRACE_JSON);
+	context.Destroy();
+	return 0;
+#endif
+}
+
+
+// make the cpu tiles for any number of viewers, without drawing anything, until it is interrupted:
+//
+//	--tile-daemon socket [--cpu-tiles N] [--tile-store file]
+//
+// the viewers connect with --tile-service socket (see tileservice.h)
+// --cpu-tiles N makes them with N worker threads (0 makes them on this one)
+// --tile-store keeps them in a file, and looks there before making any
+
+int
+RunTileDaemon(int argc, char* argv[])
+{
+	const char* socket = NULL;
+	int workers = std::max((int)std::thread::hardware_concurrency(), 1);
+	const char* storeFile = TileStoreFile;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--tile-daemon") == 0 && i + 1 < argc)
+			socket = argv[++i];
+		else if (strcmp(argv[i], "--cpu-tiles") == 0 && i + 1 < argc)
+			workers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--tile-store") == 0 && i + 1 < argc)
+			storeFile = argv[++i];
+	}
+
+	if (socket == NULL)
+	{
+		fprintf(stderr, "Usage: %s --tile-daemon socket [--cpu-tiles N] [--tile-store file]\n", argv[0]);
+		return 1;
+	}
+	return RunTileService(socket, CHUNK_CELLS, GRID_SIZE / (float)(GRID_RES_LOW - 1), workers, storeFile);
+}
+
+
 // called when user resizes the window:
 
 void
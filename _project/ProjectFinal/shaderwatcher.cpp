@@ -0,0 +1,188 @@
+#include "shaderwatcher.h"
+
+#include <string.h>
+#include <chrono>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+
+static
+long long
+GetModTime( const char *file )
+{
+	struct stat st;
+	if( stat( file, &st ) != 0 )
+		return 0;
+	return (long long)st.st_mtime;
+}
+
+
+// the directory part of a file name, or "." if it doesn't have one:
+
+static
+std::string
+GetDirectory( const std::string &file )
+{
+	size_t slash = file.find_last_of( "/\\" );
+	if( slash == std::string::npos )
+		return ".";
+	if( slash == 0 )
+		return "/";
+	return file.substr( 0, slash );
+}
+
+
+ShaderWatcher::ShaderWatcher( ) : changed( false ), stopping( false )
+{
+}
+
+
+ShaderWatcher::~ShaderWatcher( )
+{
+	Stop( );
+}
+
+
+// true if name matches the last part of one of the watched files:
+
+bool
+ShaderWatcher::IsWatchedName( const char *name )
+{
+	for( int i = 0; i < (int)files.size( ); i++ )
+	{
+		size_t slash = files[i].find_last_of( "/\\" );
+		const char *base = files[i].c_str( ) + ( slash == std::string::npos ? 0 : slash + 1 );
+		if( strcmp( base, name ) == 0 )
+			return true;
+	}
+	return false;
+}
+
+
+bool
+ShaderWatcher::Start( const char *_files[ ], int numFiles )
+{
+	Stop( );
+
+	files.clear( );
+	modTimes.clear( );
+	for( int i = 0; i < numFiles; i++ )
+	{
+		files.push_back( _files[i] );
+		modTimes.push_back( GetModTime( _files[i] ) );
+	}
+
+	changed.store( false );
+	stopping.store( false );
+
+#ifdef __linux__
+	thread = std::thread( &ShaderWatcher::WatchInotify, this );
+#else
+	thread = std::thread( &ShaderWatcher::WatchModTimes, this );
+#endif
+	return true;
+}
+
+
+void
+ShaderWatcher::Stop( )
+{
+	if( ! thread.joinable( ) )
+		return;
+
+	stopping.store( true );
+	thread.join( );
+}
+
+
+// returns true, once, for each batch of changes seen since the last call:
+
+bool
+ShaderWatcher::TakeChanged( )
+{
+	return changed.exchange( false, std::memory_order_acq_rel );
+}
+
+
+#ifdef __linux__
+
+// editors usually save by writing a new file and renaming it over the old one,
+//	which would orphan a watch on the file itself -- so watch the directories instead:
+
+void
+ShaderWatcher::WatchInotify( )
+{
+	int fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if( fd < 0 )
+	{
+		fprintf( stderr, "inotify is not available -- watching shader modification times instead\n" );
+		WatchModTimes( );
+		return;
+	}
+
+	std::vector<std::string> dirs;
+	for( int i = 0; i < (int)files.size( ); i++ )
+	{
+		std::string dir = GetDirectory( files[i] );
+		bool seen = false;
+		for( int d = 0; d < (int)dirs.size( ); d++ )
+			seen = seen || dirs[d] == dir;
+		if( seen )
+			continue;
+		dirs.push_back( dir );
+
+		if( inotify_add_watch( fd, dir.c_str( ), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0 )
+			fprintf( stderr, "Cannot watch '%s' for shader changes\n", dir.c_str( ) );
+	}
+
+	alignas( struct inotify_event ) char buffer[4096];
+	while( ! stopping.load( ) )
+	{
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		if( poll( &pfd, 1, SHADER_WATCH_INTERVAL_MS ) <= 0 )
+			continue;
+
+		ssize_t len;
+		while( ( len = read( fd, buffer, sizeof(buffer) ) ) > 0 )
+		{
+			for( char *p = buffer; p < buffer + len; )
+			{
+				struct inotify_event *event = (struct inotify_event *)p;
+				if( event->len > 0  &&  IsWatchedName( event->name ) )
+					changed.store( true, std::memory_order_release );
+				p += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	}
+
+	close( fd );
+}
+
+#endif
+
+
+void
+ShaderWatcher::WatchModTimes( )
+{
+	while( ! stopping.load( ) )
+	{
+		std::this_thread::sleep_for( std::chrono::milliseconds( SHADER_WATCH_INTERVAL_MS ) );
+
+		for( int i = 0; i < (int)files.size( ); i++ )
+		{
+			long long t = GetModTime( files[i].c_str( ) );
+			if( t != modTimes[i] )
+			{
+				modTimes[i] = t;
+				changed.store( true, std::memory_order_release );
+			}
+		}
+	}
+}
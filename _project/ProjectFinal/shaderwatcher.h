@@ -0,0 +1,48 @@
+#ifndef SHADERWATCHER_H
+#define SHADERWATCHER_H
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//********************************************************************************
+// watches a set of shader files from a background thread and raises a flag when
+//	any of them is saved:
+//	uses inotify on linux, and checks the files' modification times elsewhere
+//
+// the watcher never touches OpenGL -- the GL thread polls TakeChanged( ) once per
+//	frame and does the actual rebuild itself
+//********************************************************************************
+
+
+// how often the modification-time fallback looks at the files, and how often the
+//	inotify thread wakes up to see if it has been asked to stop:
+
+const int SHADER_WATCH_INTERVAL_MS = 250;
+
+
+class ShaderWatcher
+{
+  private:
+	std::vector<std::string>	files;
+	std::vector<long long>		modTimes;
+	std::atomic<bool>		changed;
+	std::atomic<bool>		stopping;
+	std::thread			thread;
+
+	bool	IsWatchedName( const char * );
+	void	WatchInotify( );
+	void	WatchModTimes( );
+
+  public:
+	ShaderWatcher( );
+	~ShaderWatcher( );
+	bool	Start( const char *[ ], int );
+	void	Stop( );
+	bool	TakeChanged( );
+};
+
+#endif	// SHADERWATCHER_H
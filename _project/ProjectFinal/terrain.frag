@@ -1,9 +1,33 @@
 #version 330 compatibility
 
+// Permutations (#define'd by GLSLProgram::SetDefines):
+//   MULTICOLOR  -- color by height from a row of the uPalette texture array
+//                  instead of uBaseColor
+//   NORMAL_MAP  -- show the normal as a color
+//   UNLIT       -- uBaseColor as is, with no lighting math at all
+//   WIREFRAME   -- draw only the anti-aliased edges of each filled triangle
+//                  (blended, so it wants GL_BLEND on)
+//   NO_GEOMETRY_SHADER -- take the inputs straight from terrain.vert, and
+//                  work out the face normal here
+
+#ifdef NO_GEOMETRY_SHADER
+#define gLightVector   vLightVector
+#define gEyeVector     vEyeVector
+#define gBarycentric   vBarycentric
+#endif
+
 // Interpolated lighting vectors from vertex shader
+#if !defined(UNLIT) || defined(NORMAL_MAP)
+#ifdef NO_GEOMETRY_SHADER
+in vec3        vPosition;      // View space position
+#else
 in vec3        gNormalVector;  // Normal vector
+#endif
+#endif
+#ifndef UNLIT
 in vec3        gLightVector;   // Vector from fragment to light
 in vec3        gEyeVector;     // Vector from fragment to eye
+#endif
 
 // Lighting parameters
 uniform float  uKa;            // Ambient lighting coefficient
@@ -12,23 +36,64 @@ uniform float  uKs;            // Specular lighting coefficient
 uniform float  uSh;
 
 // Color parameters
+#ifndef NO_GEOMETRY_SHADER
 in      float   gHeight;
+#elif defined(MULTICOLOR)
+flat in float   vFlatHeight;
+#define gHeight vFlatHeight
+#endif
 
-uniform int    uMultiColor;
 uniform vec4   uBaseColor;
-uniform vec4   uColor0;
-uniform vec4   uColor1;
-uniform vec4   uColor2;
-uniform vec4   uColor3;
 
-uniform int uNormalMap;
+#ifdef MULTICOLOR
+uniform sampler1DArray uPalette; // One height-band palette per layer
+uniform float  uPaletteLayer;
+uniform float  uPaletteMin;    // Heights at the two ends of each palette
+uniform float  uPaletteMax;
+#endif
+
+#ifdef WIREFRAME
+in vec3        gBarycentric;   // 1 at one corner, falling to 0 along the opposite edge
+uniform float  uLineWidth;     // in pixels
+#endif
+
+#if !defined(UNLIT) || defined(NORMAL_MAP)
+vec3 faceNormal()
+{
+#ifdef NO_GEOMETRY_SHADER
+    // The view space position changes linearly across the triangle, so its
+    // screen-space derivatives both lie in the triangle's plane and their
+    // cross product is the same face normal the geometry shader computes.
+    // It always faces the eye, so flip it for the back sides of triangles.
+    vec3 normal = normalize(cross(dFdx(vPosition), dFdy(vPosition)));
+    return gl_FrontFacing ? normal : -normal;
+#else
+    return normalize(gNormalVector);
+#endif
+}
+#endif
 
 void main() {
+#ifdef NORMAL_MAP
+    gl_FragColor = vec4(faceNormal(), 1.0);
+#else
+    vec4 color = uBaseColor;
+
+#ifdef MULTICOLOR
+    // One texture fetch instead of a ladder of height thresholds. The bands
+    // (hard or blended) are baked into the palette; see palette.cpp.
+    float u = (gHeight - uPaletteMin) / (uPaletteMax - uPaletteMin);
+    color = texture(uPalette, vec2(u, uPaletteLayer));
+#endif
+
+#ifdef UNLIT
+    gl_FragColor = color;
+#else
     //--------------------------------------------------------------------------
     // Normalize lighting vectors (interpolated from vertex shader values)
     //--------------------------------------------------------------------------
 
-    vec3  normalVector = normalize(gNormalVector);
+    vec3  normalVector = faceNormal();
     vec3  lightVector  = normalize(gLightVector);
     vec3  eyeVector    = normalize(gEyeVector);
 
@@ -85,21 +150,22 @@ void main() {
     //--------------------------------------------------------------------------
 
     // Multiply base color by combined lighting component intensities.
-    if (uNormalMap == 1)
-    {
-        gl_FragColor = vec4(normalVector, 1.0);
-    }
-    else
-    {
-        vec4 color = uBaseColor;
-
-        if (uMultiColor == 1)
-        {
-            if (gHeight < -8) color = uColor0;
-            else if (gHeight < 2) color = uColor1;
-            else if (gHeight < 9) color = uColor2;
-            else color = uColor3;
-        }
-        gl_FragColor = color * (ambient + diffuse + specular);
-    }
+    gl_FragColor = color * (ambient + diffuse + specular);
+#endif
+
+#ifdef WIREFRAME
+    // fwidth() is how much each barycentric coordinate changes over one
+    // pixel, so this is how many pixels the fragment is from each edge.
+    vec3  edgePixels   = gBarycentric / fwidth(gBarycentric);
+    float edgeDistance = min(min(edgePixels.x, edgePixels.y), edgePixels.z);
+
+    // Each triangle draws its half of the line, fading out over one pixel.
+    // The neighboring triangle draws the other half.
+    float halfWidth = 0.5 * uLineWidth;
+    float coverage  = 1.0 - smoothstep(halfWidth - 0.5, halfWidth + 0.5, edgeDistance);
+    if (coverage <= 0.0)
+        discard;
+    gl_FragColor.a *= coverage;
+#endif
+#endif
 }
@@ -1,5 +1,28 @@
 #version 330 compatibility
 
+// Permutations (#define'd by GLSLProgram::SetDefines):
+//   UNLIT       -- skip the lighting vectors
+//   NO_GEOMETRY_SHADER -- feed terrain.frag directly (see the end of main())
+//   MULTICOLOR  -- with NO_GEOMETRY_SHADER, average the triangle's height
+//   WIREFRAME   -- with NO_GEOMETRY_SHADER, hand out the barycentric coordinates
+//   ADAPTIVE_OCTAVES -- fade out the octaves too small to see from here
+//   TESSELLATION -- just pass the patch corners on to terrain.tcs
+//   HEIGHTMAP   -- fetch the heights terrain.comp already worked out
+//   CHUNKED     -- place one chunk of TerrainChunks' shared grid (see chunkVertex())
+//   TILE_HEIGHTS -- with CHUNKED, read the heights of the chunks that have a cpu tile
+
+#ifdef HEIGHTMAP
+// For layout(binding). It needs compute shaders anyway, so this is always there.
+#extension GL_ARB_shading_language_420pack : require
+#endif
+
+#ifdef CHUNKED
+// For the chunk list, gl_DrawIDARB, and layout(binding)
+#extension GL_ARB_shader_storage_buffer_object : require
+#extension GL_ARB_shader_draw_parameters : require
+#extension GL_ARB_shading_language_420pack : require
+#endif
+
 // Uniforms
 
 uniform float uNX;
@@ -7,8 +30,7 @@ uniform float uNZ;
 uniform float uDepthSquares;
 uniform float uTime;
 
-uniform float uOffsetX;
-uniform float uOffsetZ;
+uniform float uGridDelta;      // Width of one grid cell, as in GenerateTerrainMesh()
 
 // Transformation matrices
 
@@ -21,94 +43,144 @@ in vec3       aVertex;         // Vertex position coordinates
 
 // Lighting vectors in view space to be sent to geometry and fragment shader
 out vec3      vPosition;
+#ifndef UNLIT
 out vec3      vLightVector;    // Vector from vertex to light in view space
 out vec3      vEyeVector;      // Vector from vertex to eye in view space
+#endif
 
 // Position for color calculations
 out float     vHeight;
 
+#ifdef NO_GEOMETRY_SHADER
+#ifdef MULTICOLOR
+flat out float vFlatHeight;    // Average height of the triangle (from its provoking vertex)
+#endif
+#ifdef WIREFRAME
+out vec3      vBarycentric;
+#endif
+#endif
+
 // Light and eye positions
 const vec3    LIGHT_WC = vec3( 0., 100., -20. ); //vec3( 0., 15., 15. );
 const vec3    EYE_EC   = vec3( 0.,  0., 0. );
 
 
-float hash(vec2 p)
+#ifdef HEIGHTMAP
+// One texel per grid point, from terrain.comp. It has its own texture unit, so
+// it can't clash with terrain.frag's palette when the program is validated.
+layout(binding = 1) uniform sampler2D uHeightmap;
+
+// Height of the terrain at grid position (x, z)
+float getTerrainHeight(float x, float z)
 {
-    // Generate pseudo-random value between 0 and 1
-    return fract(sin(dot(p, vec2(127.1, 311.7))) * 43758.5453);
+    return texelFetch(uHeightmap, ivec2(round(vec2(x, z) / uGridDelta)), 0).r;
 }
+#else
+#include "noise.glsl"
+#endif
 
-vec2 randomGradient(vec2 gridPoint)
+#ifdef CHUNKED
+// One entry per chunk drawn, from TerrainChunks::Update()
+struct Chunk
 {
-    // Convert hash value to angle (in radians) along the unit circle
-    float angle = hash(gridPoint) * 6.28318530718;
+    ivec2 coord;        // The chunk starts at grid point coord * uChunkCells
+    int   lod;          // It draws every 2^lod'th grid point
+    int   neighborLods; // Lod of the chunks at -x, +x, -z, +z, a byte each from the lowest
+    int   tile;         // Slot of its heights in TileHeights, or -1 for none
+    int   pad;
+};
+
+layout(std430, binding = 2) readonly buffer Chunks
+{
+    Chunk uChunks[];
+};
 
-    // Return the x and y components of the resultant angle
-    return vec2(cos(angle), sin(angle));
-}
+uniform int uChunkIndex;       // First chunk of this draw (glMultiDrawElementsIndirect counts from 0 with gl_DrawIDARB)
+uniform int uChunkCells;       // Grid cells along each side of a chunk
+uniform float uGridSize;       // Width of the window of terrain on screen
 
-float perlin(vec2 point)
+#ifdef TILE_HEIGHTS
+// The heights TerrainTiles made on the cpu, (uChunkCells + 1)^2 per tile, in
+// the slots TileUploader put them in
+layout(std430, binding = 3) readonly buffer TileHeights
 {
-    // Integer part of the coordinates (the "cell" that contains this point)
-    // Fractional part of the coordinates (how far into the cell the coordinates are)
-    vec2 gridPoint = floor(point);  
-    vec2 offset = point - gridPoint; 
-
-    // Get gradients (2D vector) for each corner of the "cell"
-    vec2 g00 = randomGradient(gridPoint + vec2(0.0, 0.0));
-    vec2 g10 = randomGradient(gridPoint + vec2(1.0, 0.0));
-    vec2 g01 = randomGradient(gridPoint + vec2(0.0, 1.0));
-    vec2 g11 = randomGradient(gridPoint + vec2(1.0, 1.0));
-
-    // Calculate dot product for coordinate and each corner (distance to each gradient)
-    float d00 = dot(g00, offset - vec2(0.0, 0.0));
-    float d10 = dot(g10, offset - vec2(1.0, 0.0));
-    float d01 = dot(g01, offset - vec2(0.0, 1.0));
-    float d11 = dot(g11, offset - vec2(1.0, 1.0));
-
-    // Interpolate between the values (linear interpolation)
-    float u = offset.x;  // X interpolation factor
-    float v = offset.y;  // Y interpolation factor
-
-    float nx0 = mix(d00, d10, u);
-    float nx1 = mix(d01, d11, u);
-
-    // Returns a value between -1 and +1
-    return mix(nx0, nx1, v);  // Final interpolation between the two results
-}
+    float uTileHeights[];
+};
+#endif
 
-float perlinMultiOctave(vec2 point, int octaves, float persistence)
+// Height at grid point `local` of chunk, with the grid points outside the
+// window pulled in to its edge
+float getGridHeight(Chunk chunk, ivec2 local, out vec2 positionMC)
 {
-    float total = 0.0;
-    float frequency = 1.0;  // Base frequency (larger values for more zoomed-in noise)
-    float amplitude = 1.0;  // Base amplitude (larger values for more influence)
-
-    for (int i = 0; i < octaves; i++) {
-        total += perlin(point * frequency) * amplitude;  // Apply Perlin noise with frequency and amplitude
-        frequency *= 2;  // Double the frequency for next octave (zoom in)
-        amplitude *= persistence;  // Decrease the amplitude (less influence as octaves increase)
-    }
-
-    return total;
+    vec2 offset = vec2(uOffsetX, uOffsetZ);
+    vec2 unclamped = vec2(chunk.coord * uChunkCells + local) * uGridDelta - offset;
+    positionMC = clamp(unclamped, 0., uGridSize);
+#ifdef TILE_HEIGHTS
+    // (a tile only has the grid points, not where the window's edges cut between them --
+    // the noise picks the same gradients the cpu made the tile with, so the two meet)
+    if (chunk.tile >= 0 && positionMC == unclamped)
+        return uTileHeights[(chunk.tile * (uChunkCells + 1) + local.y) * (uChunkCells + 1) + local.x];
+#endif
+    return getNoiseHeight(positionMC + offset, getOctaves(positionMC.x, positionMC.y));
 }
 
-float getHeight(float x, float z, float scale, int octaves, float persistence)
+// Model coordinates of this vertex of the chunk. A vertex on an edge shared
+// with a coarser chunk, which the coarser chunk skips, gets moved onto the
+// coarser chunk's edge, so the two chunks don't crack apart.
+vec4 chunkVertex()
 {
-    float height = perlinMultiOctave(vec2(x,z) * scale, octaves, persistence);
-    //return max(30 * height, -9);
-    return 30 * height;
+    Chunk chunk = uChunks[uChunkIndex + gl_DrawIDARB];
+    ivec2 local = ivec2(aVertex.xz);
+
+    vec2 positionMC;
+    float height = getGridHeight(chunk, local, positionMC);
+
+    // Which neighbor this vertex's edge is shared with, and which way the edge runs
+    int   side = -1;
+    ivec2 along = ivec2(0);
+    if (local.x == 0)                { side = 0; along = ivec2(0, 1); }
+    else if (local.x == uChunkCells) { side = 1; along = ivec2(0, 1); }
+    else if (local.y == 0)           { side = 2; along = ivec2(1, 0); }
+    else if (local.y == uChunkCells) { side = 3; along = ivec2(1, 0); }
+
+    if (side >= 0) {
+        int neighborLod = (chunk.neighborLods >> (8 * side)) & 0xff;
+        int step = 1 << neighborLod;
+        int r = (along.x != 0 ? local.x : local.y) % step;
+        if (neighborLod > chunk.lod && r != 0) {
+            vec2 unused;
+            float h0 = getGridHeight(chunk, local - r * along, unused);
+            float h1 = getGridHeight(chunk, local + (step - r) * along, unused);
+            height = mix(h0, h1, float(r) / float(step));
+        }
+    }
+
+    return vec4(positionMC.x, height, positionMC.y, 1.f);
 }
+#endif
 
 void main() {
+#ifdef TESSELLATION
+    // The patch corners stay in model coordinates: terrain.tcs decides how
+    // finely to split each patch, and terrain.tes does the rest of this for
+    // every vertex that comes out of the split
+    gl_Position = vec4(aVertex, 1.f);
+    return;
+#endif
+
     //--------------------------------------------------------------------------
     // Get vertex coordinate data for calculations
     //--------------------------------------------------------------------------
 
+#ifdef CHUNKED
+    vec4 vertexMC = chunkVertex();
+#else
     // Convert vertex to vec4 for compatibility with matrix
     vec4 vertexMC = vec4(aVertex, 1.f);
 
     // Get noise coords and determine y-height
-    vertexMC.y = getHeight(vertexMC.x+uOffsetX, vertexMC.z+uOffsetZ, 0.01f, 6, 0.6f);
+    vertexMC.y = getTerrainHeight(vertexMC.x, vertexMC.z);
+#endif
 
     //--------------------------------------------------------------------------
     // Set `out` variables (lighting vectors) to geometry/fragment shader
@@ -127,10 +199,46 @@ void main() {
     // Position data to geometry shader
     vPosition = vec3(vertexEC);
 
+#ifndef UNLIT
     // Apply view matrix to light position and get vector from vertex to light
     vec4 lightEC = uViewMatrix * vec4(LIGHT_WC, 1.f);
     vLightVector = normalize( lightEC.xyz - vertexEC.xyz );
 
     // Calculate vector from vertex to eye
     vEyeVector = normalize( EYE_EC - vertexEC.xyz );
+#endif
+
+#ifdef NO_GEOMETRY_SHADER
+    //--------------------------------------------------------------------------
+    // Do the geometry shader's per-triangle work here instead
+    //--------------------------------------------------------------------------
+
+    // The mesh isn't indexed, so every vertex belongs to exactly one triangle:
+    // vertices 0-2 of each cell are one triangle and 3-5 are the other.
+    int corner = gl_VertexID % 6;
+
+#ifdef MULTICOLOR
+    // `flat` outputs come from the last vertex of each triangle (the default
+    // provoking vertex), so only that one needs the triangle's average
+    // height. It finds the other two corners from the grid layout and adds
+    // the heights in the same order as the geometry shader.
+    vFlatHeight = vHeight;
+    if (corner == 2 || corner == 5)
+    {
+        ivec2 cell = ivec2(round(aVertex.xz / uGridDelta));
+        ivec2 a = (corner == 2) ? cell + ivec2(-1, 0) : cell + ivec2( 0, -1);
+        ivec2 b = (corner == 2) ? cell + ivec2(-1, 1) : cell + ivec2(-1,  0);
+        vec2  pa = vec2(a) * uGridDelta;
+        vec2  pb = vec2(b) * uGridDelta;
+        float ha = getTerrainHeight(pa.x, pa.y);
+        float hb = getTerrainHeight(pb.x, pb.y);
+        vFlatHeight = (ha + hb + vHeight) / 3.f;
+    }
+#endif
+
+#ifdef WIREFRAME
+    int i = corner % 3;
+    vBarycentric = vec3(float(i == 0), float(i == 1), float(i == 2));
+#endif
+#endif
 }
@@ -0,0 +1,500 @@
+#include <algorithm>
+
+#include "terrainchunks.h"
+
+
+// how many chunks' grid bounds to remember before starting over:
+
+const int MAX_CACHED_BOUNDS = 4096;
+
+
+// how near and how far the footprint of the box ( boxMin, boxMax ) gets from eye's spot on the ground:
+
+static float
+NearestDistance( glm::vec3 eye, glm::vec3 boxMin, glm::vec3 boxMax )
+{
+	float dx = fmaxf( fmaxf( boxMin.x - eye.x, eye.x - boxMax.x ), 0.f );
+	float dz = fmaxf( fmaxf( boxMin.z - eye.z, eye.z - boxMax.z ), 0.f );
+	return sqrtf( dx*dx + dz*dz );
+}
+
+
+static float
+FarthestDistance( glm::vec3 eye, glm::vec3 boxMin, glm::vec3 boxMax )
+{
+	float dx = fmaxf( fabsf( eye.x - boxMin.x ), fabsf( eye.x - boxMax.x ) );
+	float dz = fmaxf( fabsf( eye.z - boxMin.z ), fabsf( eye.z - boxMax.z ) );
+	return sqrtf( dx*dx + dz*dz );
+}
+
+
+// widen b to take in the height at ( x, z ) in the window's model coordinates:
+
+void
+TerrainChunks::AddPointBounds( float x, float z, struct ChunkBounds *b )
+{
+	float heights[NOISE_MAX_OCTAVES];
+	NoiseHeights( x + offsetX, z + offsetZ, heights );
+
+	b->lo = fminf( b->lo, heights[NOISE_MAX_OCTAVES-1] );
+	b->hi = fmaxf( b->hi, heights[NOISE_MAX_OCTAVES-1] );
+	for( int i = 0; i < NOISE_MAX_OCTAVES; i++ )
+	{
+		b->loAny = fminf( b->loAny, heights[i] );
+		b->hiAny = fmaxf( b->hiAny, heights[i] );
+	}
+}
+
+
+// remove the chunks that are hidden behind nearer ones, as seen through projection:
+// (margin widens the height bounds -- never by less than the cpu and gpu noise can round
+//	differently, see terrainnoise.h -- and anyOctaves bounds the terrain for any number of octaves)
+// returns how many chunks were culled
+//
+// the Horizon only knows the terrain hides what is behind it when the eye is above
+//	the terrain, so this culls nothing when the eye is outside the window or too low
+
+int
+TerrainChunks::Cull( Horizon *horizon, glm::mat4 projection, float margin, bool anyOctaves )
+{
+	TRACE_ZONE( "TerrainChunks::Cull" );
+
+	margin = fmaxf( margin, NOISE_ROUNDING );
+
+	float chunkSize = (float)cells * cellSize;
+	glm::vec3 eye = glm::vec3( glm::inverse( modelView ) * glm::vec4( 0.f, 0.f, 0.f, 1.f ) );
+	if( eye.x < 0.f  ||  eye.x > windowSize  ||  eye.z < 0.f  ||  eye.z > windowSize )
+		return 0;
+
+	// the terrain under the eye is no higher than the corners of the cell it is in, at its chunk's lod:
+
+	int ex = (int)floorf( ( eye.x + offsetX ) / cellSize );
+	int ez = (int)floorf( ( eye.z + offsetZ ) / cellSize );
+	int step = 0;
+	for( int i = 0; i < (int)chunks.size( ); i++ )
+	{
+		if( chunks[i].cx == (int)floorf( (float)ex / (float)cells )  &&  chunks[i].cz == (int)floorf( (float)ez / (float)cells ) )
+			step = 1 << chunks[i].lod;
+	}
+	if( step == 0 )
+		return 0;
+
+	struct ChunkBounds under;
+	under.lo = under.loAny =  1.e30f;
+	under.hi = under.hiAny = -1.e30f;
+	ex -= ( ( ex % step ) + step ) % step;
+	ez -= ( ( ez % step ) + step ) % step;
+	for( int i = 0; i < 4; i++ )
+	{
+		float x = glm::clamp( (float)( ex + ( ( i & 1 ) ? step : 0 ) ) * cellSize - offsetX, 0.f, windowSize );
+		float z = glm::clamp( (float)( ez + ( ( i & 2 ) ? step : 0 ) ) * cellSize - offsetZ, 0.f, windowSize );
+		AddPointBounds( x, z, &under );
+	}
+	if( eye.y <= ( anyOctaves ? under.hiAny : under.hi ) + margin )
+		return 0;
+
+	// each chunk's bounding box, and the floors that hide what is behind it: one per tile,
+	//	as long as none of its triangles (or the edges it snaps to) reach past a tile,
+	//	and otherwise one for the whole chunk
+
+	int n = (int)chunks.size( );
+	int tileCells = cells / OCCLUDER_TILES;
+	std::vector<glm::vec3> boxMin( n ), boxMax( n );
+	std::vector<float> nearest( n );
+	std::vector<glm::vec3> floorMin, floorMax;
+	std::vector<float> farthest;
+	for( int i = 0; i < n; i++ )
+	{
+		struct ChunkBounds b = GetBounds( chunks[i].cx, chunks[i].cz );
+		float cx0 = (float)chunks[i].cx * chunkSize - offsetX;
+		float cz0 = (float)chunks[i].cz * chunkSize - offsetZ;
+		float x0 = fmaxf( cx0, 0.f );
+		float z0 = fmaxf( cz0, 0.f );
+		float x1 = fminf( cx0 + chunkSize, windowSize );
+		float z1 = fminf( cz0 + chunkSize, windowSize );
+		boxMin[i] = glm::vec3( x0, ( anyOctaves ? b.loAny : b.lo ) - margin, z0 );
+		boxMax[i] = glm::vec3( x1, ( anyOctaves ? b.hiAny : b.hi ) + margin, z1 );
+		nearest[i] = NearestDistance( eye, boxMin[i], boxMax[i] );
+
+		int coarsest = chunks[i].lod;
+		for( int side = 0; side < 4; side++ )
+			coarsest = std::max( coarsest, ( chunks[i].neighborLods >> ( 8 * side ) ) & 0xff );
+
+		bool inside = x0 == cx0  &&  z0 == cz0  &&  x1 == cx0 + chunkSize  &&  z1 == cz0 + chunkSize;
+		if( inside  &&  tileCells > 0  &&  ( 1 << coarsest ) <= tileCells )
+		{
+			float tileSize = (float)tileCells * cellSize;
+			for( int t = 0; t < OCCLUDER_TILES * OCCLUDER_TILES; t++ )
+			{
+				float tx = x0 + (float)( t % OCCLUDER_TILES ) * tileSize;
+				float tz = z0 + (float)( t / OCCLUDER_TILES ) * tileSize;
+				floorMin.push_back( glm::vec3( tx, ( anyOctaves ? b.tileLoAny[t] : b.tileLo[t] ) - margin, tz ) );
+				floorMax.push_back( glm::vec3( tx + tileSize, 0.f, tz + tileSize ) );
+			}
+		}
+		else
+		{
+			floorMin.push_back( boxMin[i] );
+			floorMax.push_back( boxMax[i] );
+		}
+	}
+	for( int f = 0; f < (int)floorMin.size( ); f++ )
+		farthest.push_back( FarthestDistance( eye, floorMin[f], floorMax[f] ) );
+
+	std::vector<int> byNearest( n ), byFarthest( floorMin.size( ) );
+	for( int i = 0; i < n; i++ )
+		byNearest[i] = i;
+	for( int f = 0; f < (int)floorMin.size( ); f++ )
+		byFarthest[f] = f;
+	std::sort( byNearest.begin( ), byNearest.end( ), [&]( int a, int b ) { return nearest[a] < nearest[b]; } );
+	std::sort( byFarthest.begin( ), byFarthest.end( ), [&]( int a, int b ) { return farthest[a] < farthest[b]; } );
+
+	// front to back -- a floor only joins the horizon once every chunk still to be
+	//	tested is entirely beyond it (along any ray from the eye, the distances from
+	//	the eye's spot on the ground grow together):
+
+	horizon->Begin( projection * modelView );
+	std::vector<bool> hidden( n, false );
+	int next = 0;
+	for( int k = 0; k < n; k++ )
+	{
+		int i = byNearest[k];
+		while( next < (int)byFarthest.size( )  &&  farthest[ byFarthest[next] ] <= nearest[i] )
+		{
+			horizon->Occlude( floorMin[ byFarthest[next] ], floorMax[ byFarthest[next] ] );
+			next++;
+		}
+		hidden[i] = horizon->Hides( boxMin[i], boxMax[i] );
+	}
+
+	int kept = 0;
+	for( int i = 0; i < n; i++ )
+	{
+		if( hidden[i] )
+			continue;
+		chunks[kept] = chunks[i];
+		commands[kept] = commands[i];
+		kept++;
+	}
+	chunks.resize( kept );
+	commands.resize( kept );
+	return n - kept;
+}
+
+
+// draw every chunk from the last Update( ) with program, which is already in use:
+// (multiDraw picks one glMultiDrawElementsIndirect( ) over one glDrawElements( ) per chunk)
+// returns the number of draw calls it took
+
+int
+TerrainChunks::Draw( GLSLProgram *program, bool multiDraw )
+{
+	TRACE_ZONE( "TerrainChunks::Draw" );
+
+	if( chunks.empty( ) )
+		return 0;
+
+	glBindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+	program->SetAttributePointer3fv( (char *)"aVertex", 3, (GLfloat *)0 );
+	program->EnableVertexAttribArray( "aVertex" );
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, CHUNK_BUFFER_BINDING, chunkBuffer );
+
+	int drawCalls;
+	if( multiDraw )
+	{
+		// gl_DrawIDARB counts the draws from 0, so it is the chunk number by itself:
+		program->SetUniformVariable( (char *)"uChunkIndex", 0 );
+
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectBuffer );
+		glMultiDrawElementsIndirect( GL_TRIANGLES, GL_UNSIGNED_INT, (void *)0, (GLsizei)commands.size( ), 0 );
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+		drawCalls = 1;
+	}
+	else
+	{
+		for( int i = 0; i < (int)commands.size( ); i++ )
+		{
+			program->SetUniformVariable( (char *)"uChunkIndex", i );
+			glDrawElements( GL_TRIANGLES, commands[i].count, GL_UNSIGNED_INT,
+				(void *)( (size_t)commands[i].firstIndex * sizeof(GLuint) ) );
+		}
+		drawCalls = (int)commands.size( );
+	}
+
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+	return drawCalls;
+}
+
+
+// the height bounds of chunk ( cx, cz ), as the last Update( )'s window clamps it:
+// (every grid point of the chunk, and where the ones outside the window get pulled in to its edges)
+
+struct ChunkBounds
+TerrainChunks::GetBounds( int cx, int cz )
+{
+	std::pair<int,int> key( cx, cz );
+	std::map< std::pair<int,int>, struct ChunkBounds >::iterator it = gridBounds.find( key );
+
+	float chunkSize = (float)cells * cellSize;
+	float x0 = (float)cx * chunkSize - offsetX;
+	float z0 = (float)cz * chunkSize - offsetZ;
+
+	struct ChunkBounds b;
+	if( it != gridBounds.end( ) )
+	{
+		b = it->second;
+	}
+	else
+	{
+		b.lo = b.loAny =  1.e30f;
+		b.hi = b.hiAny = -1.e30f;
+		for( int t = 0; t < OCCLUDER_TILES * OCCLUDER_TILES; t++ )
+			b.tileLo[t] = b.tileLoAny[t] = 1.e30f;
+
+		// a grid point on the side of a tile belongs to the tiles on both sides:
+		int tileCells = std::max( cells / OCCLUDER_TILES, 1 );
+		for( int j = 0; j <= cells; j++ )
+		{
+			for( int i = 0; i <= cells; i++ )
+			{
+				struct ChunkBounds p;
+				p.lo = p.loAny =  1.e30f;
+				p.hi = p.hiAny = -1.e30f;
+				AddPointBounds( x0 + (float)i * cellSize, z0 + (float)j * cellSize, &p );
+
+				b.lo = fminf( b.lo, p.lo );
+				b.hi = fmaxf( b.hi, p.hi );
+				b.loAny = fminf( b.loAny, p.loAny );
+				b.hiAny = fmaxf( b.hiAny, p.hiAny );
+
+				int ti0 = std::max( i - 1, 0 ) / tileCells, ti1 = std::min( i / tileCells, OCCLUDER_TILES - 1 );
+				int tj0 = std::max( j - 1, 0 ) / tileCells, tj1 = std::min( j / tileCells, OCCLUDER_TILES - 1 );
+				for( int tj = tj0; tj <= tj1; tj++ )
+				{
+					for( int ti = ti0; ti <= ti1; ti++ )
+					{
+						int t = tj * OCCLUDER_TILES + ti;
+						b.tileLo[t] = fminf( b.tileLo[t], p.lo );
+						b.tileLoAny[t] = fminf( b.tileLoAny[t], p.loAny );
+					}
+				}
+			}
+		}
+
+		if( (int)gridBounds.size( ) >= MAX_CACHED_BOUNDS )
+			gridBounds.clear( );
+		gridBounds[key] = b;
+	}
+
+	float x1 = x0 + chunkSize;
+	float z1 = z0 + chunkSize;
+	if( x0 < 0.f  ||  z0 < 0.f  ||  x1 > windowSize  ||  z1 > windowSize )
+	{
+		for( int k = 0; k <= cells; k++ )
+		{
+			float x = glm::clamp( x0 + (float)k * cellSize, 0.f, windowSize );
+			float z = glm::clamp( z0 + (float)k * cellSize, 0.f, windowSize );
+			if( x0 < 0.f )		AddPointBounds( 0.f, z, &b );
+			if( x1 > windowSize )	AddPointBounds( windowSize, z, &b );
+			if( z0 < 0.f )		AddPointBounds( x, 0.f, &b );
+			if( z1 > windowSize )	AddPointBounds( x, windowSize, &b );
+		}
+	}
+	return b;
+}
+
+
+int
+TerrainChunks::GetCells( )
+{
+	return cells;
+}
+
+
+// chunk i of the last Update( ) (and Cull( )):
+
+struct TerrainChunk *
+TerrainChunks::GetChunk( int i )
+{
+	return &chunks[i];
+}
+
+
+int
+TerrainChunks::GetNumChunks( )
+{
+	return (int)chunks.size( );
+}
+
+
+// vertices the last Update( )'s chunks submit, counting the shared ones once per triangle:
+
+int
+TerrainChunks::GetNumIndices( )
+{
+	int n = 0;
+	for( int i = 0; i < (int)commands.size( ); i++ )
+		n += commands[i].count;
+	return n;
+}
+
+
+// _cells is the number of grid cells along each side of a chunk, and must be a power of 2:
+// (this needs a current GL context)
+
+void
+TerrainChunks::Init( int _cells, float _cellSize )
+{
+	cells = _cells;
+	cellSize = _cellSize;
+
+	numLods = 1;
+	while( ( 1 << numLods ) <= cells )
+		numLods++;
+	if( ( 1 << ( numLods - 1 ) ) != cells )
+		fprintf( stderr, "TerrainChunks: %d cells per chunk is not a power of 2\n", cells );
+
+	// every chunk uses the same vertices -- their place in the chunk's grid:
+
+	std::vector<GLfloat> vertices;
+	for( int z = 0; z <= cells; z++ )
+	{
+		for( int x = 0; x <= cells; x++ )
+		{
+			vertices.push_back( (float)x );
+			vertices.push_back( 0.f );
+			vertices.push_back( (float)z );
+		}
+	}
+
+	// each lod uses every 2^lod'th one, with the triangles the way GenerateTerrainMesh( ) makes them:
+
+	std::vector<GLuint> indices;
+	lodFirstIndex.clear( );
+	lodCount.clear( );
+	for( int lod = 0; lod < numLods; lod++ )
+	{
+		int step = 1 << lod;
+		int n = cells / step;
+		lodFirstIndex.push_back( (GLuint)indices.size( ) );
+		for( int z = 0; z < n; z++ )
+		{
+			for( int x = 0; x < n; x++ )
+			{
+				GLuint p00 = ( z * step ) * ( cells + 1 ) + ( x * step );
+				GLuint p01 = p00 + step * ( cells + 1 );	// one step in +z
+				GLuint p10 = p00 + step;			// one step in +x
+				GLuint p11 = p01 + step;
+
+				indices.push_back( p00 );  indices.push_back( p01 );  indices.push_back( p10 );
+				indices.push_back( p10 );  indices.push_back( p01 );  indices.push_back( p11 );
+			}
+		}
+		lodCount.push_back( (GLuint)indices.size( ) - lodFirstIndex[lod] );
+	}
+
+	glGenBuffers( 1, &vertexBuffer );
+	glBindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+	glBufferData( GL_ARRAY_BUFFER, vertices.size( ) * sizeof(GLfloat), &vertices[0], GL_STATIC_DRAW );
+
+	glGenBuffers( 1, &indexBuffer );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, indexBuffer );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, indices.size( ) * sizeof(GLuint), &indices[0], GL_STATIC_DRAW );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+	glGenBuffers( 1, &chunkBuffer );
+	glGenBuffers( 1, &indirectBuffer );
+}
+
+
+// pick the chunks that cover the window ( offsetX, offsetZ ) to ( offsetX, offsetZ ) + windowSize
+//	of the terrain, and their levels of detail:
+//
+// modelView takes the window's model coordinates to eye coordinates, and a chunk gets one
+//	level coarser each time the distance from the eye to its nearest point doubles past lodDistance
+// (nothing is drawn differently until Upload( ))
+
+void
+TerrainChunks::Update( float _offsetX, float _offsetZ, float _windowSize, glm::mat4 _modelView, float lodDistance )
+{
+	TRACE_ZONE( "TerrainChunks::Update" );
+
+	offsetX = _offsetX;
+	offsetZ = _offsetZ;
+	windowSize = _windowSize;
+	modelView = _modelView;
+
+	float chunkSize = (float)cells * cellSize;
+	int cx0 = (int)floorf( offsetX / chunkSize );
+	int cz0 = (int)floorf( offsetZ / chunkSize );
+	int nx = (int)floorf( ( offsetX + windowSize ) / chunkSize ) - cx0 + 1;
+	int nz = (int)floorf( ( offsetZ + windowSize ) / chunkSize ) - cz0 + 1;
+
+	glm::vec3 eye = glm::vec3( glm::inverse( modelView ) * glm::vec4( 0.f, 0.f, 0.f, 1.f ) );
+
+	chunks.resize( nx * nz );
+	for( int j = 0; j < nz; j++ )
+	{
+		for( int i = 0; i < nx; i++ )
+		{
+			struct TerrainChunk *c = &chunks[ j * nx + i ];
+			c->cx = cx0 + i;
+			c->cz = cz0 + j;
+			c->tile = -1;
+			c->pad = 0;
+
+			// the nearest point of the chunk to the eye, in the window's model coordinates:
+			float x0 = (float)c->cx * chunkSize - offsetX;
+			float z0 = (float)c->cz * chunkSize - offsetZ;
+			glm::vec3 nearest = glm::vec3( glm::clamp( eye.x, x0, x0 + chunkSize ), 0.f, glm::clamp( eye.z, z0, z0 + chunkSize ) );
+			float distance = glm::length( glm::vec3( modelView * glm::vec4( nearest, 1.f ) ) );
+
+			c->lod = 0;
+			while( c->lod < numLods - 1  &&  distance > lodDistance * (float)( 1 << c->lod ) )
+				c->lod++;
+		}
+	}
+
+	// the chunks along the outside have no neighbor there, so they use their own lod:
+
+	commands.resize( chunks.size( ) );
+	for( int j = 0; j < nz; j++ )
+	{
+		for( int i = 0; i < nx; i++ )
+		{
+			struct TerrainChunk *c = &chunks[ j * nx + i ];
+			int minusX = ( i > 0 )      ? chunks[ j * nx + i - 1 ].lod   : c->lod;
+			int plusX  = ( i < nx - 1 ) ? chunks[ j * nx + i + 1 ].lod   : c->lod;
+			int minusZ = ( j > 0 )      ? chunks[ ( j - 1 ) * nx + i ].lod : c->lod;
+			int plusZ  = ( j < nz - 1 ) ? chunks[ ( j + 1 ) * nx + i ].lod : c->lod;
+			c->neighborLods = minusX | ( plusX << 8 ) | ( minusZ << 16 ) | ( plusZ << 24 );
+
+			struct DrawElementsIndirectCommand *d = &commands[ j * nx + i ];
+			d->count = lodCount[c->lod];
+			d->instanceCount = 1;
+			d->firstIndex = lodFirstIndex[c->lod];
+			d->baseVertex = 0;
+			d->baseInstance = 0;
+		}
+	}
+}
+
+
+// send the chunks to draw to the gpu:
+
+void
+TerrainChunks::Upload( )
+{
+	if( chunks.empty( ) )
+		return;
+
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, chunkBuffer );
+	glBufferData( GL_SHADER_STORAGE_BUFFER, chunks.size( ) * sizeof(struct TerrainChunk), &chunks[0], GL_STREAM_DRAW );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, indirectBuffer );
+	glBufferData( GL_DRAW_INDIRECT_BUFFER, commands.size( ) * sizeof(struct DrawElementsIndirectCommand), &commands[0], GL_STREAM_DRAW );
+	glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+}
@@ -0,0 +1,124 @@
+#ifndef TERRAINCHUNKS_H
+#define TERRAINCHUNKS_H
+
+#include <stdio.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include "glew.h"
+#include <GL/gl.h>
+#endif
+
+#include "glm/glm.hpp"
+#include "glslprogram.h"
+#include "horizon.h"
+#include "terrainnoise.h"
+
+
+//********************************************************************************
+// the terrain as a grid of square chunks, fixed to the terrain rather than to the
+//	window, so scrolling brings new chunks in at one side and drops them at the other
+//
+// every chunk draws the same small indexed grid, at a level of detail picked from
+//	its distance -- terrain.vert (with CHUNKED #define'd) finds each chunk's place and
+//	level of detail in a shader storage buffer, and snaps the vertices along an edge
+//	shared with a coarser chunk onto that chunk's edge, so there are no cracks
+//
+// all the chunks can be drawn with one glMultiDrawElementsIndirect( ), which terrain.vert
+//	tells apart with gl_DrawIDARB, or with one glDrawElements( ) each
+//
+// chunks hidden behind nearer ridges can be culled first, against a Horizon built
+//	front to back from the chunks' height bounds (from the cpu copy of the noise)
+//********************************************************************************
+
+
+// shader storage buffer binding of the chunk list (as in terrain.vert):
+
+const int CHUNK_BUFFER_BINDING = 2;
+
+
+// one chunk to draw -- must match struct Chunk in terrain.vert (std430 layout):
+
+struct TerrainChunk
+{
+	int	cx, cz;		// which chunk: it starts at grid point ( cx, cz ) * cells
+	int	lod;		// draws every 2^lod'th grid point
+	int	neighborLods;	// lod of the chunks at -x, +x, -z, +z, a byte each from the lowest
+	int	tile;		// slot of its heights in the TileUploader's buffer, or -1 for none
+	int	pad;		// (std430 rounds the struct up to a multiple of its ivec2)
+};
+
+
+// the horizon culling also takes the lowest point of each of OCCLUDER_TILES x OCCLUDER_TILES
+//	tiles of a chunk, which hides a lot more than the lowest point of the whole chunk:
+
+const int OCCLUDER_TILES = 4;
+
+
+// lowest and highest the terrain gets over a chunk -- with all the octaves, and with any
+//	number of them (for ADAPTIVE_OCTAVES):
+
+struct ChunkBounds
+{
+	float	lo, hi;
+	float	loAny, hiAny;
+	float	tileLo[OCCLUDER_TILES*OCCLUDER_TILES];		// only for the whole grid, not the window's edges
+	float	tileLoAny[OCCLUDER_TILES*OCCLUDER_TILES];
+};
+
+
+// what glMultiDrawElementsIndirect( ) reads for each draw:
+
+struct DrawElementsIndirectCommand
+{
+	GLuint	count;
+	GLuint	instanceCount;
+	GLuint	firstIndex;
+	GLint	baseVertex;
+	GLuint	baseInstance;
+};
+
+
+class TerrainChunks
+{
+  private:
+	int		cells;			// grid cells along each side of a chunk, at lod 0
+	float		cellSize;		// width of one grid cell
+	int		numLods;
+	std::vector<GLuint>	lodFirstIndex;	// where each lod's triangles start in the index buffer
+	std::vector<GLuint>	lodCount;
+
+	std::vector<struct TerrainChunk>		chunks;
+	std::vector<struct DrawElementsIndirectCommand>	commands;
+
+	float		offsetX, offsetZ;	// the window of terrain from the last Update( )
+	float		windowSize;
+	glm::mat4	modelView;
+
+	std::map< std::pair<int,int>, struct ChunkBounds >	gridBounds;	// every grid point of a chunk, by cx, cz
+
+	void			AddPointBounds( float, float, struct ChunkBounds * );
+	struct ChunkBounds	GetBounds( int, int );
+
+	GLuint		vertexBuffer;
+	GLuint		indexBuffer;
+	GLuint		chunkBuffer;
+	GLuint		indirectBuffer;
+
+  public:
+	int	Cull( Horizon *, glm::mat4, float, bool );
+	int	Draw( GLSLProgram *, bool );
+	int	GetCells( );
+	struct TerrainChunk *GetChunk( int );
+	int	GetNumChunks( );
+	int	GetNumIndices( );
+	void	Init( int, float );
+	void	Update( float, float, float, glm::mat4, float );
+	void	Upload( );
+};
+
+#endif	// TERRAINCHUNKS_H
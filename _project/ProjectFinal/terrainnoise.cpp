@@ -0,0 +1,87 @@
+#include "terrainnoise.h"
+
+
+// pcgHash( ) in noise.glsl -- a PCG step, all in 32-bit unsigned ints, so it is the same
+//	bit for bit on any cpu and gpu:
+
+static unsigned int
+NoisePcg( unsigned int v )
+{
+	unsigned int state = v * 747796405u + 2891336453u;
+	unsigned int word = ( ( state >> ( ( state >> 28u ) + 4u ) ) ^ state ) * 277803737u;
+	return ( word >> 22u ) ^ word;
+}
+
+
+// GRADIENTS in noise.glsl:
+
+static const float NOISE_GRADIENTS[16][2] =
+{
+	{  1.00000000f,  0.00000000f }, {  0.92387953f,  0.38268343f },
+	{  0.70710678f,  0.70710678f }, {  0.38268343f,  0.92387953f },
+	{  0.00000000f,  1.00000000f }, { -0.38268343f,  0.92387953f },
+	{ -0.70710678f,  0.70710678f }, { -0.92387953f,  0.38268343f },
+	{ -1.00000000f,  0.00000000f }, { -0.92387953f, -0.38268343f },
+	{ -0.70710678f, -0.70710678f }, { -0.38268343f, -0.92387953f },
+	{  0.00000000f, -1.00000000f }, {  0.38268343f, -0.92387953f },
+	{  0.70710678f, -0.70710678f }, {  0.92387953f, -0.38268343f }
+};
+
+
+// hash( ) and randomGradient( ) in noise.glsl, for the lattice point ( x, z ):
+
+static void
+NoiseGradient( float x, float z, float *gx, float *gz )
+{
+	unsigned int hash = NoisePcg( (unsigned int)(int)x + NoisePcg( (unsigned int)(int)z ) );
+	*gx = NOISE_GRADIENTS[ hash & 15u ][0];
+	*gz = NOISE_GRADIENTS[ hash & 15u ][1];
+}
+
+
+// perlin( ) in noise.glsl -- between -1 and +1:
+
+float
+NoisePerlin( float x, float z )
+{
+	float x0 = floorf( x );
+	float z0 = floorf( z );
+	float u = x - x0;
+	float v = z - z0;
+
+	float g[4][2];
+	NoiseGradient( x0,       z0,       &g[0][0], &g[0][1] );
+	NoiseGradient( x0 + 1.f, z0,       &g[1][0], &g[1][1] );
+	NoiseGradient( x0,       z0 + 1.f, &g[2][0], &g[2][1] );
+	NoiseGradient( x0 + 1.f, z0 + 1.f, &g[3][0], &g[3][1] );
+
+	float d00 = g[0][0] * u         + g[0][1] * v;
+	float d10 = g[1][0] * ( u - 1.f ) + g[1][1] * v;
+	float d01 = g[2][0] * u         + g[2][1] * ( v - 1.f );
+	float d11 = g[3][0] * ( u - 1.f ) + g[3][1] * ( v - 1.f );
+
+	float nx0 = d00 + u * ( d10 - d00 );
+	float nx1 = d01 + u * ( d11 - d01 );
+	return nx0 + v * ( nx1 - nx0 );
+}
+
+
+// the terrain's height at ( x, z ) in the noise's own coordinates (the grid position plus
+//	the offset) with 1, 2, ... NOISE_MAX_OCTAVES octaves, into heights[0], heights[1], ...
+// (ADAPTIVE_OCTAVES fades the last octave in, so its height is always between two of these)
+
+void
+NoiseHeights( float x, float z, float heights[ ] )
+{
+	float total = 0.f;
+	float frequency = 1.f;
+	float amplitude = 1.f;
+
+	for( int i = 0; i < NOISE_MAX_OCTAVES; i++ )
+	{
+		total += NoisePerlin( x * NOISE_SCALE * frequency, z * NOISE_SCALE * frequency ) * amplitude;
+		heights[i] = NOISE_AMPLITUDE * total;
+		frequency *= 2.f;
+		amplitude *= NOISE_GAIN;
+	}
+}
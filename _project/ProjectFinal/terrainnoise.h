@@ -0,0 +1,36 @@
+#ifndef TERRAINNOISE_H
+#define TERRAINNOISE_H
+
+#include <math.h>
+
+
+//********************************************************************************
+// a cpu copy of the terrain's height function in noise.glsl, for the cpu-side
+//	decisions that need to know how tall the terrain is somewhere
+//
+// it picks the same gradients as the shader bit for bit (an integer hash, and a
+//	table of directions), then does the same float operations in the same order --
+//	so the heights only differ by how the gpu rounds and fuses them, a few ulps
+//********************************************************************************
+
+
+// as getHeight( ) in noise.glsl is called from getTerrainHeight( ):
+
+const int	NOISE_MAX_OCTAVES	= 6;
+const float	NOISE_SCALE		= 0.01f;
+const float	NOISE_AMPLITUDE		= 30.f;
+const float	NOISE_GAIN		= 0.6f;		// the persistence
+
+// bumped whenever the height function changes, so no tiles made with another one get used:
+
+const int	NOISE_VERSION		= 2;
+
+// more than the cpu's heights can differ from the gpu's by, with its own rounding:
+
+const float	NOISE_ROUNDING		= 0.01f;
+
+
+float	NoisePerlin( float, float );
+void	NoiseHeights( float, float, float [ ] );
+
+#endif	// TERRAINNOISE_H
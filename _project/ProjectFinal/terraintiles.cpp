@@ -0,0 +1,683 @@
+#include <chrono>
+#include <math.h>
+
+#include "terraintiles.h"
+
+
+TerrainTiles::TerrainTiles( )
+{
+	cells = 0;
+	cellSize = 0.f;
+	params = 0;
+	requested = received = reprioritized = 0;
+	collectLimit = -1;
+	lookahead = TILE_PREFETCH_TILES;
+	cache.SetBudget( TILE_CACHE_BYTES );
+	heading = glm::vec2( 0.f, 0.f );
+	haveWindow = false;
+	windowX0 = windowX1 = windowZ0 = windowZ1 = 0;
+	prefetchHits = prefetchLate = prefetchMisses = prefetchWasted = 0;
+}
+
+
+TerrainTiles::~TerrainTiles( )
+{
+	pool.Stop( );
+	CloseShared( );
+
+	TileJob *job;
+	while( ( job = pool.TakeDone( ) ) != NULL )
+		delete job;
+}
+
+
+// the tiles the window of terrain ( offsetX, offsetZ ) .. + windowSize sweeps over in the next
+//	lookahead tiles along its heading, that it isn't over already:
+
+void
+TerrainTiles::Ahead( float offsetX, float offsetZ, float windowSize, std::set< std::pair<int,int> > *ahead )
+{
+	if( lookahead <= 0  ||  heading == glm::vec2( 0.f, 0.f ) )
+		return;
+
+	float tileSize = (float)cells * cellSize;
+	int cx0 = (int)floorf( offsetX / tileSize );
+	int cz0 = (int)floorf( offsetZ / tileSize );
+	int cx1 = (int)floorf( ( offsetX + windowSize ) / tileSize );
+	int cz1 = (int)floorf( ( offsetZ + windowSize ) / tileSize );
+
+	// (half a tile at a time, so a diagonal heading can't skip a corner)
+	for( float d = .5f * tileSize; d <= (float)lookahead * tileSize; d += .5f * tileSize )
+	{
+		float x = offsetX + d * heading.x;
+		float z = offsetZ + d * heading.y;
+		int ax0 = (int)floorf( x / tileSize );
+		int az0 = (int)floorf( z / tileSize );
+		int ax1 = (int)floorf( ( x + windowSize ) / tileSize );
+		int az1 = (int)floorf( ( z + windowSize ) / tileSize );
+		for( int cz = az0; cz <= az1; cz++ )
+		{
+			for( int cx = ax0; cx <= ax1; cx++ )
+			{
+				if( cx < cx0  ||  cx > cx1  ||  cz < cz0  ||  cz > cz1 )
+					ahead->insert( std::pair<int,int>( cx, cz ) );
+			}
+		}
+	}
+}
+
+
+// let go of the shared tiles, and stop sharing:
+
+void
+TerrainTiles::CloseShared( )
+{
+	for( std::map< std::pair<int,int>, int >::iterator f = fromShared.begin( ); f != fromShared.end( ); f++ )
+		shared.Release( f->second );
+	fromShared.clear( );
+	shared.Close( );
+}
+
+
+// ask the tile service daemon listening on socket path for the tiles, instead of making them:
+// (call after Init( ), which says what kind of tiles they are)
+
+bool
+TerrainTiles::ConnectService( const char *path )
+{
+	return client.Connect( path, cells, params );
+}
+
+
+// take the jobs that have come back, up to limit made tiles (-1 for no limit) -- anything no
+//	longer pending was cancelled, or asked for again since, but if it got made anyway it
+//	goes in the cache:
+
+void
+TerrainTiles::Collect( int limit )
+{
+	int taken = 0;
+	TileJob *job;
+	while( ( limit < 0  ||  taken < limit )  &&  ( job = TakeDone( ) ) != NULL )
+	{
+		std::pair<int,int> key( job->cx, job->cz );
+		std::map< std::pair<int,int>, TileJob * >::iterator p = pending.find( key );
+
+		// (the daemon's may be in a memfd mapping, not in the job)
+		int mapping = -1;
+		const float *heights = job->finished ? client.TakeMapped( job, &mapping ) : NULL;
+		if( heights == NULL )
+			heights = job->heights.data( );
+		if( job->finished )
+		{
+			shared.Publish( job->cx, job->cz, heights );
+			store.Put( job->cx, job->cz, heights );
+		}
+
+		if( p != pending.end( )  &&  p->second == job )
+		{
+			pending.erase( p );
+			if( job->finished )
+			{
+				if( mapping >= 0 )
+					fromService[key] = std::pair<const float *, int>( heights, mapping );
+				else
+					tiles[key].swap( job->heights );
+				mapping = -1;
+				received++;
+				taken++;
+			}
+		}
+		else if( job->finished  &&  p == pending.end( )  &&  ! Have( key ) )
+		{
+			if( mapping >= 0 )
+				job->heights.assign( heights, heights + ( cells + 1 ) * ( cells + 1 ) );
+			TileKey cached = { job->cx, job->cz, params };
+			cache.Put( cached, &job->heights );
+		}
+		if( mapping >= 0 )
+			client.Release( mapping );
+		delete job;
+	}
+}
+
+
+// move tile t into the cache:
+
+void
+TerrainTiles::Drop( std::map< std::pair<int,int>, std::vector<float> >::iterator t )
+{
+	TileKey key = { t->first.first, t->first.second, params };
+	cache.Put( key, &t->second );
+	tiles.erase( t );
+}
+
+
+// wait for every tile asked for so far to come back:
+
+void
+TerrainTiles::Finish( )
+{
+	pool.Flush( );
+	client.Flush( );
+	Collect( -1 );
+	while( ! pending.empty( ) )
+	{
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		pool.Flush( );
+		client.Flush( );
+		Collect( -1 );
+	}
+}
+
+
+// a hash of every tile held, in order -- the same for the same tiles however they were made:
+
+unsigned int
+TerrainTiles::GetChecksum( )
+{
+	// (in order, wherever they came from)
+	std::map< std::pair<int,int>, const float * > all( fromStore.begin( ), fromStore.end( ) );
+	for( std::map< std::pair<int,int>, int >::iterator f = fromShared.begin( ); f != fromShared.end( ); f++ )
+		all[ f->first ] = shared.GetHeights( f->second );
+	for( std::map< std::pair<int,int>, std::pair<const float *, int> >::iterator f = fromService.begin( ); f != fromService.end( ); f++ )
+		all[ f->first ] = f->second.first;
+	for( std::map< std::pair<int,int>, std::vector<float> >::iterator t = tiles.begin( ); t != tiles.end( ); t++ )
+		all[ t->first ] = t->second.data( );
+
+	unsigned int hash = FNV1A_BASIS;
+	size_t tileBytes = ( cells + 1 ) * ( cells + 1 ) * sizeof( float );
+	for( std::map< std::pair<int,int>, const float * >::iterator t = all.begin( ); t != all.end( ); t++ )
+	{
+		int key[2] = { t->first.first, t->first.second };
+		hash = Fnv1a( hash, key, sizeof(key) );
+		hash = Fnv1a( hash, t->second, tileBytes );
+	}
+	return hash;
+}
+
+
+TileCache *
+TerrainTiles::GetCache( )
+{
+	return &cache;
+}
+
+
+TileClient *
+TerrainTiles::GetClient( )
+{
+	return &client;
+}
+
+
+int
+TerrainTiles::GetLookahead( )
+{
+	return lookahead;
+}
+
+
+int
+TerrainTiles::GetNumPending( )
+{
+	return (int)pending.size( );
+}
+
+
+int
+TerrainTiles::GetNumTiles( )
+{
+	return (int)( tiles.size( ) + fromStore.size( ) + fromShared.size( ) + fromService.size( ) );
+}
+
+
+// the hash of the noise parameters and grid the tiles are made with (see TileParamsHash( )):
+
+unsigned int
+TerrainTiles::GetParams( )
+{
+	return params;
+}
+
+
+TilePool *
+TerrainTiles::GetPool( )
+{
+	return &pool;
+}
+
+
+TileShared *
+TerrainTiles::GetShared( )
+{
+	return &shared;
+}
+
+
+TileStore *
+TerrainTiles::GetStore( )
+{
+	return &store;
+}
+
+
+// tiles that came into the window already made, still being made, or not even asked for yet,
+//	and tiles made ahead that the window never came to:
+
+long long
+TerrainTiles::GetPrefetchHits( )
+{
+	return prefetchHits;
+}
+
+
+long long
+TerrainTiles::GetPrefetchLate( )
+{
+	return prefetchLate;
+}
+
+
+long long
+TerrainTiles::GetPrefetchMisses( )
+{
+	return prefetchMisses;
+}
+
+
+long long
+TerrainTiles::GetPrefetchWasted( )
+{
+	return prefetchWasted;
+}
+
+
+long long
+TerrainTiles::GetReceived( )
+{
+	return received;
+}
+
+
+long long
+TerrainTiles::GetReprioritized( )
+{
+	return reprioritized;
+}
+
+
+long long
+TerrainTiles::GetRequested( )
+{
+	return requested;
+}
+
+
+// the heights of tile ( cx, cz ), ( cells + 1 ) x ( cells + 1 ) of them, or NULL if it isn't here (yet):
+
+const float *
+TerrainTiles::GetTile( int cx, int cz )
+{
+	std::pair<int,int> key( cx, cz );
+	std::map< std::pair<int,int>, std::vector<float> >::iterator t = tiles.find( key );
+	if( t != tiles.end( ) )
+		return t->second.data( );
+
+	std::map< std::pair<int,int>, const float * >::iterator f = fromStore.find( key );
+	if( f != fromStore.end( ) )
+		return f->second;
+
+	std::map< std::pair<int,int>, int >::iterator g = fromShared.find( key );
+	if( g != fromShared.end( ) )
+		return shared.GetHeights( g->second );
+
+	std::map< std::pair<int,int>, std::pair<const float *, int> >::iterator s = fromService.find( key );
+	if( s != fromService.end( ) )
+		return s->second.first;
+	return NULL;
+}
+
+
+// whether tile key is here, wherever it came from:
+
+bool
+TerrainTiles::Have( std::pair<int,int> key )
+{
+	return tiles.count( key ) != 0  ||  fromStore.count( key ) != 0  ||  fromShared.count( key ) != 0  ||  fromService.count( key ) != 0;
+}
+
+
+// tiles of cells x cells grid cells, cellSize apart, made by numWorkers threads:
+// (with none, Update( ) makes them itself)
+
+void
+TerrainTiles::Init( int _cells, float _cellSize, int numWorkers )
+{
+	cells = _cells;
+	cellSize = _cellSize;
+	params = TileParamsHash( cells, cellSize );
+	pool.Start( numWorkers, cells, cellSize );
+}
+
+
+// how soon tile ( cx, cz ) is wanted by an eye at eye, looking along forward -- lower is sooner:
+
+float
+TerrainTiles::Priority( int cx, int cz, glm::vec3 eye, glm::vec3 forward )
+{
+	float tileSize = (float)cells * cellSize;
+	glm::vec3 toCenter = glm::vec3( ( (float)cx + .5f ) * tileSize, 0.f, ( (float)cz + .5f ) * tileSize ) - eye;
+	toCenter.y = 0.f;
+	float priority = glm::length( toCenter );
+	if( glm::dot( toCenter, forward ) < 0.f )
+		priority *= TILE_BEHIND_FACTOR;
+	return priority;
+}
+
+
+// ask a worker for tile ( cx, cz ), unless it is here or on its way already, or in the shared
+//	cache, the store or the cache -- true if it was asked for (or found):
+
+bool
+TerrainTiles::Request( int cx, int cz, float priority, std::vector<TileJob *> *jobs )
+{
+	std::pair<int,int> key( cx, cz );
+	if( Have( key )  ||  pending.count( key ) != 0 )
+		return false;
+
+	int slot = shared.Acquire( cx, cz );
+	if( slot >= 0 )
+	{
+		fromShared[key] = slot;
+		return true;
+	}
+
+	const float *stored = store.Find( cx, cz );
+	if( stored != NULL )
+	{
+		fromStore[key] = stored;
+		return true;
+	}
+
+	TileKey cached = { cx, cz, params };
+	std::vector<float> heights;
+	if( cache.Take( cached, &heights ) )
+	{
+		tiles[key].swap( heights );
+		return true;
+	}
+
+	TileJob *job = new TileJob;
+	job->cx = cx;
+	job->cz = cz;
+	job->cancelled = false;
+	job->finished = false;
+	job->priority = job->asked = priority;
+	job->worker = -1;
+
+	pending[key] = job;
+	jobs->push_back( job );
+	return true;
+}
+
+
+// take at most limit made tiles a frame, or all there are for -1:
+
+void
+TerrainTiles::SetCollectLimit( int limit )
+{
+	collectLimit = limit;
+}
+
+
+// share the tiles with the other viewers through the shared memory called name, and look there
+//	before anywhere else:
+// (call after Init( ), which says what kind of tiles they are)
+
+bool
+TerrainTiles::OpenShared( const char *name )
+{
+	return shared.Open( name, cells, params );
+}
+
+
+// keep the tiles in file, and look there before making any:
+// (call after Init( ), which says what kind of tiles they are)
+
+bool
+TerrainTiles::OpenStore( const char *file )
+{
+	return store.Open( file, cells, params );
+}
+
+
+// keep at most budget bytes of tiles that have left the window (0 for none):
+
+void
+TerrainTiles::SetCacheBudget( long long budget )
+{
+	cache.SetBudget( budget );
+}
+
+
+// fetch as far as tiles ahead of the window, in the direction it is moving (0 for none):
+
+void
+TerrainTiles::SetLookahead( int tiles )
+{
+	lookahead = tiles;
+}
+
+
+// ask for the tiles covering the window of terrain ( offsetX, offsetZ ) .. + windowSize, seen
+//	through modelView, and for the ones the window is heading into, drop the ones that are
+//	neither any more, and take what has come back:
+
+void
+TerrainTiles::Update( float offsetX, float offsetZ, float windowSize, glm::mat4 modelView )
+{
+	TRACE_ZONE( "TerrainTiles::Update" );
+
+	float tileSize = (float)cells * cellSize;
+	int cx0 = (int)floorf( offsetX / tileSize );
+	int cz0 = (int)floorf( offsetZ / tileSize );
+	int cx1 = (int)floorf( ( offsetX + windowSize ) / tileSize );
+	int cz1 = (int)floorf( ( offsetZ + windowSize ) / tileSize );
+
+	// where the eye is over the noise, and which way it looks along the ground:
+	glm::mat4 eyeToModel = glm::inverse( modelView );
+	glm::vec3 eye = glm::vec3( eyeToModel * glm::vec4( 0.f, 0.f, 0.f, 1.f ) ) + glm::vec3( offsetX, 0.f, offsetZ );
+	glm::vec3 forward = glm::vec3( eyeToModel * glm::vec4( 0.f, 0.f, -1.f, 0.f ) );
+
+	// the tiles the window is heading into, which wait behind everything in the window itself:
+	UpdateHeading( offsetX, offsetZ, windowSize );
+	std::set< std::pair<int,int> > ahead;
+	Ahead( offsetX, offsetZ, windowSize, &ahead );
+	float aheadPriority = TILE_PREFETCH_WINDOWS * windowSize;
+
+	// send on whatever didn't fit in the workers' queues (or the daemon's socket) last time, and hear
+	//	what has been stored:
+	pool.Flush( );
+	client.Flush( );
+	store.Poll( );
+
+	// count the tiles coming into the window that were already there for it, or on their way:
+	if( haveWindow )
+	{
+		for( int cz = cz0; cz <= cz1; cz++ )
+		{
+			for( int cx = cx0; cx <= cx1; cx++ )
+			{
+				if( cx >= windowX0  &&  cx <= windowX1  &&  cz >= windowZ0  &&  cz <= windowZ1 )
+					continue;
+
+				std::pair<int,int> key( cx, cz );
+				if( Have( key ) )
+					prefetchHits++;
+				else if( pending.count( key ) != 0 )
+					prefetchLate++;
+				else
+					prefetchMisses++;
+			}
+		}
+	}
+	windowX0 = cx0;
+	windowX1 = cx1;
+	windowZ0 = cz0;
+	windowZ1 = cz1;
+	haveWindow = true;
+
+	for( std::set< std::pair<int,int> >::iterator a = prefetched.begin( ); a != prefetched.end( ); )
+	{
+		int cx = a->first, cz = a->second;
+		if( cx >= cx0  &&  cx <= cx1  &&  cz >= cz0  &&  cz <= cz1 )
+			prefetched.erase( a++ );		// in the window now, so no longer a guess
+		else if( ahead.count( *a ) == 0 )
+		{
+			prefetchWasted++;			// the window turned away before it got there
+			prefetched.erase( a++ );
+		}
+		else
+			a++;
+	}
+
+	// cancel what is no longer wanted, or has turned up in the shared cache, and move up what
+	//	is wanted sooner now:
+	for( std::map< std::pair<int,int>, TileJob * >::iterator p = pending.begin( ); p != pending.end( ); )
+	{
+		int cx = p->first.first, cz = p->first.second;
+		bool inWindow = cx >= cx0  &&  cx <= cx1  &&  cz >= cz0  &&  cz <= cz1;
+		if( ! inWindow  &&  ahead.count( p->first ) == 0 )
+		{
+			if( client.IsConnected( ) )
+				client.Cancel( p->second );
+			else
+				pool.Cancel( p->second );
+			pending.erase( p++ );
+			continue;
+		}
+
+		// (another viewer may have made it since)
+		int slot = shared.IsOpen( ) ? shared.Acquire( cx, cz ) : -1;
+		if( slot >= 0 )
+		{
+			if( client.IsConnected( ) )
+				client.Cancel( p->second );
+			else
+				pool.Cancel( p->second );
+			fromShared[ p->first ] = slot;
+			pending.erase( p++ );
+			continue;
+		}
+
+		float now = Priority( cx, cz, eye, forward ) + ( inWindow ? 0.f : aheadPriority );
+		if( fabsf( now - p->second->asked ) > TILE_REPRIORITIZE_TILES * tileSize )
+		{
+			p->second->asked = now;
+			if( client.IsConnected( ) )
+				client.Reprioritize( p->second, now );
+			else
+				pool.Reprioritize( p->second, now );
+			reprioritized++;
+		}
+		p++;
+	}
+	for( std::map< std::pair<int,int>, std::vector<float> >::iterator t = tiles.begin( ); t != tiles.end( ); )
+	{
+		int cx = t->first.first, cz = t->first.second;
+		if( ( cx < cx0  ||  cx > cx1  ||  cz < cz0  ||  cz > cz1 )  &&  ahead.count( t->first ) == 0 )
+			Drop( t++ );
+		else
+			t++;
+	}
+	for( std::map< std::pair<int,int>, const float * >::iterator f = fromStore.begin( ); f != fromStore.end( ); )
+	{
+		int cx = f->first.first, cz = f->first.second;
+		if( ( cx < cx0  ||  cx > cx1  ||  cz < cz0  ||  cz > cz1 )  &&  ahead.count( f->first ) == 0 )
+			fromStore.erase( f++ );		// (they are still in the store)
+		else
+			f++;
+	}
+	for( std::map< std::pair<int,int>, int >::iterator f = fromShared.begin( ); f != fromShared.end( ); )
+	{
+		int cx = f->first.first, cz = f->first.second;
+		if( ( cx < cx0  ||  cx > cx1  ||  cz < cz0  ||  cz > cz1 )  &&  ahead.count( f->first ) == 0 )
+		{
+			shared.Release( f->second );		// (free to be written over, once no viewer is using it)
+			fromShared.erase( f++ );
+		}
+		else
+			f++;
+	}
+	for( std::map< std::pair<int,int>, std::pair<const float *, int> >::iterator f = fromService.begin( ); f != fromService.end( ); )
+	{
+		int cx = f->first.first, cz = f->first.second;
+		if( ( cx < cx0  ||  cx > cx1  ||  cz < cz0  ||  cz > cz1 )  &&  ahead.count( f->first ) == 0 )
+		{
+			// (into the cache, like the ones made here, and out of the mapping)
+			TileKey key = { cx, cz, params };
+			std::vector<float> heights( f->second.first, f->second.first + ( cells + 1 ) * ( cells + 1 ) );
+			cache.Put( key, &heights );
+			client.Release( f->second.second );
+			fromService.erase( f++ );
+		}
+		else
+			f++;
+	}
+
+	// ask for what is new:
+	std::vector<TileJob *> jobs;
+	for( int cz = cz0; cz <= cz1; cz++ )
+	{
+		for( int cx = cx0; cx <= cx1; cx++ )
+			Request( cx, cz, Priority( cx, cz, eye, forward ), &jobs );
+	}
+	for( std::set< std::pair<int,int> >::iterator a = ahead.begin( ); a != ahead.end( ); a++ )
+	{
+		if( Request( a->first, a->second, Priority( a->first, a->second, eye, forward ) + aheadPriority, &jobs ) )
+			prefetched.insert( *a );
+	}
+	requested += (long long)jobs.size( );
+	if( ! jobs.empty( )  &&  client.IsConnected( ) )
+		client.Submit( jobs );
+	else if( ! jobs.empty( ) )
+		pool.Submit( jobs );
+
+	Collect( collectLimit );
+}
+
+
+// the next job back from the daemon, or else the pool:
+// (the daemon's, after it has gone away, are the ones it never sent)
+
+TileJob *
+TerrainTiles::TakeDone( )
+{
+	TileJob *job = client.TakeDone( );
+	return job != NULL ? job : pool.TakeDone( );
+}
+
+
+// keep a short history of where the window has been, and from it which way it is going:
+// (heading stays put while the window stands still, so a pause doesn't throw away what was
+//	fetched ahead -- and a jump bigger than the window starts the history over)
+
+void
+TerrainTiles::UpdateHeading( float offsetX, float offsetZ, float windowSize )
+{
+	glm::vec2 offset( offsetX, offsetZ );
+	if( ! history.empty( )  &&  glm::length( offset - history.back( ) ) > windowSize )
+	{
+		history.clear( );
+		heading = glm::vec2( 0.f, 0.f );
+	}
+
+	history.push_back( offset );
+	if( (int)history.size( ) > TILE_HEADING_FRAMES )
+		history.pop_front( );
+
+	glm::vec2 moved = history.back( ) - history.front( );
+	if( glm::length( moved ) > 0.f )
+		heading = glm::normalize( moved );
+}
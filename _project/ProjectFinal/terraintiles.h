@@ -0,0 +1,158 @@
+#ifndef TERRAINTILES_H
+#define TERRAINTILES_H
+
+#include <stdio.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "tilecache.h"
+#include "tilepool.h"
+#include "tileservice.h"
+#include "tileshared.h"
+#include "tilestore.h"
+
+
+//********************************************************************************
+// the terrain's heights made on the cpu, a tile per chunk (see terrainchunks.h),
+//	for anything on the cpu that wants to know them
+//
+// Update( ) asks a TilePool for the tiles covering the window, nearest the eye first
+//	(and those in front of it before those behind), cancels the ones still being
+//	made that have scrolled out of the window, moves the rest up or down the line as
+//	the eye moves, and collects the ones that are done
+//
+// it also fetches the tiles the window is heading into, before they are needed: the heading
+//	comes from the last few frames' offsets, and the tiles swept over in the next
+//	SetLookahead( ) tiles along it are asked for behind everything in the window -- the hit
+//	rate says how many of the tiles coming into the window were already made
+//
+// tiles that are no longer wanted go into a TileCache rather than away, and a tile asked
+//	for again comes out of it instead of being made again -- as do tiles that finish
+//	after they were cancelled
+//
+// with OpenStore( ), every tile made is also written to a TileStore file, and a tile
+//	asked for is looked for there first -- one that is found is used straight out of the
+//	mapped file
+//
+// with OpenShared( ), every tile made is also published in a TileShared cache, for the
+//	other viewers on the machine, and a tile asked for is looked for there before
+//	anywhere else (and again each frame while it is being made here, in case another
+//	viewer got there first) -- one that is found is used straight out of the shared
+//	memory, and let go of once it leaves the window
+//
+// with ConnectService( ), the tiles are asked for from a tile service daemon instead of
+//	made here -- the same jobs go to a TileClient rather than the TilePool, and if the
+//	daemon goes away they come back unfinished and are asked for from the pool instead --
+//	tiles that come in a memfd are used straight out of the client's mapping of it, and
+//	let go of once they leave the window
+//
+// SetCollectLimit( ) caps how many made tiles Update( ) takes a frame -- whatever is left
+//	stays in the pool's done queue, and once that is full the workers wait
+//
+// all of this is called from the GL thread -- only the TilePool's workers run elsewhere
+//********************************************************************************
+
+
+// a tile behind the eye is treated as if it were this many times farther away:
+
+const float TILE_BEHIND_FACTOR = 4.f;
+
+
+// a tile still waiting to be made is moved in line when its priority changes by more than
+//	this many tiles' distance:
+
+const float TILE_REPRIORITIZE_TILES = 1.f;
+
+
+// how many frames of offsets the heading comes from, how many tiles ahead to fetch by default,
+//	and how many window sizes a tile fetched ahead waits behind the ones in the window:
+//	(more than any tile in the window can have, even behind the eye)
+
+const int   TILE_HEADING_FRAMES   = 8;
+const int   TILE_PREFETCH_TILES   = 2;
+const float TILE_PREFETCH_WINDOWS = 8.f;
+
+
+// how many bytes of tiles that have left the window to keep by default:
+
+const long long TILE_CACHE_BYTES = 4 * 1024 * 1024;
+
+
+class TerrainTiles
+{
+  private:
+	int		cells;
+	float		cellSize;
+	unsigned int	params;		// TileParamsHash( ) of the tiles made
+	TilePool	pool;
+	TileClient	client;
+	TileCache	cache;
+	TileStore	store;
+	TileShared	shared;
+
+	std::map< std::pair<int,int>, TileJob * >		pending;	// submitted, and not back yet
+	std::map< std::pair<int,int>, std::vector<float> >	tiles;		// done, and still in the window
+	std::map< std::pair<int,int>, const float * >		fromStore;	// found in the store, and still in the window
+	std::map< std::pair<int,int>, int >			fromShared;	// the shared slots being used, in the window
+	std::map< std::pair<int,int>, std::pair<const float *, int> >	fromService;	// in the client's mappings, in the window
+
+	long long	requested;
+	long long	received;
+	long long	reprioritized;
+	int		collectLimit;		// tiles to take a frame, or -1 for all there are
+
+	int				lookahead;	// tiles ahead to fetch
+	std::deque<glm::vec2>		history;	// the last few offsets
+	glm::vec2			heading;	// which way the window last moved, or 0 if it hasn't
+	bool				haveWindow;
+	int				windowX0, windowX1, windowZ0, windowZ1;	// the last Update( )'s tiles
+	std::set< std::pair<int,int> >	prefetched;	// asked for ahead, and not in the window yet
+	long long			prefetchHits, prefetchLate, prefetchMisses, prefetchWasted;
+
+	void		Ahead( float, float, float, std::set< std::pair<int,int> > * );
+	void		Collect( int );
+	void		Drop( std::map< std::pair<int,int>, std::vector<float> >::iterator );
+	bool		Have( std::pair<int,int> );
+	float		Priority( int, int, glm::vec3, glm::vec3 );
+	bool		Request( int, int, float, std::vector<TileJob *> * );
+	TileJob *	TakeDone( );
+	void		UpdateHeading( float, float, float );
+
+  public:
+	TerrainTiles( );
+	~TerrainTiles( );
+	void		CloseShared( );
+	bool		ConnectService( const char * );
+	void		Finish( );
+	unsigned int	GetChecksum( );
+	int		GetNumPending( );
+	int		GetNumTiles( );
+	unsigned int	GetParams( );
+	TileCache *	GetCache( );
+	TileClient *	GetClient( );
+	int		GetLookahead( );
+	TilePool *	GetPool( );
+	TileShared *	GetShared( );
+	TileStore *	GetStore( );
+	long long	GetPrefetchHits( );
+	long long	GetPrefetchLate( );
+	long long	GetPrefetchMisses( );
+	long long	GetPrefetchWasted( );
+	long long	GetReceived( );
+	long long	GetReprioritized( );
+	long long	GetRequested( );
+	const float *	GetTile( int, int );
+	void		Init( int, float, int );
+	bool		OpenShared( const char * );
+	bool		OpenStore( const char * );
+	void		SetCacheBudget( long long );
+	void		SetCollectLimit( int );
+	void		SetLookahead( int );
+	void		Update( float, float, float, glm::mat4 );
+};
+
+#endif	// TERRAINTILES_H
@@ -0,0 +1,201 @@
+#include <math.h>
+
+#include "tilecache.h"
+#include "tilecodec.h"
+#include "terrainnoise.h"
+
+
+TileCache::TileCache( )
+{
+	bytes = 0;
+	budgetBytes = 0;
+	rawBytes = 0;
+	packing = false;
+	hits = misses = evictions = 0;
+}
+
+
+long long
+TileCache::GetBudget( )
+{
+	return budgetBytes;
+}
+
+
+long long
+TileCache::GetBytes( )
+{
+	return bytes;
+}
+
+
+long long
+TileCache::GetEvictions( )
+{
+	return evictions;
+}
+
+
+long long
+TileCache::GetHits( )
+{
+	return hits;
+}
+
+
+long long
+TileCache::GetMisses( )
+{
+	return misses;
+}
+
+
+int
+TileCache::GetNumTiles( )
+{
+	return (int)tiles.size( );
+}
+
+
+// the bytes the tiles would take up if none were packed:
+
+long long
+TileCache::GetRawBytes( )
+{
+	return rawBytes;
+}
+
+
+bool
+TileCache::IsPacking( )
+{
+	return packing;
+}
+
+
+// keep *heights as tile key, leaving *heights empty:
+
+void
+TileCache::Put( TileKey key, std::vector<float> *heights )
+{
+	struct CachedTile tile;
+	tile.rawBytes = (long long)( heights->size( ) * sizeof(float) );
+	if( packing  &&  ! heights->empty( ) )
+	{
+		int width = (int)( sqrtf( (float)heights->size( ) ) + 0.5f );		// (the tiles are square)
+		TileEncode( heights->data( ), width, width, &tile.packed );
+	}
+	else
+		tile.heights.swap( *heights );
+	heights->clear( );
+
+	long long size = tile.Bytes( );
+	if( size > budgetBytes )
+		return;		// (it would only push everything else out, and then itself)
+
+	std::map<TileKey, struct CachedTile>::iterator t = tiles.find( key );
+	if( t != tiles.end( ) )
+	{
+		bytes -= t->second.Bytes( );
+		rawBytes -= t->second.rawBytes;
+		lru.erase( t->second.use );
+	}
+	else
+		t = tiles.insert( std::pair<TileKey, struct CachedTile>( key, CachedTile( ) ) ).first;
+
+	t->second.heights.swap( tile.heights );
+	t->second.packed.swap( tile.packed );
+	t->second.rawBytes = tile.rawBytes;
+	lru.push_front( key );
+	t->second.use = lru.begin( );
+	bytes += size;
+	rawBytes += tile.rawBytes;
+
+	Trim( );
+}
+
+
+// keep at most budget bytes of tiles (0 keeps none):
+
+void
+TileCache::SetBudget( long long budget )
+{
+	budgetBytes = budget;
+	Trim( );
+}
+
+
+// pack the tiles put in from now on, or not -- the ones already here stay the way they are:
+
+void
+TileCache::SetPacking( bool pack )
+{
+	packing = pack;
+}
+
+
+// move tile key into *heights, if it is here -- true if it was:
+
+bool
+TileCache::Take( TileKey key, std::vector<float> *heights )
+{
+	std::map<TileKey, struct CachedTile>::iterator t = tiles.find( key );
+	if( t == tiles.end( ) )
+	{
+		misses++;
+		return false;
+	}
+
+	bytes -= t->second.Bytes( );
+	rawBytes -= t->second.rawBytes;
+	if( ! t->second.packed.empty( ) )
+		TileDecode( t->second.packed.data( ), (int)t->second.packed.size( ), heights );
+	else
+		heights->swap( t->second.heights );
+	lru.erase( t->second.use );
+	tiles.erase( t );
+	hits++;
+	return true;
+}
+
+
+// evict the least recently used until the tiles fit the budget:
+
+void
+TileCache::Trim( )
+{
+	while( bytes > budgetBytes  &&  ! lru.empty( ) )
+	{
+		std::map<TileKey, struct CachedTile>::iterator t = tiles.find( lru.back( ) );
+		bytes -= t->second.Bytes( );
+		rawBytes -= t->second.rawBytes;
+		tiles.erase( t );
+		lru.pop_back( );
+		evictions++;
+	}
+}
+
+
+// add size bytes at data to hash:
+
+unsigned int
+Fnv1a( unsigned int hash, const void *data, size_t size )
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	for( size_t i = 0; i < size; i++ )
+		hash = ( hash ^ bytes[i] ) * 16777619u;
+	return hash;
+}
+
+
+// a hash of everything a tile's heights depend on besides where it is: the noise function and
+//	its parameters, and the grid's cells and cellSize:
+
+unsigned int
+TileParamsHash( int cells, float cellSize )
+{
+	float noise[5] = { (float)NOISE_VERSION, (float)NOISE_MAX_OCTAVES, NOISE_SCALE, NOISE_AMPLITUDE, NOISE_GAIN };
+	unsigned int hash = Fnv1a( FNV1A_BASIS, noise, sizeof(noise) );
+	hash = Fnv1a( hash, &cells, sizeof(cells) );
+	return Fnv1a( hash, &cellSize, sizeof(cellSize) );
+}
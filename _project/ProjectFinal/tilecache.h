@@ -0,0 +1,97 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <stdio.h>
+#include <list>
+#include <map>
+#include <vector>
+
+
+//********************************************************************************
+// the cpu tiles (see terraintiles.h) that have left the window, kept in case it comes
+//	back for them, until they take up more than a byte budget -- then the least
+//	recently used go first
+//
+// a tile is keyed by its chunk coordinates and a hash of everything its heights were
+//	made with, so a tile made with other noise parameters or another grid is never
+//	taken for it
+//
+// Take( ) moves a tile out of the cache and Put( ) moves one in, by swapping the
+//	vectors: a tile is either in the window's tiles or in here, never in both
+//
+// with SetPacking( true ), the tiles are kept packed (see tilecodec.h), so about twice
+//	as many fit the budget -- but a tile that comes back out is only within half a
+//	quantization step of the one made, so is no longer exactly the same whichever
+//	way the window went
+//********************************************************************************
+
+
+struct TileKey
+{
+	int		cx, cz;
+	unsigned int	params;		// see TileParamsHash( )
+
+	bool
+	operator<( const TileKey &other ) const
+	{
+		if( cx != other.cx )
+			return cx < other.cx;
+		if( cz != other.cz )
+			return cz < other.cz;
+		return params < other.params;
+	}
+};
+
+
+class TileCache
+{
+  private:
+	struct CachedTile
+	{
+		std::vector<float>		heights;
+		std::vector<unsigned char>	packed;		// instead of the heights, when packing
+		long long			rawBytes;	// what the heights take up
+		std::list<TileKey>::iterator	use;		// its place in lru
+
+		long long
+		Bytes( ) const
+		{
+			return (long long)( heights.size( ) * sizeof(float) + packed.size( ) );
+		}
+	};
+
+	std::map<TileKey, struct CachedTile>	tiles;
+	std::list<TileKey>			lru;		// most recently put in first
+	long long	bytes;
+	long long	budgetBytes;
+	long long	rawBytes;
+	bool		packing;
+	long long	hits, misses, evictions;
+
+	void		Trim( );
+
+  public:
+	TileCache( );
+	long long	GetBudget( );
+	long long	GetBytes( );
+	long long	GetEvictions( );
+	long long	GetHits( );
+	long long	GetMisses( );
+	int		GetNumTiles( );
+	long long	GetRawBytes( );
+	bool		IsPacking( );
+	void		Put( TileKey, std::vector<float> * );
+	void		SetBudget( long long );
+	void		SetPacking( bool );
+	bool		Take( TileKey, std::vector<float> * );
+};
+
+
+// FNV-1a, for hashing the tiles and what they were made with -- start from FNV1A_BASIS:
+
+const unsigned int FNV1A_BASIS = 2166136261u;
+
+unsigned int	Fnv1a( unsigned int, const void *, size_t );
+unsigned int	TileParamsHash( int, float );
+
+#endif	// TILECACHE_H
@@ -0,0 +1,436 @@
+#include <math.h>
+#include <string.h>
+
+#if defined( __SSE2__ )  ||  defined( _M_X64 )
+#include <emmintrin.h>
+#define TILE_CODEC_SSE2
+#endif
+
+#include "tilecodec.h"
+
+
+// the packed tile: this header, then each row's bit width in a byte, followed by its
+//	residuals, width bits each:
+
+struct CodecHeader
+{
+	unsigned short	width, height;
+	float		lowest;		// what a quantized 0 comes back as
+	float		step;		// and how much each 1 adds to it
+};
+
+
+// the residuals go in as 0, -1, 1, -2, 2, ... -> 0, 1, 2, 3, 4, ... so the small ones
+//	need few bits whichever way they go:
+
+static inline unsigned short
+ZigZag( unsigned short r )
+{
+	return (unsigned short)( ( r << 1 ) ^ ( (short)r >> 15 ) );
+}
+
+
+static inline unsigned short
+UnZigZag( unsigned short z )
+{
+	return (unsigned short)( ( z >> 1 ) ^ ( 0 - ( z & 1 ) ) );
+}
+
+
+// quantize the width x height heights, x changing fastest, and pack them into *packed:
+
+void
+TileEncode( const float *heights, int width, int height, std::vector<unsigned char> *packed )
+{
+	int n = width * height;
+	float lowest = heights[0];
+	float highest = heights[0];
+	for( int k = 1; k < n; k++ )
+	{
+		if( heights[k] < lowest )
+			lowest = heights[k];
+		if( heights[k] > highest )
+			highest = heights[k];
+	}
+
+	struct CodecHeader header;
+	header.width = (unsigned short)width;
+	header.height = (unsigned short)height;
+	header.lowest = lowest;
+	header.step = ( highest - lowest ) / 65535.f;
+
+	packed->resize( sizeof(header) );
+	memcpy( packed->data( ), &header, sizeof(header) );
+
+	std::vector<unsigned short> above( width, 0 );
+	std::vector<unsigned short> row( width );
+	std::vector<unsigned short> residuals( width );
+	for( int j = 0; j < height; j++ )
+	{
+		unsigned short biggest = 0;
+		for( int i = 0; i < width; i++ )
+		{
+			float q = header.step > 0.f ? floorf( ( heights[ j * width + i ] - lowest ) / header.step + 0.5f ) : 0.f;
+			row[i] = (unsigned short)( q < 0.f ? 0.f : q > 65535.f ? 65535.f : q );
+
+			unsigned short predicted = (unsigned short)( above[i] + ( i > 0 ? row[i-1] - above[i-1] : 0 ) );
+			residuals[i] = ZigZag( (unsigned short)( row[i] - predicted ) );
+			if( residuals[i] > biggest )
+				biggest = residuals[i];
+		}
+
+		int bits = 0;
+		while( bits < 16  &&  ( biggest >> bits ) != 0 )
+			bits++;
+
+		size_t start = packed->size( );
+		packed->resize( start + 1 + ( width * bits + 7 ) / 8, 0 );
+		unsigned char *out = packed->data( ) + start;
+		*out++ = (unsigned char)bits;
+		for( int i = 0; i < width; i++ )
+		{
+			int bit = i * bits;
+			unsigned int value = (unsigned int)residuals[i] << ( bit & 7 );
+			for( int b = bit >> 3; value != 0; b++, value >>= 8 )
+				out[b] |= (unsigned char)value;
+		}
+
+		above.swap( row );
+	}
+}
+
+
+// check the header of the size packed bytes, and make room for the heights:
+
+static bool
+StartDecode( const unsigned char *packed, int size, struct CodecHeader *header, std::vector<float> *heights )
+{
+	if( size < (int)sizeof(*header) )
+		return false;
+	memcpy( header, packed, sizeof(*header) );
+	heights->resize( (size_t)header->width * header->height );
+	return true;
+}
+
+
+// the bits of a row, or false if the row runs past the end:
+
+static bool
+RowBits( const unsigned char *packed, int size, int at, int width, int *bits )
+{
+	if( at >= size )
+		return false;
+	*bits = packed[at];
+	return *bits <= 16  &&  at + 1 + ( width * *bits + 7 ) / 8 <= size;
+}
+
+
+// one byte at a time, with no SSE2 -- what TileDecode( ) has to match:
+
+bool
+TileDecodeScalar( const unsigned char *packed, int size, std::vector<float> *heights )
+{
+	struct CodecHeader header;
+	if( ! StartDecode( packed, size, &header, heights ) )
+		return false;
+
+	int width = header.width;
+	std::vector<unsigned short> row( width, 0 );
+	int at = sizeof(header);
+	for( int j = 0; j < header.height; j++ )
+	{
+		int bits;
+		if( ! RowBits( packed, size, at, width, &bits ) )
+			return false;
+		const unsigned char *in = packed + at + 1;
+
+		unsigned short change = 0;		// from the row above, so far along this one
+		for( int i = 0; i < width; i++ )
+		{
+			int bit = i * bits;
+			unsigned int value = 0;
+			for( int b = 0; b * 8 < ( bit & 7 ) + bits; b++ )
+				value |= (unsigned int)in[ ( bit >> 3 ) + b ] << ( 8 * b );
+			unsigned short z = (unsigned short)( ( value >> ( bit & 7 ) ) & ( ( 1u << bits ) - 1 ) );
+
+			change = (unsigned short)( change + UnZigZag( z ) );
+			row[i] = (unsigned short)( row[i] + change );
+			(*heights)[ j * width + i ] = header.lowest + (float)row[i] * header.step;
+		}
+		at += 1 + ( width * bits + 7 ) / 8;
+	}
+	return true;
+}
+
+
+// unpack the size packed bytes into *heights -- false if they aren't a whole packed tile:
+
+bool
+TileDecode( const unsigned char *packed, int size, std::vector<float> *heights )
+{
+#ifndef TILE_CODEC_SSE2
+	return TileDecodeScalar( packed, size, heights );
+#else
+	struct CodecHeader header;
+	if( ! StartDecode( packed, size, &header, heights ) )
+		return false;
+
+	int width = header.width;
+	int padded = ( width + 7 ) & ~7;
+	static thread_local std::vector<unsigned short> row, z;		// (so a small tile isn't mostly allocating these)
+	row.assign( padded, 0 );
+	z.assign( padded, 0 );
+	float *out = heights->data( );
+	const __m128i zero = _mm_setzero_si128( );
+	const __m128i one = _mm_set1_epi16( 1 );
+	const __m128 lowest = _mm_set1_ps( header.lowest );
+	const __m128 step = _mm_set1_ps( header.step );
+
+	int at = sizeof(header);
+	for( int j = 0; j < header.height; j++, out += width )
+	{
+		int bits;
+		if( ! RowBits( packed, size, at, width, &bits ) )
+			return false;
+		const unsigned char *in = packed + at + 1;
+		int rowBytes = ( width * bits + 7 ) / 8;
+		at += 1 + rowBytes;
+
+		// unpack the residuals, 4 bytes at a time for as long as there are 4 bytes left in the tile:
+		// (x86 is little-endian, so those are the bytes in the order they were packed)
+		unsigned int mask = ( 1u << bits ) - 1;
+		int loadable = width;
+		while( loadable > 0  &&  in + ( ( ( loadable - 1 ) * bits ) >> 3 ) + 4 > packed + size )
+			loadable--;
+
+		int i = 0;
+		for( int bit = 0; i < loadable; i++, bit += bits )
+		{
+			unsigned int value;
+			memcpy( &value, in + ( bit >> 3 ), 4 );
+			z[i] = (unsigned short)( ( value >> ( bit & 7 ) ) & mask );
+		}
+		for( ; i < width; i++ )
+		{
+			int bit = i * bits;
+			unsigned int value = 0;
+			for( int b = bit >> 3; b < rowBytes; b++ )
+				value |= (unsigned int)in[b] << ( 8 * ( b - ( bit >> 3 ) ) );
+			z[i] = (unsigned short)( ( value >> ( bit & 7 ) ) & mask );
+		}
+
+		// add up the changes from the row above along the row, 8 at a time -- each 8 added up
+		//	in 3 shifts, plus the total so far:
+		__m128i change = zero;
+		for( i = 0; i < padded; i += 8 )
+		{
+			__m128i zz = _mm_loadu_si128( (const __m128i *)&z[i] );
+			__m128i r = _mm_xor_si128( _mm_srli_epi16( zz, 1 ), _mm_sub_epi16( zero, _mm_and_si128( zz, one ) ) );
+			r = _mm_add_epi16( r, _mm_slli_si128( r, 2 ) );
+			r = _mm_add_epi16( r, _mm_slli_si128( r, 4 ) );
+			r = _mm_add_epi16( r, _mm_slli_si128( r, 8 ) );
+			r = _mm_add_epi16( r, change );
+			change = _mm_shufflehi_epi16( r, 0xff );
+			change = _mm_unpackhi_epi64( change, change );		// (the last one, in all 8)
+
+			__m128i q = _mm_add_epi16( _mm_loadu_si128( (const __m128i *)&row[i] ), r );
+			_mm_storeu_si128( (__m128i *)&row[i], q );
+			if( i + 8 > width )
+				break;		// (the rest of the row is done one at a time below)
+
+			__m128 lo = _mm_cvtepi32_ps( _mm_unpacklo_epi16( q, zero ) );
+			__m128 hi = _mm_cvtepi32_ps( _mm_unpackhi_epi16( q, zero ) );
+			_mm_storeu_ps( out + i,     _mm_add_ps( lowest, _mm_mul_ps( lo, step ) ) );
+			_mm_storeu_ps( out + i + 4, _mm_add_ps( lowest, _mm_mul_ps( hi, step ) ) );
+		}
+		for( ; i < width; i++ )
+			out[i] = header.lowest + (float)row[i] * header.step;
+	}
+	return true;
+#endif
+}
+
+
+#ifdef HEADLESS
+
+// the timings for the headless benchmark's --codec-test:
+
+#include <algorithm>
+#include <chrono>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include "terrainnoise.h"
+
+
+// the least time each thing is timed for:
+
+const double CODEC_BENCH_SECONDS = 0.5;
+
+
+static double
+NowSeconds( )
+{
+	return std::chrono::duration<double>( std::chrono::steady_clock::now( ).time_since_epoch( ) ).count( );
+}
+
+
+// decode all the packed tiles over and over for at least CODEC_BENCH_SECONDS -- the heights made a second:
+
+static double
+TimeDecode( bool (*decode)( const unsigned char *, int, std::vector<float> * ), std::vector< std::vector<unsigned char> > &packed )
+{
+	std::vector<float> heights;
+	long long decoded = 0;
+	double start = NowSeconds( );
+	double seconds;
+	do
+	{
+		for( size_t t = 0; t < packed.size( ); t++ )
+		{
+			decode( packed[t].data( ), (int)packed[t].size( ), &heights );
+			decoded += (long long)heights.size( );
+		}
+		seconds = NowSeconds( ) - start;
+	} while( seconds < CODEC_BENCH_SECONDS );
+	return (double)decoded / seconds;
+}
+
+
+#ifndef WIN32
+
+// write size bytes to a file, push them out to the disk and out of the page cache, and time
+//	reading them back -- first from the disk, then again from the page cache -- in bytes a second:
+// (false if there is nowhere to write them)
+
+static bool
+TimeRead( const unsigned char *bytes, size_t size, double *fromDisk, double *fromCache )
+{
+	char file[] = "/tmp/tilecodecXXXXXX";
+	int fd = mkstemp( file );
+	if( fd < 0 )
+		return false;
+	unlink( file );
+
+	bool ok = write( fd, bytes, size ) == (ssize_t)size  &&  fsync( fd ) == 0;
+	std::vector<unsigned char> in( size );
+	for( int pass = 0; ok  &&  pass < 2; pass++ )
+	{
+#ifdef POSIX_FADV_DONTNEED
+		if( pass == 0 )
+			posix_fadvise( fd, 0, size, POSIX_FADV_DONTNEED );
+#endif
+		double start = NowSeconds( );
+		ok = pread( fd, in.data( ), size, 0 ) == (ssize_t)size;
+		double seconds = NowSeconds( ) - start;
+		*( pass == 0 ? fromDisk : fromCache ) = (double)size / seconds;
+	}
+	close( fd );
+	return ok;
+}
+
+#endif
+
+
+// pack numTiles tiles of ( cells + 1 ) x ( cells + 1 ) heights, made with the standard noise,
+//	and report how small they got, how far off they came back, and how fast they unpack,
+//	against reading the raw floats:
+
+void
+TileCodecBenchmark( int cells, float cellSize, int numTiles )
+{
+	int n = cells + 1;
+	int across = std::max( (int)sqrtf( (float)numTiles ), 1 );
+	numTiles = across * across;
+
+	std::vector<float> raw( (size_t)numTiles * n * n );
+	for( int t = 0; t < numTiles; t++ )
+	{
+		float *tile = &raw[ (size_t)t * n * n ];
+		for( int j = 0; j < n; j++ )
+		{
+			float z = (float)( ( t / across ) * cells + j ) * cellSize;
+			for( int i = 0; i < n; i++ )
+			{
+				float x = (float)( ( t % across ) * cells + i ) * cellSize;
+				float heights[NOISE_MAX_OCTAVES];
+				NoiseHeights( x, z, heights );
+				tile[ j * n + i ] = heights[NOISE_MAX_OCTAVES-1];
+			}
+		}
+	}
+
+	std::vector< std::vector<unsigned char> > packed( numTiles );
+	size_t packedBytes = 0;
+	for( int t = 0; t < numTiles; t++ )
+	{
+		TileEncode( &raw[ (size_t)t * n * n ], n, n, &packed[t] );
+		packedBytes += packed[t].size( );
+	}
+	size_t rawBytes = raw.size( ) * sizeof(float);
+
+	// the fast decode has to come out exactly like the scalar one, and within half a step of the heights:
+	double worst = 0.;
+	double worstSteps = 0.;
+	bool same = true;
+	std::vector<float> fast, scalar;
+	for( int t = 0; t < numTiles; t++ )
+	{
+		const float *tile = &raw[ (size_t)t * n * n ];
+		bool ok = TileDecode( packed[t].data( ), (int)packed[t].size( ), &fast );
+		ok = ok  &&  TileDecodeScalar( packed[t].data( ), (int)packed[t].size( ), &scalar );
+		same = same  &&  ok  &&  fast == scalar;
+
+		struct CodecHeader header;
+		memcpy( &header, packed[t].data( ), sizeof(header) );
+		for( int k = 0; ok  &&  k < n * n; k++ )
+		{
+			double error = fabs( (double)fast[k] - (double)tile[k] );
+			worst = std::max( worst, error );
+			if( header.step > 0.f )
+				worstSteps = std::max( worstSteps, error / header.step );
+		}
+	}
+
+	fprintf( stderr, "Tile codec: %d tiles of %dx%d heights, %.1f MB raw, %.1f MB packed -- %.2f:1, %.2f bits a height\n",
+		numTiles, n, n, (double)rawBytes / 1.e6, (double)packedBytes / 1.e6, (double)rawBytes / (double)packedBytes,
+		8. * (double)packedBytes / (double)raw.size( ) );
+	fprintf( stderr, "  worst error %.6f (%.3f of a step)%s\n", worst, worstSteps,
+		same ? "" : " -- THE SSE2 AND SCALAR DECODES DISAGREE" );
+
+	double fastRate = TimeDecode( TileDecode, packed ) * sizeof(float);
+	double scalarRate = TimeDecode( TileDecodeScalar, packed ) * sizeof(float);
+#ifdef TILE_CODEC_SSE2
+	fprintf( stderr, "  decode %8.2f GB/s of floats (sse2), %8.2f GB/s (scalar)\n", fastRate / 1.e9, scalarRate / 1.e9 );
+#else
+	fprintf( stderr, "  decode %8.2f GB/s of floats (no sse2), %8.2f GB/s (scalar)\n", fastRate / 1.e9, scalarRate / 1.e9 );
+#endif
+
+#ifndef WIN32
+	double diskRate, cacheRate;
+	if( TimeRead( (const unsigned char *)raw.data( ), rawBytes, &diskRate, &cacheRate ) )
+	{
+		fprintf( stderr, "  reading the raw floats %8.2f GB/s from the disk, %8.2f GB/s from the page cache\n",
+			diskRate / 1.e9, cacheRate / 1.e9 );
+
+		// the packed tiles in one file, so they are read the way the raw ones were:
+		std::vector<unsigned char> all;
+		for( int t = 0; t < numTiles; t++ )
+			all.insert( all.end( ), packed[t].begin( ), packed[t].end( ) );
+		double packedDiskRate, packedCacheRate;
+		if( TimeRead( all.data( ), all.size( ), &packedDiskRate, &packedCacheRate ) )
+		{
+			// (heights a second, reading the packed bytes and then decoding them)
+			double diskSeconds = (double)all.size( ) / packedDiskRate + (double)rawBytes / fastRate;
+			fprintf( stderr, "  reading the packed tiles and decoding them %8.2f GB/s of floats from the disk\n",
+				(double)rawBytes / diskSeconds / 1.e9 );
+		}
+	}
+#endif
+}
+
+#endif	// HEADLESS
@@ -0,0 +1,37 @@
+#ifndef TILECODEC_H
+#define TILECODEC_H
+
+#include <stdio.h>
+#include <vector>
+
+
+//********************************************************************************
+// packs a tile of heights (see terraintiles.h) into a few bits a height, and back
+//
+// each tile is quantized to 16 bits between its own lowest and highest heights; each
+//	row is predicted from the row before it, plus how much the height to the left
+//	changed from the row before (so the first row is predicted along itself), so what
+//	is left is mostly small; and each row's residuals are packed with just as many bits
+//	as its biggest one needs
+//
+// the residuals are worked out mod 2^16, so no row ever needs more than 16 bits, and
+//	the rows start on byte boundaries
+//
+// it is lossy: a height comes back within half a quantization step, ( highest - lowest )
+//	/ 65535 / 2, of where it was (give or take the float rounding)
+//
+// TileDecode( ) unpacks a row's bits, then adds it up and turns it back into floats 8 at
+//	a time with SSE2, where there is SSE2 -- TileDecodeScalar( ) does it all one at a
+//	time, and comes out exactly the same
+//********************************************************************************
+
+
+void	TileEncode( const float *, int, int, std::vector<unsigned char> * );
+bool	TileDecode( const unsigned char *, int, std::vector<float> * );
+bool	TileDecodeScalar( const unsigned char *, int, std::vector<float> * );
+
+#ifdef HEADLESS
+void	TileCodecBenchmark( int, float, int );
+#endif
+
+#endif	// TILECODEC_H
@@ -0,0 +1,473 @@
+#include <algorithm>
+#include <chrono>
+
+#include "tilepool.h"
+
+
+TilePool::TilePool( )
+{
+	cells = 0;
+	cellSize = 0.f;
+	nextWorker = 0;
+	sleepers = 0;
+	queued = 0;
+	stopping = false;
+	generated = cancelled = stolen = 0;
+	busyMicroseconds = stalledMicroseconds = 0;
+	done.Init( TILE_DONE_CAPACITY );
+}
+
+
+TilePool::~TilePool( )
+{
+	Stop( );
+}
+
+
+// ask for job to be dropped -- it comes back through TakeDone( ) either way:
+
+void
+TilePool::Cancel( TileJob *job )
+{
+	job->cancelled = true;
+	if( job->worker >= 0 )
+		Send( job->worker, TILE_CANCEL, job, 0.f );
+}
+
+
+// hand a job that is done with back to the GL thread, waiting while the done queue is full:
+
+void
+TilePool::Deliver( TileJob *job )
+{
+	if( workers.empty( ) )
+	{
+		leftovers.push_back( job );		// (on the GL thread itself)
+		return;
+	}
+
+	if( done.Push( job ) )
+		return;
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now( );
+	while( ! done.Push( job ) )
+	{
+		if( stopping )
+		{
+			std::lock_guard<std::mutex> guard( leftoverLock );
+			leftovers.push_back( job );
+			break;
+		}
+		std::this_thread::sleep_for( std::chrono::microseconds( TILE_STALL_MICROSECONDS ) );
+	}
+	stalledMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::high_resolution_clock::now( ) - start ).count( );
+}
+
+
+// worker w acts on the messages the GL thread has sent it:
+
+void
+TilePool::Drain( int w )
+{
+	TileWorker *worker = workers[w];
+	if( worker->inbox.Size( ) == 0 )
+		return;
+
+	std::vector<TileJob *> dropped;
+	int added = 0;
+	{
+		std::lock_guard<std::mutex> guard( worker->lock );
+		struct TileMessage m;
+		while( worker->inbox.Pop( &m ) )
+		{
+			if( m.type != TILE_SUBMIT )
+			{
+				// (if it isn't here, it is being made or is done already)
+				std::deque<TileJob *>::iterator at = std::find( worker->jobs.begin( ), worker->jobs.end( ), m.job );
+				if( at == worker->jobs.end( ) )
+					continue;
+				worker->jobs.erase( at );
+				queued--;
+
+				if( m.type == TILE_CANCEL )
+				{
+					dropped.push_back( m.job );
+					continue;
+				}
+				m.job->priority = m.priority;
+			}
+
+			std::deque<TileJob *>::iterator at = std::upper_bound( worker->jobs.begin( ), worker->jobs.end( ), m.job,
+				[]( TileJob *a, TileJob *b ) { return a->priority < b->priority; } );
+			worker->jobs.insert( at, m.job );
+			queued++;
+			added++;
+		}
+	}
+
+	// (the other workers may be asleep with nothing to steal)
+	if( added > 0 )
+		Wake( );
+
+	for( int i = 0; i < (int)dropped.size( ); i++ )
+	{
+		dropped[i]->finished = false;
+		cancelled++;
+		Deliver( dropped[i] );
+	}
+}
+
+
+// send the messages that didn't fit in the workers' queues before, as far as they fit now:
+// (the GL thread should call this every so often, or those messages never get there)
+
+void
+TilePool::Flush( )
+{
+	bool sent = false;
+	for( int w = 0; w < (int)workers.size( ); w++ )
+	{
+		TileWorker *worker = workers[w];
+		while( ! worker->outbox.empty( )  &&  worker->inbox.Push( worker->outbox.front( ) ) )
+		{
+			worker->outbox.pop_front( );
+			sent = true;
+		}
+	}
+	if( sent )
+		Wake( );
+}
+
+
+// fill in job's heights, unless it gets cancelled first -- worker w is making it (-1 for none):
+
+void
+TilePool::Generate( TileJob *job, int w )
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now( );
+
+	int n = cells + 1;
+	job->heights.resize( n * n );
+	job->finished = false;
+	for( int j = 0; j < n; j++ )
+	{
+		if( job->cancelled )
+			break;
+		if( w >= 0 )
+			Drain( w );
+
+		float z = (float)( job->cz * cells + j ) * cellSize;
+		for( int i = 0; i < n; i++ )
+		{
+			float x = (float)( job->cx * cells + i ) * cellSize;
+			float heights[NOISE_MAX_OCTAVES];
+			NoiseHeights( x, z, heights );
+			job->heights[ j * n + i ] = heights[NOISE_MAX_OCTAVES-1];
+		}
+	}
+
+	if( job->cancelled )
+	{
+		job->heights.clear( );
+		cancelled++;
+	}
+	else
+	{
+		job->finished = true;
+		generated++;
+	}
+
+	busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::high_resolution_clock::now( ) - start ).count( );
+
+	Deliver( job );
+}
+
+
+long long
+TilePool::GetBusyMicroseconds( )
+{
+	return busyMicroseconds;
+}
+
+
+long long
+TilePool::GetCancelled( )
+{
+	return cancelled;
+}
+
+
+long long
+TilePool::GetGenerated( )
+{
+	return generated;
+}
+
+
+// made tiles waiting for the GL thread to take them:
+
+int
+TilePool::GetNumDone( )
+{
+	return done.Size( ) + (int)leftovers.size( );
+}
+
+
+// messages waiting for room in a worker's queue:
+
+int
+TilePool::GetNumUnsent( )
+{
+	int n = 0;
+	for( int w = 0; w < (int)workers.size( ); w++ )
+		n += (int)workers[w]->outbox.size( );
+	return n;
+}
+
+
+int
+TilePool::GetNumWorkers( )
+{
+	return (int)workers.size( );
+}
+
+
+// how long the workers have spent waiting for room in the done queue:
+
+long long
+TilePool::GetStalledMicroseconds( )
+{
+	return stalledMicroseconds;
+}
+
+
+long long
+TilePool::GetStolen( )
+{
+	return stolen;
+}
+
+
+// ask for job to be moved to priority in line (if it hasn't been started yet):
+
+void
+TilePool::Reprioritize( TileJob *job, float priority )
+{
+	if( job->worker >= 0 )
+		Send( job->worker, TILE_REPRIORITIZE, job, priority );
+}
+
+
+// worker w's loop: take jobs until Stop( ), sleeping while there are none anywhere,
+//	and holding off while the done queue is full
+
+void
+TilePool::Run( int w )
+{
+	TileWorker *worker = workers[w];
+	while( ! stopping )
+	{
+		Drain( w );
+
+		if( done.Size( ) >= done.GetCapacity( ) )
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now( );
+			std::this_thread::sleep_for( std::chrono::microseconds( TILE_STALL_MICROSECONDS ) );
+			stalledMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::high_resolution_clock::now( ) - start ).count( );
+			continue;
+		}
+
+		TileJob *job = Take( w );
+		if( job != NULL )
+		{
+			Generate( job, w );
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard( sleepLock );
+		sleepers++;
+		wake.wait( guard, [this, worker]( )
+		{
+			// (pairs with the fence in Wake( ): either this sees the new work, or Wake( ) sees the sleeper)
+			std::atomic_thread_fence( std::memory_order_seq_cst );
+			return stopping  ||  queued > 0  ||  worker->inbox.Size( ) > 0;
+		} );
+		sleepers--;
+	}
+}
+
+
+// the GL thread sends worker w a message -- never waits, since what doesn't fit waits in the outbox:
+
+void
+TilePool::Send( int w, int type, TileJob *job, float priority )
+{
+	struct TileMessage m;
+	m.type = type;
+	m.job = job;
+	m.priority = priority;
+
+	// (in order behind anything already waiting)
+	TileWorker *worker = workers[w];
+	if( ! worker->outbox.empty( )  ||  ! worker->inbox.Push( m ) )
+		worker->outbox.push_back( m );
+	Wake( );
+}
+
+
+// the next job for worker w: the front of its own deque, or else the front of someone else's:
+// (returns NULL if every deque is empty)
+
+TileJob *
+TilePool::Take( int w )
+{
+	int n = (int)workers.size( );
+	for( int k = 0; k < n; k++ )
+	{
+		TileWorker *victim = workers[ ( w + k ) % n ];
+		std::lock_guard<std::mutex> guard( victim->lock );
+		if( victim->jobs.empty( ) )
+			continue;
+
+		TileJob *job = victim->jobs.front( );
+		victim->jobs.pop_front( );
+		queued--;
+		if( k != 0 )
+			stolen++;
+		return job;
+	}
+	return NULL;
+}
+
+
+// start numWorkers threads making tiles of cells x cells, cellSize apart:
+// (with no workers, Submit( ) makes the tiles itself, on the calling thread)
+
+bool
+TilePool::Start( int numWorkers, int _cells, float _cellSize )
+{
+	Stop( );
+
+	cells = _cells;
+	cellSize = _cellSize;
+	stopping = false;
+	for( int w = 0; w < numWorkers; w++ )
+	{
+		workers.push_back( new TileWorker );
+		workers[w]->inbox.Init( TILE_INBOX_CAPACITY );
+	}
+	for( int w = 0; w < numWorkers; w++ )
+		workers[w]->thread = std::thread( &TilePool::Run, this, w );
+	return true;
+}
+
+
+// stop the workers, once they finish what they are in the middle of:
+// (jobs still queued, or not even sent yet, come back through TakeDone( ) as cancelled)
+
+void
+TilePool::Stop( )
+{
+	{
+		std::lock_guard<std::mutex> guard( sleepLock );
+		stopping = true;
+	}
+	wake.notify_all( );
+
+	for( int w = 0; w < (int)workers.size( ); w++ )
+	{
+		if( workers[w]->thread.joinable( ) )
+			workers[w]->thread.join( );
+	}
+
+	// (the workers are gone, so this thread can be the one popping their queues)
+	for( int w = 0; w < (int)workers.size( ); w++ )
+	{
+		TileWorker *worker = workers[w];
+		std::vector<TileJob *> dropped( worker->jobs.begin( ), worker->jobs.end( ) );
+		struct TileMessage m;
+		while( worker->inbox.Pop( &m ) )
+		{
+			if( m.type == TILE_SUBMIT )
+				dropped.push_back( m.job );
+		}
+		for( int i = 0; i < (int)worker->outbox.size( ); i++ )
+		{
+			if( worker->outbox[i].type == TILE_SUBMIT )
+				dropped.push_back( worker->outbox[i].job );
+		}
+
+		for( int i = 0; i < (int)dropped.size( ); i++ )
+		{
+			dropped[i]->cancelled = true;
+			dropped[i]->finished = false;
+			leftovers.push_back( dropped[i] );
+		}
+		delete worker;
+	}
+	workers.clear( );
+	queued = 0;
+}
+
+
+// queue up jobs, most urgent (lowest priority) first:
+//	they are dealt out round robin, so every worker gets some of the urgent ones
+
+void
+TilePool::Submit( std::vector<TileJob *> &jobs )
+{
+	std::sort( jobs.begin( ), jobs.end( ), []( TileJob *a, TileJob *b ) { return a->priority < b->priority; } );
+
+	if( workers.empty( ) )
+	{
+		for( int i = 0; i < (int)jobs.size( ); i++ )
+		{
+			jobs[i]->worker = -1;
+			Generate( jobs[i], -1 );
+		}
+		return;
+	}
+
+	Flush( );
+	for( int i = 0; i < (int)jobs.size( ); i++ )
+	{
+		jobs[i]->worker = nextWorker;
+		Send( nextWorker, TILE_SUBMIT, jobs[i], jobs[i]->priority );
+		nextWorker = ( nextWorker + 1 ) % (int)workers.size( );
+	}
+}
+
+
+// the next job that has come back, finished or cancelled, or NULL if there are none right now:
+// (leftovers is only added to with no workers, or while stopping -- never while this can be called)
+
+TileJob *
+TilePool::TakeDone( )
+{
+	TileJob *job;
+	if( done.Pop( &job ) )
+		return job;
+
+	if( leftovers.empty( ) )
+		return NULL;
+	job = leftovers.back( );
+	leftovers.pop_back( );
+	return job;
+}
+
+
+// let the sleeping workers know there is something new for them:
+
+void
+TilePool::Wake( )
+{
+	// (pairs with the fence in Run( )'s wait)
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( sleepers == 0 )
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard( sleepLock );
+	}
+	wake.notify_all( );
+}
@@ -0,0 +1,143 @@
+#ifndef TILEPOOL_H
+#define TILEPOOL_H
+
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "terrainnoise.h"
+#include "tilequeue.h"
+
+
+//********************************************************************************
+// a pool of worker threads that fill in tiles of terrain heights on the cpu
+//
+// each worker has its own deque of jobs, kept in priority order: a worker takes
+//	the most urgent job from its own deque, and when that is empty it steals the most
+//	urgent one from another worker's (the deques are each locked, so there is no
+//	contention reason to steal from the far end -- and the near end is what the
+//	camera needs first)
+//
+// a tile's heights depend only on which tile it is, never on which worker or how many
+//	there are, so the output is the same bit for bit with any number of threads
+//
+// jobs can be cancelled at any time: a queued job is never started, and a running
+//	one stops at the next row -- either way it still comes back through TakeDone( ),
+//	marked cancelled, so whoever made it can delete it
+//
+// the GL thread never takes a lock the workers hold: it sends each worker its jobs, and
+//	asks for them to be cancelled or reprioritized, through that worker's SpscQueue
+//	(see tilequeue.h), and gets them back through one MpscQueue all the workers push
+//	into -- the workers look at their messages between jobs, and between rows of a job
+//
+// both kinds of queue are bounded, and the backpressure goes back up the pipe: when the
+//	GL thread stops taking tiles (the uploads have fallen behind), the done queue fills,
+//	and the workers stop making more until there is room -- the jobs they haven't got to
+//	yet can still be cancelled for nothing meanwhile; and when a worker's messages fill
+//	its queue, the rest wait on the GL thread until Flush( ) finds room
+//********************************************************************************
+
+
+// what the GL thread can ask of a worker:
+
+const int TILE_SUBMIT       = 0;	// make the job
+const int TILE_CANCEL       = 1;	// drop the job if it hasn't been started (its cancelled flag stops it if it has)
+const int TILE_REPRIORITIZE = 2;	// move the job to a new place in line
+
+
+// how many messages a worker's queue holds, and how many made tiles the done queue holds:
+
+const int TILE_INBOX_CAPACITY = 64;
+const int TILE_DONE_CAPACITY  = 64;
+
+
+// how long a worker naps while the done queue is full:
+
+const int TILE_STALL_MICROSECONDS = 200;
+
+
+// one tile of heights to fill in:
+
+struct TileJob
+{
+	int			cx, cz;		// which tile: it starts at grid point ( cx, cz ) * cells
+	float			priority;	// lower goes first -- the pool's, once the job is submitted
+	float			asked;		// the priority last asked for -- the submitter's
+	int			worker;		// whose queue Submit( ) dealt it to (-1 with no workers)
+	std::atomic<bool>	cancelled;
+	bool			finished;	// set by the worker, once heights is filled in
+	std::vector<float>	heights;	// ( cells + 1 ) x ( cells + 1 ), x changing fastest
+};
+
+
+struct TileMessage
+{
+	int		type;		// TILE_SUBMIT, TILE_CANCEL, or TILE_REPRIORITIZE
+	TileJob *	job;
+	float		priority;	// for TILE_REPRIORITIZE
+};
+
+
+class TilePool
+{
+  private:
+	struct TileWorker
+	{
+		std::mutex			lock;		// only ever contended by other workers, stealing
+		std::deque<TileJob *>		jobs;
+		std::thread			thread;
+		SpscQueue<struct TileMessage>	inbox;		// from the GL thread
+		std::deque<struct TileMessage>	outbox;		// the GL thread's, until there is room in the inbox
+	};
+
+	int				cells;
+	float				cellSize;
+	std::vector<TileWorker *>	workers;
+	int				nextWorker;		// the next one Submit( ) deals a job to
+
+	std::mutex			sleepLock;		// idle workers wait on wake
+	std::condition_variable		wake;
+	std::atomic<int>		sleepers;
+	std::atomic<int>		queued;			// jobs in all the deques
+	std::atomic<bool>		stopping;
+
+	MpscQueue<TileJob *>		done;
+	std::mutex			leftoverLock;
+	std::vector<TileJob *>		leftovers;		// done with no workers, or while stopping
+
+	std::atomic<long long>		generated, cancelled, stolen;
+	std::atomic<long long>		busyMicroseconds, stalledMicroseconds;
+
+	void		Deliver( TileJob * );
+	void		Drain( int );
+	void		Generate( TileJob *, int );
+	void		Run( int );
+	void		Send( int, int, TileJob *, float );
+	TileJob *	Take( int );
+	void		Wake( );
+
+  public:
+	TilePool( );
+	~TilePool( );
+	void		Cancel( TileJob * );
+	void		Flush( );
+	long long	GetBusyMicroseconds( );
+	long long	GetCancelled( );
+	long long	GetGenerated( );
+	int		GetNumDone( );
+	int		GetNumUnsent( );
+	int		GetNumWorkers( );
+	long long	GetStalledMicroseconds( );
+	long long	GetStolen( );
+	void		Reprioritize( TileJob *, float );
+	bool		Start( int, int, float );
+	void		Stop( );
+	void		Submit( std::vector<TileJob *> & );
+	TileJob *	TakeDone( );
+};
+
+#endif	// TILEPOOL_H
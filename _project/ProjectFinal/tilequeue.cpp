@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tilequeue.h"
+
+
+// checks and timings for the queues, run by the headless benchmark's --queue-test
+//	(the queues themselves are all in tilequeue.h)
+
+
+// what the tests push -- who pushed it, which of theirs it was, and when:
+
+struct QueueItem
+{
+	int		producer;
+	int		sequence;
+	long long	pushedNs;
+};
+
+
+// the small capacity makes the producers run into a full queue all the time:
+
+const int QUEUE_TEST_CAPACITY = 8;
+
+
+// and the benchmark uses the size the tile pool's queues are (see tilepool.h):
+
+const int QUEUE_BENCH_CAPACITY = 64;
+
+
+static long long
+NowNs( )
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now( ).time_since_epoch( ) ).count( );
+}
+
+
+// what the mpsc queue replaced -- a mutex around a deque, bounded the same way:
+
+template <class T>
+class LockedQueue
+{
+  private:
+	std::mutex	lock;
+	std::deque<T>	items;
+	int		capacity;
+
+  public:
+	void
+	Init( int _capacity )
+	{
+		capacity = _capacity;
+	}
+
+	bool
+	Push( const T &value )
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		if( (int)items.size( ) >= capacity )
+			return false;
+		items.push_back( value );
+		return true;
+	}
+
+	bool
+	Pop( T *value )
+	{
+		std::lock_guard<std::mutex> guard( lock );
+		if( items.empty( ) )
+			return false;
+		*value = items.front( );
+		items.pop_front( );
+		return true;
+	}
+};
+
+
+// producers threads each push items things into queue while this thread pops them, checking
+//	that every one comes out exactly once, and each producer's in the order it pushed them:
+// (returns how many times a producer found the queue full, or -1 if anything went wrong)
+
+template <class Q>
+static long long
+StressQueue( Q &queue, int producers, int items )
+{
+	std::atomic<long long> fulls( 0 );
+	std::vector<std::thread> threads;
+	for( int p = 0; p < producers; p++ )
+	{
+		threads.push_back( std::thread( [&queue, &fulls, p, items]( )
+		{
+			for( int i = 0; i < items; i++ )
+			{
+				struct QueueItem item = { p, i, 0 };
+				while( ! queue.Push( item ) )
+				{
+					fulls++;
+					std::this_thread::yield( );
+				}
+			}
+		} ) );
+	}
+
+	std::vector<int> next( producers, 0 );
+	bool ok = true;
+	for( long long received = 0; received < (long long)producers * items; )
+	{
+		struct QueueItem item;
+		if( ! queue.Pop( &item ) )
+		{
+			std::this_thread::yield( );
+			continue;
+		}
+		if( item.producer < 0  ||  item.producer >= producers  ||  item.sequence != next[ item.producer ] )
+		{
+			fprintf( stderr, "Queue stress test: got item %d of producer %d, expected %d\n", item.sequence, item.producer,
+				item.producer >= 0  &&  item.producer < producers ? next[ item.producer ] : -1 );
+			ok = false;
+			break;
+		}
+		next[ item.producer ]++;
+		received++;
+	}
+
+	for( int p = 0; p < producers; p++ )
+		threads[p].join( );
+
+	struct QueueItem extra;
+	if( ok  &&  queue.Pop( &extra ) )
+	{
+		fprintf( stderr, "Queue stress test: item %d of producer %d came out twice\n", extra.sequence, extra.producer );
+		ok = false;
+	}
+	return ok ? (long long)fulls : -1;
+}
+
+
+// hammer both queues through a tiny capacity -- true if they came through it:
+
+bool
+TileQueueStressTest( int producers, int items )
+{
+	SpscQueue<struct QueueItem> spsc;
+	spsc.Init( QUEUE_TEST_CAPACITY );
+	long long spscFulls = StressQueue( spsc, 1, items );
+
+	MpscQueue<struct QueueItem> mpsc;
+	mpsc.Init( QUEUE_TEST_CAPACITY );
+	long long mpscFulls = StressQueue( mpsc, producers, items );
+
+	if( spscFulls < 0  ||  mpscFulls < 0 )
+	{
+		fprintf( stderr, "Queue stress test: FAILED\n" );
+		return false;
+	}
+	fprintf( stderr, "Queue stress test: passed -- spsc %d items (%lld pushes into a full queue), mpsc %d x %d items (%lld)\n",
+		items, spscFulls, producers, items, mpscFulls );
+	return true;
+}
+
+
+// the time from each push to its pop, with producers threads pushing into queue at once:
+
+template <class Q>
+static void
+TimeQueue( const char *name, Q &queue, int producers, int items )
+{
+	std::vector<std::thread> threads;
+	for( int p = 0; p < producers; p++ )
+	{
+		threads.push_back( std::thread( [&queue, p, items]( )
+		{
+			for( int i = 0; i < items; i++ )
+			{
+				struct QueueItem item = { p, i, 0 };
+				item.pushedNs = NowNs( );
+				while( ! queue.Push( item ) )
+				{
+					std::this_thread::yield( );
+					item.pushedNs = NowNs( );		// (the latency of the queue, not of waiting for room)
+				}
+			}
+		} ) );
+	}
+
+	long long total = (long long)producers * items;
+	std::vector<long long> latencies;
+	latencies.reserve( total );
+	long long start = NowNs( );
+	while( (long long)latencies.size( ) < total )
+	{
+		struct QueueItem item;
+		if( queue.Pop( &item ) )
+			latencies.push_back( NowNs( ) - item.pushedNs );
+		else
+			std::this_thread::yield( );
+	}
+	double seconds = (double)( NowNs( ) - start ) / 1.e9;
+
+	for( int p = 0; p < producers; p++ )
+		threads[p].join( );
+
+	std::sort( latencies.begin( ), latencies.end( ) );
+	fprintf( stderr, "  %-26s %8.2f M items/s, latency %8lld ns p50, %8lld ns p99, %10lld ns max\n", name,
+		(double)total / seconds / 1.e6, latencies[ total / 2 ], latencies[ total * 99 / 100 ], latencies[ total - 1 ] );
+}
+
+
+// the enqueue to dequeue latency of each queue, against a mutex around a deque:
+
+void
+TileQueueBenchmark( int producers, int items )
+{
+	fprintf( stderr, "Queue benchmark: %d items from each producer, %d slots, %u cores\n", items, QUEUE_BENCH_CAPACITY,
+		std::thread::hardware_concurrency( ) );
+
+	SpscQueue<struct QueueItem> spsc;
+	spsc.Init( QUEUE_BENCH_CAPACITY );
+	TimeQueue( "spsc, 1 producer", spsc, 1, items );
+
+	LockedQueue<struct QueueItem> locked1;
+	locked1.Init( QUEUE_BENCH_CAPACITY );
+	TimeQueue( "mutex, 1 producer", locked1, 1, items );
+
+	char name[64];
+	MpscQueue<struct QueueItem> mpsc;
+	mpsc.Init( QUEUE_BENCH_CAPACITY );
+	sprintf( name, "mpsc, %d producers", producers );
+	TimeQueue( name, mpsc, producers, items );
+
+	LockedQueue<struct QueueItem> locked;
+	locked.Init( QUEUE_BENCH_CAPACITY );
+	sprintf( name, "mutex, %d producers", producers );
+	TimeQueue( name, locked, producers, items );
+}
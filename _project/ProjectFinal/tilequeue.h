@@ -0,0 +1,232 @@
+#ifndef TILEQUEUE_H
+#define TILEQUEUE_H
+
+#include <stdio.h>
+#include <atomic>
+
+
+//********************************************************************************
+// bounded lock-free queues, for handing things between the GL thread and the tile
+//	workers (see tilepool.h) without either one ever waiting on a mutex the other holds
+//
+// SpscQueue: one thread pushes, one other thread pops -- a ring with a head only the
+//	consumer moves and a tail only the producer moves
+//
+// MpscQueue: any number of threads push, one thread pops -- each slot carries a
+//	sequence number that says whether it is ready to be pushed into or popped from,
+//	and the pushers claim slots by moving the tail with a compare-exchange
+//
+// both are bounded: Push( ) says false when the queue is full rather than growing or
+//	waiting, so the pusher decides what to do about it -- that is the backpressure
+//
+// the capacity gets rounded up to a power of 2
+//********************************************************************************
+
+
+// keeps the producer's and the consumer's indices on different cache lines:
+
+const int QUEUE_CACHE_LINE = 64;
+
+
+template <class T>
+class SpscQueue
+{
+  private:
+	T *			slots;
+	unsigned int		mask;
+	char			pad0[QUEUE_CACHE_LINE];
+	std::atomic<unsigned int>	head;		// the next to pop -- moved by the consumer
+	char			pad1[QUEUE_CACHE_LINE];
+	std::atomic<unsigned int>	tail;		// the next to push into -- moved by the producer
+	char			pad2[QUEUE_CACHE_LINE];
+
+  public:
+	SpscQueue( )
+	{
+		slots = NULL;
+		mask = 0;
+		head = tail = 0;
+	}
+
+	~SpscQueue( )
+	{
+		delete [ ] slots;
+	}
+
+	int
+	GetCapacity( )
+	{
+		return (int)mask + 1;
+	}
+
+	// room for at least capacity things -- call before the threads start using it:
+
+	void
+	Init( int capacity )
+	{
+		unsigned int n = 2;
+		while( n < (unsigned int)capacity )
+			n *= 2;
+
+		delete [ ] slots;
+		slots = new T[n];
+		mask = n - 1;
+		head = tail = 0;
+	}
+
+	// (producer only)
+
+	bool
+	Push( const T &value )
+	{
+		unsigned int t = tail.load( std::memory_order_relaxed );
+		if( t - head.load( std::memory_order_acquire ) > mask )
+			return false;		// full
+
+		slots[ t & mask ] = value;
+		tail.store( t + 1, std::memory_order_release );
+		return true;
+	}
+
+	// (consumer only)
+
+	bool
+	Pop( T *value )
+	{
+		unsigned int h = head.load( std::memory_order_relaxed );
+		if( h == tail.load( std::memory_order_acquire ) )
+			return false;		// empty
+
+		*value = slots[ h & mask ];
+		head.store( h + 1, std::memory_order_release );
+		return true;
+	}
+
+	// (exact for the consumer and the producer, a snapshot for anyone else)
+
+	int
+	Size( )
+	{
+		unsigned int h = head.load( std::memory_order_acquire );		// (first, so it can't pass the tail)
+		return (int)( tail.load( std::memory_order_acquire ) - h );
+	}
+};
+
+
+template <class T>
+class MpscQueue
+{
+  private:
+	struct QueueCell
+	{
+		std::atomic<unsigned int>	sequence;	// == the index pushing it, when it is free -- that + 1 once it is full
+		T				value;
+	};
+
+	QueueCell *		cells;
+	unsigned int		mask;
+	char			pad0[QUEUE_CACHE_LINE];
+	std::atomic<unsigned int>	head;		// the next to pop -- moved by the consumer
+	char			pad1[QUEUE_CACHE_LINE];
+	std::atomic<unsigned int>	tail;		// the next to push into -- claimed by the producers
+	char			pad2[QUEUE_CACHE_LINE];
+
+  public:
+	MpscQueue( )
+	{
+		cells = NULL;
+		mask = 0;
+		head = tail = 0;
+	}
+
+	~MpscQueue( )
+	{
+		delete [ ] cells;
+	}
+
+	int
+	GetCapacity( )
+	{
+		return (int)mask + 1;
+	}
+
+	// room for at least capacity things -- call before the threads start using it:
+
+	void
+	Init( int capacity )
+	{
+		unsigned int n = 2;
+		while( n < (unsigned int)capacity )
+			n *= 2;
+
+		delete [ ] cells;
+		cells = new QueueCell[n];
+		for( unsigned int i = 0; i < n; i++ )
+			cells[i].sequence.store( i, std::memory_order_relaxed );
+		mask = n - 1;
+		head = tail = 0;
+	}
+
+	// (any thread)
+
+	bool
+	Push( const T &value )
+	{
+		unsigned int t = tail.load( std::memory_order_relaxed );
+		QueueCell *cell;
+		for( ; ; )
+		{
+			cell = &cells[ t & mask ];
+			int ready = (int)( cell->sequence.load( std::memory_order_acquire ) - t );
+			if( ready == 0 )
+			{
+				// free: claim it, unless another producer got there first
+				if( tail.compare_exchange_weak( t, t + 1, std::memory_order_relaxed ) )
+					break;
+			}
+			else if( ready < 0 )
+				return false;		// still full from a lap ago
+			else
+				t = tail.load( std::memory_order_relaxed );
+		}
+
+		cell->value = value;
+		cell->sequence.store( t + 1, std::memory_order_release );
+		return true;
+	}
+
+	// (consumer only)
+
+	bool
+	Pop( T *value )
+	{
+		unsigned int h = head.load( std::memory_order_relaxed );
+		QueueCell *cell = &cells[ h & mask ];
+		if( (int)( cell->sequence.load( std::memory_order_acquire ) - ( h + 1 ) ) < 0 )
+			return false;		// empty, or claimed but not written yet
+
+		*value = cell->value;
+		cell->sequence.store( h + mask + 1, std::memory_order_release );
+		head.store( h + 1, std::memory_order_relaxed );
+		return true;
+	}
+
+	// (a snapshot -- includes slots claimed but not written yet)
+
+	int
+	Size( )
+	{
+		unsigned int h = head.load( std::memory_order_acquire );		// (first, so it can't pass the tail)
+		return (int)( tail.load( std::memory_order_acquire ) - h );
+	}
+};
+
+
+// (a stress test and a latency benchmark, for the headless benchmark's --queue-test:)
+
+#ifdef HEADLESS
+bool		TileQueueStressTest( int, int );
+void		TileQueueBenchmark( int, int );
+#endif
+
+#endif	// TILEQUEUE_H
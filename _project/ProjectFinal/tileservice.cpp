@@ -0,0 +1,944 @@
+#include <string.h>
+#include <signal.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include "tileservice.h"
+#include "tilecache.h"
+#include "tilestore.h"
+
+
+#ifdef __linux__
+
+// send a message of type with flags, tiles and size bytes of payload after them, and passFd
+//	along with it if it isn't -1 -- 1 if it went, 0 if the socket is full, -1 if it's gone:
+
+static int
+SendMessage( int fd, int type, int flags, int count, int cells, unsigned int params,
+	const struct ServiceTile *tiles, const void *payload, size_t size, int passFd )
+{
+	struct ServiceHeader header;
+	header.magic = SERVICE_MAGIC;
+	header.type = (short)type;
+	header.flags = (short)flags;
+	header.count = count;
+	header.cells = cells;
+	header.params = params;
+
+	struct iovec parts[3];
+	parts[0].iov_base = &header;
+	parts[0].iov_len = sizeof(header);
+	parts[1].iov_base = (void *)tiles;
+	parts[1].iov_len = tiles != NULL ? sizeof(struct ServiceTile) * count : 0;
+	parts[2].iov_base = (void *)payload;
+	parts[2].iov_len = size;
+
+	struct msghdr message;
+	memset( &message, 0, sizeof(message) );
+	message.msg_iov = parts;
+	message.msg_iovlen = 3;
+
+	char control[ CMSG_SPACE( sizeof(int) ) ];
+	if( passFd >= 0 )
+	{
+		memset( control, 0, sizeof(control) );
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		struct cmsghdr *c = CMSG_FIRSTHDR( &message );
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN( sizeof(int) );
+		memcpy( CMSG_DATA( c ), &passFd, sizeof(int) );
+	}
+
+	if( sendmsg( fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL ) >= 0 )
+		return 1;
+	return errno == EAGAIN  ||  errno == EWOULDBLOCK ? 0 : -1;
+}
+
+
+// the next message into *buffer, and the fd that came with it into *passedFd (-1 for none) --
+//	its size, 0 if there isn't one yet, -1 if the socket is gone or the message is no good:
+
+static int
+ReceiveMessage( int fd, std::vector<unsigned char> *buffer, int *passedFd )
+{
+	*passedFd = -1;
+	buffer->resize( sizeof(struct ServiceHeader) + sizeof(struct ServiceTile) * TILE_SERVICE_BATCH + TILE_SERVICE_INLINE_BYTES );
+
+	struct iovec part;
+	part.iov_base = buffer->data( );
+	part.iov_len = buffer->size( );
+
+	char control[ CMSG_SPACE( sizeof(int) ) ];
+	struct msghdr message;
+	memset( &message, 0, sizeof(message) );
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	ssize_t size = recvmsg( fd, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC );
+	if( size < 0 )
+		return errno == EAGAIN  ||  errno == EWOULDBLOCK ? 0 : -1;
+
+	for( struct cmsghdr *c = CMSG_FIRSTHDR( &message ); c != NULL; c = CMSG_NXTHDR( &message, c ) )
+	{
+		if( c->cmsg_level == SOL_SOCKET  &&  c->cmsg_type == SCM_RIGHTS )
+			memcpy( passedFd, CMSG_DATA( c ), sizeof(int) );
+	}
+
+	struct ServiceHeader header;
+	bool ok = size >= (ssize_t)sizeof(header)  &&  ( message.msg_flags & ( MSG_TRUNC | MSG_CTRUNC ) ) == 0;
+	if( ok )
+	{
+		memcpy( &header, buffer->data( ), sizeof(header) );
+		ok = header.magic == SERVICE_MAGIC  &&  header.count <= TILE_SERVICE_BATCH;
+	}
+	if( ! ok )
+	{
+		if( *passedFd >= 0 )
+			close( *passedFd );
+		*passedFd = -1;
+		return -1;		// (which includes the other end hanging up, with a size of 0)
+	}
+	return (int)size;
+}
+
+#endif
+
+
+TileClient::TileClient( )
+{
+	fd = -1;
+	cells = 0;
+	tileFloats = 0;
+	params = 0;
+	nextMapping = 0;
+	received = memfds = bytes = 0;
+}
+
+
+TileClient::~TileClient( )
+{
+	Disconnect( );
+	while( ! done.empty( ) )
+	{
+		delete done.front( );
+		done.pop_front( );
+	}
+
+#ifdef __linux__
+	for( std::map< int, struct ServiceMapping >::iterator m = mappings.begin( ); m != mappings.end( ); m++ )
+		munmap( m->second.map, m->second.size );
+#endif
+}
+
+
+// don't bother making job any more -- it comes back from TakeDone( ) straight away:
+
+void
+TileClient::Cancel( TileJob *job )
+{
+	job->cancelled = true;
+	std::map< std::pair<int,int>, TileJob * >::iterator a = asked.find( std::pair<int,int>( job->cx, job->cz ) );
+	if( a != asked.end( )  &&  a->second == job )
+	{
+		asked.erase( a );
+		done.push_back( job );
+
+		struct ServiceTile tile = { job->cx, job->cz, 0.f };
+		cancels.push_back( tile );
+	}
+}
+
+
+// get tiles of _cells x _cells cells made with _params from the daemon listening on socket path --
+//	true if it's there, and makes that kind:
+
+bool
+TileClient::Connect( const char *path, int _cells, unsigned int _params )
+{
+	Disconnect( );
+
+#ifndef __linux__
+	fprintf( stderr, "The tile service needs linux's unix domain sockets -- not using '%s'\n", path );
+	return false;
+#else
+	cells = _cells;
+	tileFloats = ( cells + 1 ) * ( cells + 1 );
+	params = _params;
+
+	struct sockaddr_un address;
+	memset( &address, 0, sizeof(address) );
+	address.sun_family = AF_UNIX;
+	strncpy( address.sun_path, path, sizeof(address.sun_path) - 1 );
+
+	fd = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+	if( fd < 0  ||  connect( fd, (struct sockaddr *)&address, sizeof(address) ) != 0 )
+	{
+		fprintf( stderr, "Cannot connect to the tile service at '%s'\n", path );
+		Disconnect( );
+		return false;
+	}
+
+	// (the only time this waits for the daemon)
+	std::vector<unsigned char> buffer;
+	int passedFd;
+	int size = 0;
+	struct pollfd p = { fd, POLLIN, 0 };
+	if( SendMessage( fd, SERVICE_HELLO, 0, 0, cells, params, NULL, NULL, 0, -1 ) == 1  &&  poll( &p, 1, 1000 ) == 1 )
+		size = ReceiveMessage( fd, &buffer, &passedFd );
+
+	struct ServiceHeader header;
+	if( size > 0 )
+		memcpy( &header, buffer.data( ), sizeof(header) );
+	if( size <= 0  ||  header.type != SERVICE_HELLO  ||  header.count != 0 )
+	{
+		fprintf( stderr, "The tile service at '%s' %s\n", path, size > 0 ? "makes other tiles -- not using it" : "did not answer" );
+		Disconnect( );
+		return false;
+	}
+	heard = std::chrono::steady_clock::now( );
+	return true;
+#endif
+}
+
+
+// hand back everything still asked for, not finished, and stop using the daemon:
+
+void
+TileClient::Disconnect( )
+{
+#ifdef __linux__
+	if( fd >= 0 )
+		close( fd );
+#endif
+	fd = -1;
+
+	for( std::map< std::pair<int,int>, TileJob * >::iterator a = asked.begin( ); a != asked.end( ); a++ )
+	{
+		a->second->finished = false;
+		done.push_back( a->second );
+	}
+	asked.clear( );
+	wants.clear( );
+	cancels.clear( );
+}
+
+
+// send what hasn't been sent yet, and take what the daemon has sent back:
+
+void
+TileClient::Flush( )
+{
+	if( fd < 0 )
+		return;
+
+	if( ! Send( SERVICE_CANCEL, cancels )  ||  ! Send( SERVICE_WANT, wants ) )
+	{
+		fprintf( stderr, "Lost the tile service -- making the tiles here\n" );
+		Disconnect( );
+		return;
+	}
+	if( ! Receive( ) )
+	{
+		fprintf( stderr, "Lost the tile service -- making the tiles here\n" );
+		Disconnect( );
+	}
+}
+
+
+// bytes of heights that came from the daemon, and how many of those batches came in a memfd:
+
+long long
+TileClient::GetBytes( )
+{
+	return bytes;
+}
+
+
+long long
+TileClient::GetMemfds( )
+{
+	return memfds;
+}
+
+
+int
+TileClient::GetNumAsked( )
+{
+	return (int)asked.size( );
+}
+
+
+long long
+TileClient::GetReceived( )
+{
+	return received;
+}
+
+
+bool
+TileClient::IsConnected( )
+{
+	return fd >= 0;
+}
+
+
+// done with one tile from mapping (see TakeMapped( )) -- it is unmapped once every tile from it is:
+
+void
+TileClient::Release( int mapping )
+{
+	std::map< int, struct ServiceMapping >::iterator m = mappings.find( mapping );
+	if( m == mappings.end( )  ||  --m->second.users > 0 )
+		return;
+#ifdef __linux__
+	munmap( m->second.map, m->second.size );
+#endif
+	mappings.erase( m );
+}
+
+
+// take every message there is -- false if the daemon has gone away, or stopped answering:
+
+bool
+TileClient::Receive( )
+{
+#ifndef __linux__
+	return false;
+#else
+	std::vector<unsigned char> buffer;
+	for( ; ; )
+	{
+		int passedFd;
+		int size = ReceiveMessage( fd, &buffer, &passedFd );
+		if( size < 0 )
+			return false;
+		if( size == 0 )
+		{
+			std::chrono::duration<float, std::milli> waited = std::chrono::steady_clock::now( ) - heard;
+			if( ! asked.empty( )  &&  waited.count( ) > (float)TILE_SERVICE_TIMEOUT_MS )
+			{
+				fprintf( stderr, "The tile service has sent nothing for %.1f s\n", waited.count( ) / 1000.f );
+				return false;
+			}
+			return true;
+		}
+		heard = std::chrono::steady_clock::now( );
+
+		struct ServiceHeader header;
+		memcpy( &header, buffer.data( ), sizeof(header) );
+		size_t tilesBytes = sizeof(struct ServiceTile) * header.count;
+		size_t heightsBytes = sizeof(float) * tileFloats * header.count;
+		if( header.type != SERVICE_TILES  ||  header.count < 0  ||  sizeof(header) + tilesBytes > (size_t)size )
+		{
+			if( passedFd >= 0 )
+				close( passedFd );
+			continue;
+		}
+		const struct ServiceTile *tiles = (const struct ServiceTile *)( buffer.data( ) + sizeof(header) );
+
+		// the heights are after the tiles, or in the memfd -- which stays mapped for as long as
+		//	its tiles are used:
+		// (mapping past the end of a short one would be a SIGBUS once it was read, so that batch is
+		//	dropped -- its tiles are still asked for, until the timeout)
+		const float *heights = NULL;
+		int mapping = -1;
+		if( ( header.flags & SERVICE_MEMFD ) != 0 )
+		{
+			struct stat st;
+			if( passedFd >= 0  &&  ( fstat( passedFd, &st ) != 0  ||  (size_t)st.st_size < heightsBytes ) )
+			{
+				fprintf( stderr, "The tile service sent %d tiles in a memfd too small for them -- dropping them\n", header.count );
+				close( passedFd );
+				passedFd = -1;
+			}
+			void *map = passedFd >= 0 ? mmap( NULL, heightsBytes, PROT_READ, MAP_PRIVATE, passedFd, 0 ) : MAP_FAILED;
+			if( map != MAP_FAILED )
+			{
+				struct ServiceMapping m = { map, heightsBytes, header.count };
+				mapping = nextMapping++;
+				mappings[mapping] = m;
+				heights = (const float *)map;
+			}
+			memfds++;
+		}
+		else if( sizeof(header) + tilesBytes + heightsBytes <= (size_t)size )
+			heights = (const float *)( buffer.data( ) + sizeof(header) + tilesBytes );
+		if( passedFd >= 0 )
+			close( passedFd );		// (the mapping keeps it)
+
+		for( int t = 0; heights != NULL  &&  t < header.count; t++ )
+		{
+			std::pair<int,int> key( tiles[t].cx, tiles[t].cz );
+			std::map< std::pair<int,int>, TileJob * >::iterator a = asked.find( key );
+			TileJob *job;
+			if( a != asked.end( ) )
+			{
+				job = a->second;
+				asked.erase( a );
+			}
+			else
+			{
+				// (cancelled since, so it's on its own -- TerrainTiles puts it in its cache)
+				job = new TileJob;
+				job->cx = tiles[t].cx;
+				job->cz = tiles[t].cz;
+				job->cancelled = false;
+				job->priority = job->asked = 0.f;
+				job->worker = -1;
+			}
+			if( mapping >= 0 )
+				mapped[job] = std::pair<const float *, int>( heights + (size_t)t * tileFloats, mapping );
+			else
+				job->heights.assign( heights + (size_t)t * tileFloats, heights + (size_t)( t + 1 ) * tileFloats );
+			job->finished = true;
+			done.push_back( job );
+			received++;
+		}
+		if( heights != NULL )
+			bytes += (long long)heightsBytes;
+	}
+#endif
+}
+
+
+// ask for job again, with a new priority:
+
+void
+TileClient::Reprioritize( TileJob *job, float priority )
+{
+	struct ServiceTile tile = { job->cx, job->cz, priority };
+	wants.push_back( tile );
+}
+
+
+// send tiles as messages of type, a batch at a time, leaving what didn't fit in the socket --
+//	false if it's gone:
+
+bool
+TileClient::Send( int type, std::vector<struct ServiceTile> &tiles )
+{
+#ifndef __linux__
+	return false;
+#else
+	size_t sent = 0;
+	while( sent < tiles.size( ) )
+	{
+		int count = std::min( (int)( tiles.size( ) - sent ), TILE_SERVICE_BATCH );
+		int result = SendMessage( fd, type, 0, count, cells, params, &tiles[sent], NULL, 0, -1 );
+		if( result < 0 )
+			return false;
+		if( result == 0 )
+			break;
+		sent += count;
+	}
+	tiles.erase( tiles.begin( ), tiles.begin( ) + sent );
+	return true;
+#endif
+}
+
+
+// ask the daemon for jobs:
+
+void
+TileClient::Submit( std::vector<TileJob *> &jobs )
+{
+	// (the timeout counts from the first tile being waited on)
+	if( asked.empty( ) )
+		heard = std::chrono::steady_clock::now( );
+
+	for( int i = 0; i < (int)jobs.size( ); i++ )
+	{
+		TileJob *job = jobs[i];
+		job->worker = -1;
+		std::pair<int,int> key( job->cx, job->cz );
+		if( asked.count( key ) != 0 )
+		{
+			asked[key]->finished = false;
+			done.push_back( asked[key] );
+		}
+		asked[key] = job;
+
+		struct ServiceTile tile = { job->cx, job->cz, job->priority };
+		wants.push_back( tile );
+	}
+	Flush( );
+}
+
+
+// the next job that has come back, finished or cancelled, or NULL if there are none right now:
+
+TileJob *
+TileClient::TakeDone( )
+{
+	if( done.empty( )  &&  fd >= 0  &&  ! Receive( ) )
+	{
+		fprintf( stderr, "Lost the tile service -- making the tiles here\n" );
+		Disconnect( );
+	}
+	if( done.empty( ) )
+		return NULL;
+
+	TileJob *job = done.front( );
+	done.pop_front( );
+	return job;
+}
+
+
+// the heights of a finished job from TakeDone( ) that came in a memfd, instead of in its heights,
+//	and which mapping they are in -- or NULL if they didn't:
+// (they stay where they are until Release( mapping ))
+
+const float *
+TileClient::TakeMapped( TileJob *job, int *mapping )
+{
+	std::map< TileJob *, std::pair<const float *, int> >::iterator m = mapped.find( job );
+	if( m == mapped.end( ) )
+		return NULL;
+
+	const float *heights = m->second.first;
+	*mapping = m->second.second;
+	mapped.erase( m );
+	return heights;
+}
+
+
+//********************************************************************************
+// the daemon
+//********************************************************************************
+
+
+#ifdef __linux__
+
+static volatile sig_atomic_t ServiceStopping = 0;
+
+
+static void
+StopService( int )
+{
+	ServiceStopping = 1;
+}
+
+
+// tiles ready to send a client, in one message -- their heights in a memfd the daemon has mapped,
+//	with room for TILE_SERVICE_BATCH tiles, or without one, in heights, with room for only as
+//	many as fit in a message:
+
+struct ServiceBatch
+{
+	std::vector<struct ServiceTile>		tiles;
+	int					room;
+	int					memfd;		// -1 for none
+	float *					mapped;
+	std::vector<float>			heights;
+};
+
+
+// a client of the daemon, the tiles it is waiting for, and the ones ready to send it:
+
+struct ServiceClient
+{
+	int					fd;
+	std::set< std::pair<int,int> >		wants;
+	std::deque<struct ServiceBatch *>	ready;
+};
+
+
+// everything the daemon has:
+
+struct Service
+{
+	int					cells;
+	int					tileFloats;
+	unsigned int				params;
+	TilePool				pool;
+	TileStore				store;
+	TileCache				cache;
+	std::map< std::pair<int,int>, TileJob * >	jobs;		// being made, for somebody
+	std::vector<struct ServiceClient *>	clients;
+
+	long long				served, fromStore, fromCache, memfds;
+};
+
+
+// whether any client wants tile key:
+
+static bool
+Wanted( struct Service *service, std::pair<int,int> key )
+{
+	for( int c = 0; c < (int)service->clients.size( ); c++ )
+	{
+		if( service->clients[c]->wants.count( key ) != 0 )
+			return true;
+	}
+	return false;
+}
+
+
+// a new, empty batch of tiles:
+
+static struct ServiceBatch *
+NewBatch( struct Service *service )
+{
+	struct ServiceBatch *batch = new struct ServiceBatch;
+	size_t tileBytes = sizeof(float) * service->tileFloats;
+	batch->memfd = -1;
+	batch->mapped = NULL;
+#ifdef MFD_CLOEXEC
+	batch->memfd = memfd_create( "tiles", MFD_CLOEXEC );
+	if( batch->memfd >= 0  &&  ftruncate( batch->memfd, tileBytes * TILE_SERVICE_BATCH ) == 0 )
+	{
+		void *map = mmap( NULL, tileBytes * TILE_SERVICE_BATCH, PROT_READ | PROT_WRITE, MAP_SHARED, batch->memfd, 0 );
+		if( map != MAP_FAILED )
+			batch->mapped = (float *)map;
+	}
+	if( batch->mapped == NULL  &&  batch->memfd >= 0 )
+	{
+		close( batch->memfd );
+		batch->memfd = -1;
+	}
+#endif
+
+	if( batch->mapped != NULL )
+		batch->room = TILE_SERVICE_BATCH;
+	else
+	{
+		batch->room = std::max( TILE_SERVICE_INLINE_BYTES / (int)tileBytes, 1 );
+		batch->heights.resize( (size_t)batch->room * service->tileFloats );
+	}
+	return batch;
+}
+
+
+static void
+FreeBatch( struct Service *service, struct ServiceBatch *batch )
+{
+	if( batch->mapped != NULL )
+		munmap( batch->mapped, sizeof(float) * service->tileFloats * TILE_SERVICE_BATCH );
+	if( batch->memfd >= 0 )
+		close( batch->memfd );
+	delete batch;
+}
+
+
+// add tile key's heights to what goes to client next, straight into the batch it goes in:
+
+static void
+Ready( struct Service *service, struct ServiceClient *client, std::pair<int,int> key, const float *heights )
+{
+	if( client->ready.empty( )  ||  (int)client->ready.back( )->tiles.size( ) == client->ready.back( )->room )
+		client->ready.push_back( NewBatch( service ) );
+	struct ServiceBatch *batch = client->ready.back( );
+
+	float *to = ( batch->mapped != NULL ? batch->mapped : batch->heights.data( ) ) + batch->tiles.size( ) * service->tileFloats;
+	memcpy( to, heights, sizeof(float) * service->tileFloats );
+	struct ServiceTile tile = { key.first, key.second, 0.f };
+	batch->tiles.push_back( tile );
+	client->wants.erase( key );
+	service->served++;
+}
+
+
+// cancel the job for tile key if nobody wants it any more:
+
+static void
+Forget( struct Service *service, std::pair<int,int> key )
+{
+	std::map< std::pair<int,int>, TileJob * >::iterator j = service->jobs.find( key );
+	if( j != service->jobs.end( )  &&  ! Wanted( service, key ) )
+	{
+		service->pool.Cancel( j->second );
+		service->jobs.erase( j );
+	}
+}
+
+
+// a client wants tile ( cx, cz ), soon as priority says: send it now if it's in the store or
+//	the cache, otherwise have it made, unless it's being made already:
+
+static void
+Want( struct Service *service, struct ServiceClient *client, int cx, int cz, float priority, std::vector<TileJob *> *newJobs )
+{
+	std::pair<int,int> key( cx, cz );
+	std::map< std::pair<int,int>, TileJob * >::iterator j = service->jobs.find( key );
+	if( client->wants.count( key ) != 0  ||  j != service->jobs.end( ) )
+	{
+		client->wants.insert( key );
+		if( j != service->jobs.end( )  &&  priority < j->second->asked )
+		{
+			j->second->asked = priority;		// (the soonest anyone wants it)
+			service->pool.Reprioritize( j->second, priority );
+		}
+		return;
+	}
+
+	client->wants.insert( key );
+	const float *stored = service->store.Find( cx, cz );
+	if( stored != NULL )
+	{
+		Ready( service, client, key, stored );
+		service->fromStore++;
+		return;
+	}
+
+	TileKey cached = { cx, cz, service->params };
+	std::vector<float> heights;
+	if( service->cache.Take( cached, &heights ) )
+	{
+		Ready( service, client, key, heights.data( ) );
+		service->cache.Put( cached, &heights );		// (for the next one)
+		service->fromCache++;
+		return;
+	}
+
+	TileJob *job = new TileJob;
+	job->cx = cx;
+	job->cz = cz;
+	job->cancelled = false;
+	job->finished = false;
+	job->priority = job->asked = priority;
+	job->worker = -1;
+	service->jobs[key] = job;
+	newJobs->push_back( job );
+}
+
+
+// take every message from client -- false once it has gone away:
+
+static bool
+Listen( struct Service *service, struct ServiceClient *client, std::vector<TileJob *> *newJobs )
+{
+	std::vector<unsigned char> buffer;
+	for( ; ; )
+	{
+		int passedFd;
+		int size = ReceiveMessage( client->fd, &buffer, &passedFd );
+		if( passedFd >= 0 )
+			close( passedFd );		// (clients never send any)
+		if( size == 0 )
+			return true;
+		if( size < 0 )
+			return false;
+
+		struct ServiceHeader header;
+		memcpy( &header, buffer.data( ), sizeof(header) );
+		if( header.count < 0  ||  sizeof(header) + sizeof(struct ServiceTile) * header.count > (size_t)size )
+			return false;
+		const struct ServiceTile *tiles = (const struct ServiceTile *)( buffer.data( ) + sizeof(header) );
+
+		if( header.type == SERVICE_HELLO )
+		{
+			bool same = header.cells == service->cells  &&  header.params == service->params;
+			if( SendMessage( client->fd, SERVICE_HELLO, 0, same ? 0 : -1, service->cells, service->params, NULL, NULL, 0, -1 ) != 1 )
+				return false;
+		}
+		else if( header.type == SERVICE_WANT )
+		{
+			for( int t = 0; t < header.count; t++ )
+				Want( service, client, tiles[t].cx, tiles[t].cz, tiles[t].priority, newJobs );
+		}
+		else if( header.type == SERVICE_CANCEL )
+		{
+			for( int t = 0; t < header.count; t++ )
+			{
+				std::pair<int,int> key( tiles[t].cx, tiles[t].cz );
+				client->wants.erase( key );
+				Forget( service, key );
+			}
+		}
+	}
+}
+
+
+// send client the batches of tiles ready for it, each with more than TILE_SERVICE_INLINE_BYTES
+//	of heights in its memfd, and the rest after the tiles -- false if it has gone away:
+
+static bool
+Answer( struct Service *service, struct ServiceClient *client )
+{
+	while( ! client->ready.empty( ) )
+	{
+		struct ServiceBatch *batch = client->ready.front( );
+		int count = (int)batch->tiles.size( );
+		size_t size = sizeof(float) * service->tileFloats * count;
+
+		int result;
+		if( batch->memfd >= 0  &&  size > (size_t)TILE_SERVICE_INLINE_BYTES )
+		{
+			result = SendMessage( client->fd, SERVICE_TILES, SERVICE_MEMFD, count, service->cells, service->params,
+				batch->tiles.data( ), NULL, 0, batch->memfd );
+			if( result == 1 )
+				service->memfds++;
+		}
+		else
+		{
+			const float *heights = batch->mapped != NULL ? batch->mapped : batch->heights.data( );
+			result = SendMessage( client->fd, SERVICE_TILES, 0, count, service->cells, service->params,
+				batch->tiles.data( ), heights, size, -1 );
+		}
+
+		if( result < 0 )
+			return false;
+		if( result == 0 )
+			break;		// (the rest next time around)
+
+		// (the client has its own memfd, once it's sent, and the daemon never writes to it again)
+		FreeBatch( service, batch );
+		client->ready.pop_front( );
+	}
+	return true;
+}
+
+
+// let client go, and whatever only it wanted:
+
+static void
+Drop( struct Service *service, int c )
+{
+	struct ServiceClient *client = service->clients[c];
+	close( client->fd );
+	service->clients.erase( service->clients.begin( ) + c );
+	for( std::set< std::pair<int,int> >::iterator w = client->wants.begin( ); w != client->wants.end( ); w++ )
+		Forget( service, *w );
+	for( int b = 0; b < (int)client->ready.size( ); b++ )
+		FreeBatch( service, client->ready[b] );
+	delete client;
+}
+
+#endif
+
+
+// serve tiles of cells x cells grid cells, cellSize apart, made by numWorkers threads, on the
+//	unix domain socket path, keeping them in storeFile (NULL for no store) -- until SIGINT or
+//	SIGTERM:
+
+int
+RunTileService( const char *path, int cells, float cellSize, int numWorkers, const char *storeFile )
+{
+#ifndef __linux__
+	fprintf( stderr, "The tile service needs linux's unix domain sockets\n" );
+	return 1;
+#else
+	struct Service service;
+	service.cells = cells;
+	service.tileFloats = ( cells + 1 ) * ( cells + 1 );
+	service.params = TileParamsHash( cells, cellSize );
+	service.served = service.fromStore = service.fromCache = service.memfds = 0;
+	service.cache.SetBudget( TILE_SERVICE_CACHE_BYTES );
+
+	struct sockaddr_un address;
+	memset( &address, 0, sizeof(address) );
+	address.sun_family = AF_UNIX;
+	strncpy( address.sun_path, path, sizeof(address.sun_path) - 1 );
+	unlink( path );		// (left behind by one that didn't get to clean up)
+
+	int listener = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+	if( listener < 0  ||  bind( listener, (struct sockaddr *)&address, sizeof(address) ) != 0  ||  listen( listener, 16 ) != 0 )
+	{
+		fprintf( stderr, "Cannot listen on '%s'\n", path );
+		return 1;
+	}
+
+	if( storeFile != NULL )
+		service.store.Open( storeFile, cells, service.params );
+	service.pool.Start( numWorkers, cells, cellSize );
+
+	signal( SIGINT, StopService );
+	signal( SIGTERM, StopService );
+	signal( SIGPIPE, SIG_IGN );
+	fprintf( stderr, "Serving %dx%d tiles (params %08x) on '%s' with %d workers\n", cells, cells, service.params, path,
+		service.pool.GetNumWorkers( ) );
+
+	std::vector<struct pollfd> fds;
+	while( ! ServiceStopping )
+	{
+		fds.clear( );
+		struct pollfd l = { listener, POLLIN, 0 };
+		fds.push_back( l );
+		for( int c = 0; c < (int)service.clients.size( ); c++ )
+		{
+			struct ServiceClient *client = service.clients[c];
+			struct pollfd p = { client->fd, (short)( POLLIN | ( client->ready.empty( ) ? 0 : POLLOUT ) ), 0 };
+			fds.push_back( p );
+		}
+		poll( fds.data( ), fds.size( ), service.jobs.empty( ) ? TILE_SERVICE_IDLE_MS : TILE_SERVICE_BUSY_MS );
+
+		if( ( fds[0].revents & POLLIN ) != 0 )
+		{
+			int fd = accept4( listener, NULL, NULL, SOCK_CLOEXEC );
+			if( fd >= 0 )
+			{
+				struct ServiceClient *client = new struct ServiceClient;
+				client->fd = fd;
+				service.clients.push_back( client );
+			}
+		}
+
+		// what the clients want:
+		std::vector<TileJob *> newJobs;
+		for( int c = (int)service.clients.size( ) - 1; c >= 0; c-- )
+		{
+			if( ! Listen( &service, service.clients[c], &newJobs ) )
+				Drop( &service, c );
+		}
+		if( ! newJobs.empty( ) )
+			service.pool.Submit( newJobs );
+		service.pool.Flush( );
+		service.store.Poll( );
+
+		// what has been made, for whoever still wants it, and for the store and the cache:
+		TileJob *job;
+		while( ( job = service.pool.TakeDone( ) ) != NULL )
+		{
+			std::pair<int,int> key( job->cx, job->cz );
+			std::map< std::pair<int,int>, TileJob * >::iterator j = service.jobs.find( key );
+			if( j != service.jobs.end( )  &&  j->second == job )
+				service.jobs.erase( j );
+			if( job->finished )
+			{
+				for( int c = 0; c < (int)service.clients.size( ); c++ )
+				{
+					if( service.clients[c]->wants.count( key ) != 0 )
+						Ready( &service, service.clients[c], key, job->heights.data( ) );
+				}
+				service.store.Put( job->cx, job->cz, job->heights.data( ) );
+				TileKey cached = { job->cx, job->cz, service.params };
+				service.cache.Put( cached, &job->heights );
+			}
+			delete job;
+		}
+
+		for( int c = (int)service.clients.size( ) - 1; c >= 0; c-- )
+		{
+			if( ! Answer( &service, service.clients[c] ) )
+				Drop( &service, c );
+		}
+	}
+
+	while( ! service.clients.empty( ) )
+		Drop( &service, (int)service.clients.size( ) - 1 );
+	service.pool.Stop( );
+	TileJob *job;
+	while( ( job = service.pool.TakeDone( ) ) != NULL )
+		delete job;
+	close( listener );
+	unlink( path );
+
+	fprintf( stderr, "Served %lld tiles: %lld made, %lld from the store, %lld from the cache, %lld batches in a memfd\n",
+		service.served, service.pool.GetGenerated( ), service.fromStore, service.fromCache, service.memfds );
+	return 0;
+#endif
+}
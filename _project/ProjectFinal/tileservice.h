@@ -0,0 +1,150 @@
+#ifndef TILESERVICE_H
+#define TILESERVICE_H
+
+#include <stdio.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "tilepool.h"
+
+
+//********************************************************************************
+// the cpu tiles (see terraintiles.h) made by a separate process: RunTileService( ) is a
+//	daemon with its own TilePool and TileStore, serving tiles over a unix domain
+//	socket, and a TileClient asks it for them the way TerrainTiles asks its own
+//	TilePool -- so any number of viewers can share one daemon's work
+//
+// the socket is SOCK_SEQPACKET, so every message arrives whole, and every message is
+//	a ServiceHeader followed by count ServiceTile's:
+//
+//	SERVICE_HELLO		client -> daemon: the cells and params hash it wants tiles for
+//				daemon -> client: the same back, or count = -1 if it makes others
+//	SERVICE_WANT		client -> daemon: make these tiles (again, to change their priority)
+//	SERVICE_CANCEL		client -> daemon: don't bother with these any more
+//	SERVICE_TILES		daemon -> client: these tiles, with their heights after them --
+//				or, with SERVICE_MEMFD set in flags, in a memfd sent along with the
+//				message, which the client maps instead of reading off the socket
+//
+// a batch of more than TILE_SERVICE_INLINE_BYTES of heights goes in a memfd -- the daemon
+//	copies each tile into its mapping of the memfd as it is made, and the viewer uses the
+//	heights straight out of its own mapping, which it keeps until the last tile from it
+//	has left the window (see TakeMapped( ) and Release( )) -- so they are never copied
+//	through the socket, or again at the other end
+//
+// the daemon makes a tile once for however many clients want it, keeps the ones it made
+//	in a TileCache for the clients that want them next, and looks in its store first
+//
+// a client whose daemon goes away hands every job it had back, not finished, so they are
+//	asked for again -- from the viewer's own pool, which is what it does with no daemon --
+//	and so does one whose daemon sends nothing for TILE_SERVICE_TIMEOUT_MS while it waits
+//
+// it uses linux's own socket calls (accept4( ), SOCK_CLOEXEC, MSG_NOSIGNAL, memfd's, ...) --
+//	everywhere else, ConnectService( ) and RunTileService( ) just say it isn't there
+//********************************************************************************
+
+
+// the messages, and the flags on them:
+
+const int SERVICE_HELLO  = 1;
+const int SERVICE_WANT   = 2;
+const int SERVICE_CANCEL = 3;
+const int SERVICE_TILES  = 4;
+
+const int SERVICE_MEMFD  = 1;
+
+const unsigned int SERVICE_MAGIC = 0x53454954;		// "TIES", little-endian
+
+
+// the most tiles in a message, the most bytes of heights to send in one, and how long the
+//	daemon waits for something to happen while it has tiles being made, and while it doesn't:
+
+const int TILE_SERVICE_BATCH         = 256;
+const int TILE_SERVICE_INLINE_BYTES  = 16 * 1024;
+const int TILE_SERVICE_BUSY_MS       = 1;
+const int TILE_SERVICE_IDLE_MS       = 100;
+
+// how long a client waits for the daemon to send anything, while it has tiles asked for,
+//	before giving up on it:
+
+const int TILE_SERVICE_TIMEOUT_MS    = 5000;
+
+// the bytes of tiles the daemon keeps for the next client that wants them:
+
+const long long TILE_SERVICE_CACHE_BYTES = 16 * 1024 * 1024;
+
+
+struct ServiceHeader
+{
+	unsigned int	magic;		// SERVICE_MAGIC
+	short		type;		// SERVICE_HELLO, ...
+	short		flags;
+	int		count;		// ServiceTile's that follow
+	int		cells;
+	unsigned int	params;
+};
+
+
+struct ServiceTile
+{
+	int		cx, cz;
+	float		priority;	// for SERVICE_WANT
+};
+
+
+// the viewer's end: Submit( ), Cancel( ), Reprioritize( ) and TakeDone( ) work the way TilePool's do
+
+class TileClient
+{
+  private:
+	int		fd;
+	int		cells;
+	int		tileFloats;
+	unsigned int	params;
+
+	std::map< std::pair<int,int>, TileJob * >	asked;		// sent, and not back yet
+	std::deque<TileJob *>				done;
+	std::map< TileJob *, std::pair<const float *, int> >	mapped;		// done, with their heights in a memfd: where, and which
+
+	struct ServiceMapping
+	{
+		void *		map;
+		size_t		size;
+		int		users;		// tiles from it not released yet
+	};
+	std::map< int, struct ServiceMapping >		mappings;
+	int						nextMapping;
+	std::vector<struct ServiceTile>			wants, cancels;	// not sent yet
+	std::chrono::steady_clock::time_point		heard;		// from the daemon, or started waiting on it
+
+	long long	received, memfds, bytes;
+
+	void		Disconnect( );
+	bool		Receive( );
+	bool		Send( int, std::vector<struct ServiceTile> & );
+
+  public:
+	TileClient( );
+	~TileClient( );
+	void		Cancel( TileJob * );
+	bool		Connect( const char *, int, unsigned int );
+	void		Flush( );
+	long long	GetBytes( );
+	long long	GetMemfds( );
+	int		GetNumAsked( );
+	long long	GetReceived( );
+	bool		IsConnected( );
+	void		Release( int );
+	void		Reprioritize( TileJob *, float );
+	void		Submit( std::vector<TileJob *> & );
+	TileJob *	TakeDone( );
+	const float *	TakeMapped( TileJob *, int * );
+};
+
+
+int	RunTileService( const char *, int, float, int, const char * );
+
+#endif	// TILESERVICE_H
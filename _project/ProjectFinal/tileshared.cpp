@@ -0,0 +1,385 @@
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "tileshared.h"
+
+
+// a slot's state is one of these, in the top two bits, plus how many are using it in the rest:
+
+const unsigned int SHARED_EMPTY   = 0u;
+const unsigned int SHARED_WRITING = 1u << 30;
+const unsigned int SHARED_READY   = 2u << 30;
+const unsigned int SHARED_PHASE   = 3u << 30;
+
+
+TileShared::TileShared( )
+{
+	cells = 0;
+	tileFloats = 0;
+	params = 0;
+	numSlots = 0;
+	mapped = NULL;
+	mappedBytes = 0;
+	header = NULL;
+	slots = NULL;
+	records = NULL;
+	hits = misses = published = evictions = skipped = 0;
+}
+
+
+TileShared::~TileShared( )
+{
+	Close( );
+}
+
+
+// find tile ( cx, cz ) and start using it -- its slot, or -1 if it isn't there:
+// (call Release( ) with the slot once done with it)
+
+int
+TileShared::Acquire( int cx, int cz )
+{
+	if( mapped == NULL )
+		return -1;
+
+	int home = Home( cx, cz );
+	for( int p = 0; p < TILE_SHARED_PROBE; p++ )
+	{
+		int s = ( home + p ) % numSlots;
+		struct SharedSlot *slot = &slots[s];
+		unsigned int state = slot->state.load( std::memory_order_acquire );
+		if( ( state & SHARED_PHASE ) != SHARED_READY  ||  slot->cx.load( std::memory_order_relaxed ) != cx
+		  ||  slot->cz.load( std::memory_order_relaxed ) != cz )
+			continue;
+
+		// (a failed swap reloads state, so this goes around again only while it is still ready)
+		bool acquired = false;
+		while( ( state & SHARED_PHASE ) == SHARED_READY  &&  ! acquired )
+			acquired = slot->state.compare_exchange_weak( state, state + 1, std::memory_order_acquire );
+		if( ! acquired )
+			continue;
+
+		// it could have been written over with another tile between looking and swapping --
+		//	but not any more:
+		if( slot->cx.load( std::memory_order_relaxed ) != cx  ||  slot->cz.load( std::memory_order_relaxed ) != cz )
+		{
+			Release( s );
+			continue;
+		}
+
+		slot->lastUse.store( header->clock.fetch_add( 1, std::memory_order_relaxed ), std::memory_order_relaxed );
+		hits++;
+		return s;
+	}
+	misses++;
+	return -1;
+}
+
+
+// stop using the shared memory:
+// (the slots still being used are never released -- Release( ) them first)
+
+void
+TileShared::Close( )
+{
+#ifndef WIN32
+	if( mapped != NULL )
+		munmap( mapped, mappedBytes );
+#endif
+	mapped = NULL;
+	header = NULL;
+	slots = NULL;
+	records = NULL;
+}
+
+
+// tiles that took the slot of one no one was using any more:
+
+long long
+TileShared::GetEvictions( )
+{
+	return evictions;
+}
+
+
+// the heights in slot, from Acquire( ):
+
+const float *
+TileShared::GetHeights( int slot )
+{
+	return records + (size_t)slot * tileFloats;
+}
+
+
+long long
+TileShared::GetHits( )
+{
+	return hits;
+}
+
+
+long long
+TileShared::GetMisses( )
+{
+	return misses;
+}
+
+
+// the tiles ready in the shared memory, from any viewer:
+
+int
+TileShared::GetNumReady( )
+{
+	int ready = 0;
+	for( int s = 0; s < numSlots; s++ )
+	{
+		if( ( slots[s].state.load( std::memory_order_relaxed ) & SHARED_PHASE ) == SHARED_READY )
+			ready++;
+	}
+	return ready;
+}
+
+
+int
+TileShared::GetNumSlots( )
+{
+	return numSlots;
+}
+
+
+long long
+TileShared::GetPublished( )
+{
+	return published;
+}
+
+
+// tiles not published, because every slot they could go in was being used:
+
+long long
+TileShared::GetSkipped( )
+{
+	return skipped;
+}
+
+
+// the first slot tile ( cx, cz ) may go in:
+
+int
+TileShared::Home( int cx, int cz )
+{
+	unsigned int hash = (unsigned int)cx * 73856093u ^ (unsigned int)cz * 19349663u;
+	return (int)( hash % (unsigned int)numSlots );
+}
+
+
+bool
+TileShared::IsOpen( )
+{
+	return mapped != NULL;
+}
+
+
+// share tiles of _cells x _cells cells made with _params through the segment called name,
+//	plus the hash -- making it, if no viewer has yet:
+
+bool
+TileShared::Open( const char *name, int _cells, unsigned int _params )
+{
+	Close( );
+
+#ifdef WIN32
+	fprintf( stderr, "The shared tile cache needs shm_open( ) -- not using '%s'\n", name );
+	return false;
+#else
+	cells = _cells;
+	tileFloats = ( cells + 1 ) * ( cells + 1 );
+	params = _params;
+
+	char segment[256];
+	snprintf( segment, sizeof(segment), "%s-%08x", name, params );
+
+	size_t slotsOffset = sizeof(struct SharedHeader);
+	size_t recordsOffset = ( slotsOffset + sizeof(struct SharedSlot) * TILE_SHARED_SLOTS + 4095 ) & ~(size_t)4095;	// (page aligned)
+	mappedBytes = recordsOffset + sizeof(float) * tileFloats * TILE_SHARED_SLOTS;
+
+	// whoever makes it sizes it (which zeroes it, so every slot starts out empty), and
+	//	writes the header, then says it's ready
+	//
+	// a viewer that died part way through that leaves one that never will be -- so one still
+	//	empty, or not ready, after TILE_SHARED_WAIT_MS is unlinked, and made over, once
+	for( int tries = 0; ; tries++ )
+	{
+		bool making = true;
+		int fd = shm_open( segment, O_RDWR | O_CREAT | O_EXCL, 0644 );
+		if( fd < 0  &&  errno == EEXIST )
+		{
+			making = false;
+			fd = shm_open( segment, O_RDWR, 0644 );
+		}
+		if( fd < 0 )
+		{
+			fprintf( stderr, "Cannot open the shared tile cache '%s'\n", segment );
+			return false;
+		}
+		if( making  &&  ftruncate( fd, mappedBytes ) != 0 )
+		{
+			fprintf( stderr, "Cannot size the shared tile cache '%s'\n", segment );
+			close( fd );
+			shm_unlink( segment );
+			return false;
+		}
+
+		// (one being made by someone else can still be too small to map)
+		struct stat st;
+		memset( &st, 0, sizeof(st) );
+		bool sized = false;
+		for( int waited = 0; ! sized  &&  waited < TILE_SHARED_WAIT_MS; waited++ )
+		{
+			if( fstat( fd, &st ) != 0 )
+				break;
+			sized = (size_t)st.st_size >= mappedBytes;
+			if( ! sized )
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+		if( ! sized  &&  st.st_size == 0  &&  tries == 0 )
+		{
+			fprintf( stderr, "The shared tile cache '%s' was never finished -- making it over\n", segment );
+			close( fd );
+			shm_unlink( segment );
+			continue;
+		}
+		if( ! sized  ||  (size_t)st.st_size != mappedBytes )
+		{
+			fprintf( stderr, "The shared tile cache '%s' was made for something else -- not using it\n", segment );
+			close( fd );
+			return false;
+		}
+
+		void *map = mmap( NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		close( fd );		// (the mapping keeps it)
+		if( map == MAP_FAILED )
+		{
+			fprintf( stderr, "Cannot map the shared tile cache '%s'\n", segment );
+			return false;
+		}
+		mapped = (unsigned char *)map;
+		header = (struct SharedHeader *)mapped;
+		slots = (struct SharedSlot *)( mapped + slotsOffset );
+		records = (float *)( mapped + recordsOffset );
+		numSlots = TILE_SHARED_SLOTS;
+
+		if( making )
+		{
+			memcpy( header->magic, "TILESHAR", 8 );
+			header->version = 1;
+			header->cells = cells;
+			header->params = params;
+			header->numSlots = numSlots;
+			header->ready.store( 1, std::memory_order_release );
+		}
+		else
+		{
+			for( int waited = 0; header->ready.load( std::memory_order_acquire ) == 0  &&  waited < TILE_SHARED_WAIT_MS; waited++ )
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+
+		if( header->ready.load( std::memory_order_acquire ) == 0  &&  tries == 0 )
+		{
+			fprintf( stderr, "The shared tile cache '%s' was never finished -- making it over\n", segment );
+			Close( );
+			shm_unlink( segment );
+			continue;
+		}
+		break;
+	}
+
+	if( memcmp( header->magic, "TILESHAR", 8 ) != 0  ||  header->version != 1  ||  header->cells != cells
+	  ||  header->params != params  ||  header->numSlots != numSlots )
+	{
+		fprintf( stderr, "The shared tile cache '%s' was made for something else -- not using it\n", segment );
+		Close( );
+		return false;
+	}
+	return true;
+#endif
+}
+
+
+// put tile ( cx, cz )'s heights where every viewer can find them, unless they are there already:
+// (never waits -- if every slot it could go in is being used, it just isn't published)
+
+void
+TileShared::Publish( int cx, int cz, const float *heights )
+{
+	if( mapped == NULL )
+		return;
+
+	int home = Home( cx, cz );
+	int victim = -1;
+	unsigned int victimState = 0;
+	bool victimEmpty = false;
+	unsigned int oldest = 0;
+	for( int p = 0; p < TILE_SHARED_PROBE; p++ )
+	{
+		int s = ( home + p ) % numSlots;
+		struct SharedSlot *slot = &slots[s];
+		unsigned int state = slot->state.load( std::memory_order_acquire );
+		if( ( state & SHARED_PHASE ) == SHARED_READY  &&  slot->cx.load( std::memory_order_relaxed ) == cx
+		  &&  slot->cz.load( std::memory_order_relaxed ) == cz )
+			return;		// another viewer beat us to it
+
+		if( state == SHARED_EMPTY  &&  ! victimEmpty )
+		{
+			victim = s;
+			victimState = state;
+			victimEmpty = true;
+		}
+		else if( state == SHARED_READY  &&  ! victimEmpty )		// (ready, and no one using it)
+		{
+			// (how long ago, counting around the clock's wrap)
+			unsigned int age = header->clock.load( std::memory_order_relaxed ) - slot->lastUse.load( std::memory_order_relaxed );
+			if( victim < 0  ||  age > oldest )
+			{
+				victim = s;
+				victimState = state;
+				oldest = age;
+			}
+		}
+	}
+
+	// (and if someone else took it first, or started using it, let this one go)
+	if( victim < 0  ||  ! slots[victim].state.compare_exchange_strong( victimState, SHARED_WRITING, std::memory_order_acquire ) )
+	{
+		skipped++;
+		return;
+	}
+	if( ! victimEmpty )
+		evictions++;
+
+	struct SharedSlot *slot = &slots[victim];
+	slot->cx.store( cx, std::memory_order_relaxed );
+	slot->cz.store( cz, std::memory_order_relaxed );
+	memcpy( records + (size_t)victim * tileFloats, heights, sizeof(float) * tileFloats );
+	slot->lastUse.store( header->clock.fetch_add( 1, std::memory_order_relaxed ), std::memory_order_relaxed );
+	slot->state.store( SHARED_READY, std::memory_order_release );		// (everything above before this)
+	published++;
+}
+
+
+// stop using the tile in slot, from Acquire( ):
+
+void
+TileShared::Release( int slot )
+{
+	slots[slot].state.fetch_sub( 1, std::memory_order_release );
+}
@@ -0,0 +1,106 @@
+#ifndef TILESHARED_H
+#define TILESHARED_H
+
+#include <stdio.h>
+#include <atomic>
+
+
+//********************************************************************************
+// the cpu tiles (see terraintiles.h) kept in posix shared memory, so every viewer on
+//	the machine uses a tile that any of them made
+//
+// the shared memory is a header and a fixed number of slots, each a tile's heights and
+//	a 32-bit state: whether it is empty, being written, or ready, and how many are
+//	using it -- everything is done with compare-and-swaps on the states, never a lock,
+//	so a viewer that stops halfway can't hold up the others
+//
+// Publish( ) takes a slot no one is using -- an empty one or the least recently used
+//	ready one, among the few the tile hashes to -- by swapping its state to being
+//	written, writes the tile, and only then swaps it to ready: a tile is never seen
+//	before it is all there
+//
+// Acquire( ) finds a ready tile and adds one to its users, and the slot can't be
+//	taken for anything else until Release( ) takes it off again -- so the heights can
+//	be used straight out of the shared memory for as long as they are wanted
+//
+// there is a segment for each TileParamsHash( ), so viewers with other noise parameters
+//	or another grid never share tiles -- and it stays after the last viewer is gone,
+//	for the next ones (remove it from /dev/shm to start over)
+//
+// a viewer that dies while using a tile, or writing one, leaves that slot taken for good,
+//	which only makes the cache smaller
+//
+// on windows there is no shm_open( ), and Open( ) says so
+//********************************************************************************
+
+
+// how many tiles the shared memory has room for, and how many slots a tile may go in:
+
+const int TILE_SHARED_SLOTS = 4096;
+const int TILE_SHARED_PROBE = 16;
+
+// what the segment is called, before the hash that goes on the end of it:
+
+const char * const TILE_SHARED_NAME = "/projfinal-tiles";
+
+// how long to wait for another viewer to finish making the segment:
+
+const int TILE_SHARED_WAIT_MS = 1000;
+
+
+class TileShared
+{
+  private:
+	struct SharedHeader
+	{
+		char			magic[8];	// "TILESHAR"
+		int			version;
+		int			cells;
+		unsigned int		params;
+		int			numSlots;
+		std::atomic<unsigned int>	ready;		// set once the rest is there
+		std::atomic<unsigned int>	clock;		// for the slots' lastUse
+		int			pad[8];
+	};
+
+	struct SharedSlot
+	{
+		std::atomic<unsigned int>	state;		// a SHARED_ phase (see tileshared.cpp), plus the number of users
+		std::atomic<unsigned int>	lastUse;
+		std::atomic<int>		cx, cz;
+	};
+
+	int		cells;
+	int		tileFloats;
+	unsigned int	params;
+	int		numSlots;
+	unsigned char *	mapped;
+	size_t		mappedBytes;
+	struct SharedHeader *	header;
+	struct SharedSlot *	slots;
+	float *		records;
+
+	long long	hits, misses, published, evictions, skipped;
+
+	int		Home( int, int );
+
+  public:
+	TileShared( );
+	~TileShared( );
+	int		Acquire( int, int );
+	void		Close( );
+	long long	GetEvictions( );
+	const float *	GetHeights( int );
+	long long	GetHits( );
+	long long	GetMisses( );
+	int		GetNumReady( );
+	int		GetNumSlots( );
+	long long	GetPublished( );
+	long long	GetSkipped( );
+	bool		IsOpen( );
+	bool		Open( const char *, int, unsigned int );
+	void		Publish( int, int, const float * );
+	void		Release( int );
+};
+
+#endif	// TILESHARED_H
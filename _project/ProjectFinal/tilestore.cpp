@@ -0,0 +1,357 @@
+#include <string.h>
+#include <chrono>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "tilestore.h"
+
+
+TileStore::TileStore( )
+{
+	cells = 0;
+	tileFloats = 0;
+	params = 0;
+	capacity = 0;
+	fd = -1;
+	mapped = NULL;
+	mappedBytes = 0;
+	index = NULL;
+	records = NULL;
+	nextRecord = 0;
+	stopping = false;
+	loaded = stored = skipped = 0;
+}
+
+
+TileStore::~TileStore( )
+{
+	Close( );
+}
+
+
+// finish writing what has been Put( ), and let go of the file:
+// (the pointers Find( ) handed out are no good after this)
+
+void
+TileStore::Close( )
+{
+	if( writer.joinable( ) )
+	{
+		stopping = true;
+		writer.join( );
+	}
+
+	struct StoreWrite w;
+	while( toWrite.Pop( &w ) )
+		delete w.heights;
+	while( written.Pop( &w ) )
+		;
+	found.clear( );
+
+#ifndef WIN32
+	if( mapped != NULL )
+		munmap( mapped, mappedBytes );
+	if( fd >= 0 )
+		close( fd );
+#endif
+	mapped = NULL;
+	index = NULL;
+	records = NULL;
+	fd = -1;
+}
+
+
+// the heights of tile ( cx, cz ), straight out of the file, or NULL if they aren't in it (yet):
+
+const float *
+TileStore::Find( int cx, int cz )
+{
+	std::map< std::pair<int,int>, int >::iterator f = found.find( std::pair<int,int>( cx, cz ) );
+	if( f == found.end( )  ||  f->second < 0 )
+		return NULL;
+
+	loaded++;
+	return records + (size_t)f->second * tileFloats;
+}
+
+
+int
+TileStore::GetCapacity( )
+{
+	return capacity;
+}
+
+
+// tiles found in the store, instead of being made:
+
+long long
+TileStore::GetLoaded( )
+{
+	return loaded;
+}
+
+
+int
+TileStore::GetNumRecords( )
+{
+	return (int)found.size( );
+}
+
+
+// tiles that were not written, because the queue or the file was full:
+
+long long
+TileStore::GetSkipped( )
+{
+	return skipped;
+}
+
+
+long long
+TileStore::GetStored( )
+{
+	return stored;
+}
+
+
+bool
+TileStore::IsOpen( )
+{
+	return mapped != NULL;
+}
+
+
+// use file as the store for tiles of _cells x _cells cells made with _params, starting it over
+//	if it was made with anything else:
+
+bool
+TileStore::Open( const char *file, int _cells, unsigned int _params )
+{
+	Close( );
+
+#ifdef WIN32
+	fprintf( stderr, "The tile store needs mmap( ) -- not using '%s'\n", file );
+	return false;
+#else
+	cells = _cells;
+	tileFloats = ( cells + 1 ) * ( cells + 1 );
+	params = _params;
+
+	fd = open( file, O_RDWR | O_CREAT, 0644 );
+	if( fd < 0 )
+	{
+		fprintf( stderr, "Cannot open the tile store '%s'\n", file );
+		return false;
+	}
+
+	// one process at a time -- each keeps its own idea of which records are used, and
+	//	starting the file over would pull it out from under another one's mapping
+	// (the lock goes with the descriptor, when Close( ) closes it)
+	if( flock( fd, LOCK_EX | LOCK_NB ) != 0 )
+	{
+		fprintf( stderr, "The tile store '%s' is being used by another program -- not using it\n", file );
+		close( fd );
+		fd = -1;
+		return false;
+	}
+
+	struct StoreHeader header;
+	memset( &header, 0, sizeof(header) );
+	struct stat st;
+	if( fstat( fd, &st ) != 0 )
+	{
+		fprintf( stderr, "Cannot look at the tile store '%s'\n", file );
+		close( fd );
+		fd = -1;
+		return false;
+	}
+	bool ok = pread( fd, &header, sizeof(header), 0 ) == (ssize_t)sizeof(header);
+	ok = ok  &&  memcmp( header.magic, "TILESTOR", 8 ) == 0  &&  header.version == 1;
+	ok = ok  &&  header.cells == cells  &&  header.params == params  &&  header.capacity > 0;
+
+	capacity = ok ? header.capacity : TILE_STORE_RECORDS;
+	size_t indexBytes = sizeof(struct StoreIndex) * capacity;
+	size_t recordsOffset = ( sizeof(struct StoreHeader) + indexBytes + 4095 ) & ~(size_t)4095;		// (page aligned)
+	mappedBytes = recordsOffset + sizeof(float) * tileFloats * capacity;
+	ok = ok  &&  (size_t)st.st_size == mappedBytes;
+
+	if( ! ok )
+	{
+		if( st.st_size != 0 )
+			fprintf( stderr, "The tile store '%s' was made for something else -- starting it over\n", file );
+
+		// (the records are never read before they are written, so the file can be sparse)
+		memset( &header, 0, sizeof(header) );
+		memcpy( header.magic, "TILESTOR", 8 );
+		header.version = 1;
+		header.cells = cells;
+		header.params = params;
+		header.capacity = capacity;
+		if( ftruncate( fd, 0 ) != 0  ||  ftruncate( fd, mappedBytes ) != 0
+		  ||  pwrite( fd, &header, sizeof(header), 0 ) != (ssize_t)sizeof(header) )
+		{
+			fprintf( stderr, "Cannot make the tile store '%s'\n", file );
+			close( fd );
+			fd = -1;
+			return false;
+		}
+	}
+
+	void *map = mmap( NULL, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if( map == MAP_FAILED )
+	{
+		fprintf( stderr, "Cannot map the tile store '%s'\n", file );
+		close( fd );
+		fd = -1;
+		return false;
+	}
+	mapped = (unsigned char *)map;
+	index = (struct StoreIndex *)( mapped + sizeof(struct StoreHeader) );
+	records = (float *)( mapped + recordsOffset );
+
+	// (a record whose index entry never got written, because the program stopped first, is just skipped)
+	nextRecord = 0;
+	for( int i = 0; i < capacity; i++ )
+	{
+		if( index[i].used )
+		{
+			found[ std::pair<int,int>( index[i].cx, index[i].cz ) ] = i;
+			nextRecord = i + 1;
+		}
+	}
+
+	toWrite.Init( TILE_STORE_QUEUE );
+	written.Init( TILE_STORE_QUEUE );
+	stopping = false;
+	writer = std::thread( &TileStore::Write, this );
+	return true;
+#endif
+}
+
+
+// take what the writing thread has finished with -- Find( ) knows about those tiles from now on:
+
+void
+TileStore::Poll( )
+{
+	struct StoreWrite w;
+	while( written.Pop( &w ) )
+	{
+		std::pair<int,int> key( w.cx, w.cz );
+		if( w.record >= 0 )
+		{
+			found[key] = w.record;
+			stored++;
+		}
+		else
+		{
+			found.erase( key );
+			skipped++;
+		}
+	}
+}
+
+
+// write tile ( cx, cz )'s heights to the store, in the background, unless it has them already:
+// (never waits -- if the writing thread has too much to do already, the tile just isn't written)
+
+void
+TileStore::Put( int cx, int cz, const float *heights )
+{
+	if( mapped == NULL )
+		return;
+
+	std::pair<int,int> key( cx, cz );
+	if( found.count( key ) != 0 )
+		return;		// written, or on its way
+
+	struct StoreWrite w;
+	w.cx = cx;
+	w.cz = cz;
+	w.record = -1;
+	w.heights = new std::vector<float>( heights, heights + tileFloats );
+	if( ! toWrite.Push( w ) )
+	{
+		delete w.heights;
+		skipped++;
+		return;
+	}
+	found[key] = -1;		// (on its way)
+}
+
+
+// the writing thread: write the tiles waiting into the next records, get those onto the disk,
+//	then mark their index entries used, and say where they went -- until Close( ), once
+//	everything queued is written
+//
+// the kernel writes the mapping's pages back in whatever order it likes, so without the
+//	msync( ) an index page could reach the disk before its records, and after a power cut
+//	Open( ) would believe in records that are zeroes or garbage -- it is one msync( ) for
+//	however many tiles were waiting, since their records are next to each other
+
+void
+TileStore::Write( )
+{
+	std::vector<struct StoreWrite> batch;
+
+	for( ; ; )
+	{
+		batch.clear( );
+		struct StoreWrite w;
+		while( (int)batch.size( ) < TILE_STORE_QUEUE  &&  toWrite.Pop( &w ) )
+			batch.push_back( w );
+		if( batch.empty( ) )
+		{
+			if( stopping )
+				break;
+			std::this_thread::sleep_for( std::chrono::milliseconds( TILE_STORE_IDLE_MS ) );
+			continue;
+		}
+
+		int first = nextRecord;
+		for( int b = 0; b < (int)batch.size( )  &&  nextRecord < capacity; b++ )
+		{
+			batch[b].record = nextRecord++;
+			memcpy( records + (size_t)batch[b].record * tileFloats, batch[b].heights->data( ), sizeof(float) * tileFloats );
+		}
+
+		// (msync( ) wants a page-aligned start)
+#ifndef WIN32
+		if( nextRecord > first )
+		{
+			size_t pageBytes = (size_t)sysconf( _SC_PAGESIZE );
+			size_t start = (size_t)( (unsigned char *)( records + (size_t)first * tileFloats ) - mapped );
+			size_t end = (size_t)( (unsigned char *)( records + (size_t)nextRecord * tileFloats ) - mapped );
+			start &= ~( pageBytes - 1 );
+			if( msync( mapped + start, end - start, MS_SYNC ) != 0 )
+			{
+				fprintf( stderr, "Cannot write the tile store's records to the disk\n" );
+				for( int b = 0; b < (int)batch.size( ); b++ )
+					batch[b].record = -1;		// (never listed, so never used)
+			}
+		}
+#endif
+
+		for( int b = 0; b < (int)batch.size( ); b++ )
+		{
+			int r = batch[b].record;
+			if( r >= 0 )
+			{
+				index[r].cx = batch[b].cx;
+				index[r].cz = batch[b].cz;
+				index[r].used = 1;
+			}
+			delete batch[b].heights;
+			batch[b].heights = NULL;
+
+			while( ! written.Push( batch[b] )  &&  ! stopping )
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+		}
+	}
+}
@@ -0,0 +1,114 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "tilequeue.h"
+
+
+//********************************************************************************
+// the cpu tiles (see terraintiles.h) kept in a file, so a world that has been flown
+//	over once never has to be made again, even after a restart
+//
+// the file is a header, an index, and a fixed number of fixed-size records:
+//	record i's heights are at a fixed place, and index entry i says which tile they
+//	are, if any -- the whole file is mmap( )'d, and Find( ) hands out pointers
+//	straight into the mapping, so a tile comes off the disk with no copy (and only
+//	when it is first touched)
+//
+// Put( ) never writes on the calling thread: it copies the tile into a queue, and a
+//	background thread writes the record, msync( )s it onto the disk, then writes its
+//	index entry (so a record is never listed before it is all there, even after a power
+//	cut), and sends back where it put it -- Poll( ) takes
+//	those, and until then Find( ) doesn't know about the tile
+//
+// a file made with another grid or other noise parameters (see TileParamsHash( )) is
+//	started over, as is one that isn't a tile store at all
+//
+// only one process can have a file open -- Open( ) fails while another one has it
+//
+// the records never move or get reused, so the pointers are good until Close( ) --
+//	once the file is full, it stops taking tiles
+//
+// on windows there is no mmap( ), and Open( ) says so
+//********************************************************************************
+
+
+// how many tiles a new store has room for, how many tiles can wait to be written, and
+//	how long the writing thread naps when there is nothing to write:
+
+const int TILE_STORE_RECORDS   = 16384;
+const int TILE_STORE_QUEUE     = 64;
+const int TILE_STORE_IDLE_MS   = 5;
+
+
+class TileStore
+{
+  private:
+	struct StoreHeader
+	{
+		char		magic[8];	// "TILESTOR"
+		int		version;
+		int		cells;
+		unsigned int	params;
+		int		capacity;	// records
+		int		pad[10];
+	};
+
+	struct StoreIndex
+	{
+		int		cx, cz;
+		int		used;		// set once the record is all written
+	};
+
+	struct StoreWrite
+	{
+		int		cx, cz;
+		int		record;		// where the writing thread put it
+		std::vector<float> *	heights;
+	};
+
+	int		cells;
+	int		tileFloats;
+	unsigned int	params;
+	int		capacity;
+	int		fd;
+	unsigned char *	mapped;
+	size_t		mappedBytes;
+	struct StoreIndex *	index;
+	float *		records;
+
+	std::map< std::pair<int,int>, int >	found;		// the records written so far -- the GL thread's
+	int		nextRecord;			// the writing thread's
+
+	SpscQueue<struct StoreWrite>	toWrite;	// to the writing thread
+	SpscQueue<struct StoreWrite>	written;	// and back
+	std::thread	writer;
+	std::atomic<bool>	stopping;
+
+	long long	loaded, stored, skipped;
+
+	void		Write( );
+
+  public:
+	TileStore( );
+	~TileStore( );
+	void		Close( );
+	const float *	Find( int, int );
+	long long	GetLoaded( );
+	int		GetNumRecords( );
+	int		GetCapacity( );
+	long long	GetSkipped( );
+	long long	GetStored( );
+	bool		IsOpen( );
+	bool		Open( const char *, int, unsigned int );
+	void		Poll( );
+	void		Put( int, int, const float * );
+};
+
+#endif	// TILESTORE_H
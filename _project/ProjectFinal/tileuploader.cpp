@@ -0,0 +1,247 @@
+#include <string.h>
+#include <algorithm>
+
+#include "tileuploader.h"
+
+
+TileUploader::TileUploader( )
+{
+	cells = 0;
+	tileBytes = 0;
+	numSlots = 0;
+	heightsBuffer = 0;
+	budgetBytes = 0;
+	frame = 0;
+	frameBytes = frameDeferred = 0;
+	uploadedTiles = uploadedBytes = 0;
+	hits = evictions = 0;
+}
+
+
+// make the tile heights visible to terrain.vert:
+
+void
+TileUploader::Bind( )
+{
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, TILE_HEIGHTS_BINDING, heightsBuffer );
+}
+
+
+int
+TileUploader::GetBudget( )
+{
+	return budgetBytes;
+}
+
+
+// a slot for another tile -- a free one, or else the least recently drawn tile's, as long
+//	as it isn't drawn this frame -- or -1 if there is none; take says whether to actually
+//	take it, or just see if there is one:
+
+int
+TileUploader::FreeSlot( bool take )
+{
+	if( ! freeSlots.empty( ) )
+	{
+		int slot = freeSlots.back( );
+		if( take )
+			freeSlots.pop_back( );
+		return slot;
+	}
+
+	if( lru.empty( ) )
+		return -1;
+	std::map<TileKey, struct ResidentTile>::iterator r = resident.find( lru.back( ) );
+	if( r->second.lastFrame == frame )
+		return -1;
+
+	int slot = r->second.slot;
+	if( take )
+	{
+		lru.pop_back( );
+		resident.erase( r );
+		evictions++;
+	}
+	return slot;
+}
+
+
+// bytes of tiles the gpu has room for, and has in it:
+
+int
+TileUploader::GetCacheBudget( )
+{
+	return numSlots * tileBytes;
+}
+
+
+int
+TileUploader::GetCacheBytes( )
+{
+	return (int)resident.size( ) * tileBytes;
+}
+
+
+long long
+TileUploader::GetEvictions( )
+{
+	return evictions;
+}
+
+
+int
+TileUploader::GetFrameBytes( )
+{
+	return frameBytes;
+}
+
+
+int
+TileUploader::GetFrameDeferred( )
+{
+	return frameDeferred;
+}
+
+
+long long
+TileUploader::GetHits( )
+{
+	return hits;
+}
+
+
+int
+TileUploader::GetNumResident( )
+{
+	return (int)resident.size( );
+}
+
+
+long long
+TileUploader::GetUploadedBytes( )
+{
+	return uploadedBytes;
+}
+
+
+long long
+TileUploader::GetUploadedTiles( )
+{
+	return uploadedTiles;
+}
+
+
+// room on the gpu for cacheBytes of tiles of _cells x _cells cells, sent through a ring of
+//	ringBytes, at most budget bytes a frame:
+
+bool
+TileUploader::Init( int _cells, int cacheBytes, int ringBytes, int budget )
+{
+	cells = _cells;
+	tileBytes = ( cells + 1 ) * ( cells + 1 ) * (int)sizeof(float);
+	numSlots = std::max( cacheBytes / tileBytes, 1 );
+	budgetBytes = budget;
+
+	glGenBuffers( 1, &heightsBuffer );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, heightsBuffer );
+	glBufferData( GL_SHADER_STORAGE_BUFFER, numSlots * tileBytes, NULL, GL_DYNAMIC_DRAW );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	freeSlots.clear( );
+	for( int s = numSlots - 1; s >= 0; s-- )
+		freeSlots.push_back( s );
+	resident.clear( );
+	lru.clear( );
+
+	return ring.Init( ringBytes );
+}
+
+
+// whether the ring is mapped persistently, rather than sent with glBufferSubData( ):
+
+bool
+TileUploader::IsPersistent( )
+{
+	return ring.IsPersistent( );
+}
+
+
+void
+TileUploader::SetBudget( int budget )
+{
+	budgetBytes = budget;
+}
+
+
+// upload what the chunks about to be drawn are missing (as far as the budget goes), and tell
+//	each chunk which slot it has:
+
+void
+TileUploader::Update( TerrainTiles *tiles, TerrainChunks *chunks )
+{
+	TRACE_ZONE( "TileUploader::Update" );
+
+	ring.Retire( );
+	frame++;
+	frameBytes = 0;
+	frameDeferred = 0;
+
+	// the finest lod is the nearest, so it goes first:
+	int n = chunks->GetNumChunks( );
+	std::vector<int> order( n );
+	for( int i = 0; i < n; i++ )
+		order[i] = i;
+	std::stable_sort( order.begin( ), order.end( ), [chunks]( int a, int b ) { return chunks->GetChunk( a )->lod < chunks->GetChunk( b )->lod; } );
+
+	for( int k = 0; k < n; k++ )
+	{
+		struct TerrainChunk *c = chunks->GetChunk( order[k] );
+		TileKey key = { c->cx, c->cz, tiles->GetParams( ) };
+		c->tile = -1;
+
+		std::map<TileKey, struct ResidentTile>::iterator r = resident.find( key );
+		if( r != resident.end( ) )
+		{
+			if( r->second.lastFrame < frame - 1 )
+				hits++;
+			r->second.lastFrame = frame;
+			lru.splice( lru.begin( ), lru, r->second.use );
+			c->tile = r->second.slot;
+			continue;
+		}
+
+		const float *heights = tiles->GetTile( c->cx, c->cz );
+		if( heights == NULL )
+			continue;		// not made yet
+
+		int offset;
+		unsigned char *staging = NULL;
+		if( frameBytes + tileBytes <= budgetBytes  &&  FreeSlot( false ) >= 0 )
+			staging = ring.Allocate( tileBytes, &offset );
+		if( staging == NULL )
+		{
+			frameDeferred++;
+			continue;
+		}
+
+		memcpy( staging, heights, tileBytes );
+		ring.Commit( offset, tileBytes );
+
+		int slot = FreeSlot( true );
+		glBindBuffer( GL_COPY_READ_BUFFER, ring.GetBuffer( ) );		// (after Commit( ), which may use the binding)
+		glBindBuffer( GL_COPY_WRITE_BUFFER, heightsBuffer );
+		glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, slot * tileBytes, tileBytes );
+
+		lru.push_front( key );
+		struct ResidentTile tile = { slot, frame, lru.begin( ) };
+		resident[key] = tile;
+		c->tile = slot;
+		frameBytes += tileBytes;
+		uploadedTiles++;
+		uploadedBytes += tileBytes;
+	}
+	glBindBuffer( GL_COPY_READ_BUFFER, 0 );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+
+	ring.EndFrame( );
+}
@@ -0,0 +1,97 @@
+#ifndef TILEUPLOADER_H
+#define TILEUPLOADER_H
+
+#include <stdio.h>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include "glew.h"
+#include <GL/gl.h>
+#endif
+
+#include "tilecache.h"
+#include "terrainchunks.h"
+#include "terraintiles.h"
+#include "uploadring.h"
+
+
+//********************************************************************************
+// streams the cpu tiles (see terraintiles.h) to the gpu, for terrain.vert (with
+//	TILE_HEIGHTS #define'd) to read instead of working the noise out again
+//
+// the tiles live in slots of one shader storage buffer; each frame, the chunks about
+//	to be drawn whose tiles have come back but aren't in a slot yet get copied into
+//	the UploadRing and from there into a free slot with glCopyBufferSubData( ),
+//	finest lod first, until the frame's byte budget or the ring runs out -- the rest
+//	wait for the next frame, and meanwhile draw with the noise as before
+//
+// a chunk's slot goes in its TerrainChunk::tile, or -1 while it has none
+//
+// the slots are a cache too: a tile stays in its slot after its chunk has gone, until
+//	the slot is wanted for another tile -- then the least recently drawn tile that
+//	isn't being drawn this frame gives it up -- so the gpu's share of the tile cache
+//	is however many slots fit in its byte budget
+//********************************************************************************
+
+
+// shader storage buffer binding of the tile heights (as in terrain.vert):
+
+const int TILE_HEIGHTS_BINDING = 3;
+
+
+class TileUploader
+{
+  private:
+	struct ResidentTile
+	{
+		int				slot;
+		int				lastFrame;	// the last Update( ) a chunk drew it in
+		std::list<TileKey>::iterator	use;		// its place in lru
+	};
+
+	int		cells;
+	int		tileBytes;
+	int		numSlots;
+	GLuint		heightsBuffer;		// numSlots tiles of ( cells + 1 ) x ( cells + 1 ) heights
+	UploadRing	ring;
+	int		budgetBytes;		// most to upload in one frame
+	int		frame;
+
+	std::map<TileKey, struct ResidentTile>	resident;	// the tiles on the gpu
+	std::list<TileKey>			lru;		// most recently drawn first
+	std::vector<int>			freeSlots;
+
+	int		frameBytes;		// uploaded in the last Update( )
+	int		frameDeferred;		// left for later by the last Update( ): over budget, no room in the ring, or no slot
+	long long	uploadedTiles;
+	long long	uploadedBytes;
+	long long	hits;			// tiles drawn again from their slot, after a frame or more without
+	long long	evictions;
+
+	int		FreeSlot( bool );
+
+  public:
+	TileUploader( );
+	void		Bind( );
+	int		GetBudget( );
+	int		GetCacheBudget( );
+	int		GetCacheBytes( );
+	long long	GetEvictions( );
+	int		GetFrameBytes( );
+	int		GetFrameDeferred( );
+	long long	GetHits( );
+	int		GetNumResident( );
+	long long	GetUploadedBytes( );
+	long long	GetUploadedTiles( );
+	bool		Init( int, int, int, int );
+	bool		IsPersistent( );
+	void		SetBudget( int );
+	void		Update( TerrainTiles *, TerrainChunks * );
+};
+
+#endif	// TILEUPLOADER_H
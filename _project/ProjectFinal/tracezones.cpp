@@ -0,0 +1,164 @@
+#include "tracezones.h"
+
+
+// every thread that has recorded a zone, in the order they first did:
+// (slots are filled without a lock, so a reader can briefly see a NULL slot)
+
+static std::atomic<struct TraceBuffer *>	TraceBuffers[MAX_TRACE_THREADS];
+static std::atomic<int>			NumTraceBuffers( 0 );
+
+static thread_local struct TraceBuffer *	ThisThreadTraceBuffer = NULL;
+
+static const std::chrono::steady_clock::time_point	TraceEpoch = std::chrono::steady_clock::now( );
+
+
+static
+struct TraceBuffer *
+GetThisThreadTraceBuffer( )
+{
+	if( ThisThreadTraceBuffer == NULL )
+	{
+		int index = NumTraceBuffers.fetch_add( 1 );
+		if( index >= MAX_TRACE_THREADS )
+			return NULL;
+
+		struct TraceBuffer *tb = new struct TraceBuffer;
+		tb->head.store( 0, std::memory_order_relaxed );
+		tb->threadIndex = index;
+		TraceBuffers[index].store( tb, std::memory_order_release );
+		ThisThreadTraceBuffer = tb;
+	}
+
+	return ThisThreadTraceBuffer;
+}
+
+
+// microseconds since the program started:
+
+long long
+TraceNowUs( )
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now( ) - TraceEpoch ).count( );
+}
+
+
+void
+TraceRecord( const char *name, long long startUs, long long durationUs )
+{
+	struct TraceBuffer *tb = GetThisThreadTraceBuffer( );
+	if( tb == NULL )
+		return;
+
+	unsigned int h = tb->head.load( std::memory_order_relaxed );
+	struct TraceEvent *e = &tb->events[ h & ( TRACE_EVENTS_PER_THREAD - 1 ) ];
+	e->name = name;
+	e->startUs = startUs;
+	e->durationUs = durationUs;
+
+	// publish the event to WriteChromeTrace( ):
+	tb->head.store( h + 1, std::memory_order_release );
+}
+
+
+TraceZone::TraceZone( const char *_name )
+{
+	name = _name;
+	startUs = TraceNowUs( );
+	open = true;
+}
+
+
+TraceZone::~TraceZone( )
+{
+	End( );
+}
+
+
+void
+TraceZone::End( )
+{
+	if( ! open )
+		return;
+
+	TraceRecord( name, startUs, TraceNowUs( ) - startUs );
+	open = false;
+}
+
+
+static
+void
+WriteJsonString( FILE *fp, const char *s )
+{
+	fputc( '"', fp );
+	for( ; *s != '\0'; s++ )
+	{
+		if( *s == '"'  ||  *s == '\\' )
+			fputc( '\\', fp );
+		fputc( *s, fp );
+	}
+	fputc( '"', fp );
+}
+
+
+// write everything recorded so far in the chrome://tracing / Perfetto json format
+//	(complete "X" events, one track per thread):
+
+bool
+WriteChromeTrace( const char *filename )
+{
+	FILE *fp = fopen( filename, "w" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot open '%s' for writing\n", filename );
+		return false;
+	}
+
+	static struct TraceEvent copy[TRACE_EVENTS_PER_THREAD];
+	bool first = true;
+	int numEvents = 0;
+
+	fprintf( fp, "{\"traceEvents\":[\n" );
+
+	int numBuffers = NumTraceBuffers.load( std::memory_order_acquire );
+	if( numBuffers > MAX_TRACE_THREADS )
+		numBuffers = MAX_TRACE_THREADS;
+
+	for( int b = 0; b < numBuffers; b++ )
+	{
+		struct TraceBuffer *tb = TraceBuffers[b].load( std::memory_order_acquire );
+		if( tb == NULL )
+			continue;
+
+		// copy the newest events out, then throw away any that the owning thread
+		//	could have been overwriting while we were copying:
+
+		unsigned int end = tb->head.load( std::memory_order_acquire );
+		unsigned int begin = ( end > (unsigned int)TRACE_EVENTS_PER_THREAD ) ? end - TRACE_EVENTS_PER_THREAD : 0;
+		int n = 0;
+		for( unsigned int i = begin; i < end; i++ )
+			copy[n++] = tb->events[ i & ( TRACE_EVENTS_PER_THREAD - 1 ) ];
+
+		unsigned int after = tb->head.load( std::memory_order_acquire );
+		unsigned int safeBegin = ( after >= (unsigned int)TRACE_EVENTS_PER_THREAD ) ? after - TRACE_EVENTS_PER_THREAD + 1 : 0;
+		int skip = ( safeBegin > begin ) ? (int)( safeBegin - begin ) : 0;
+
+		fprintf( fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+			first ? "" : ",\n", tb->threadIndex, tb->threadIndex == 0 ? "main" : "thread", tb->threadIndex );
+		first = false;
+
+		for( int i = skip; i < n; i++ )
+		{
+			fprintf( fp, ",\n{\"name\":" );
+			WriteJsonString( fp, copy[i].name );
+			fprintf( fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}",
+				tb->threadIndex, copy[i].startUs, copy[i].durationUs );
+			numEvents++;
+		}
+	}
+
+	fprintf( fp, "\n]}\n" );
+	fclose( fp );
+
+	fprintf( stderr, "Wrote %d trace events to '%s'\n", numEvents, filename );
+	return true;
+}
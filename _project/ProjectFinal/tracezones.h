@@ -0,0 +1,80 @@
+#ifndef TRACEZONES_H
+#define TRACEZONES_H
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+
+
+//********************************************************************************
+// #define TRACE_ZONES before #include'ing this to record zones -- otherwise the
+//	TRACE_ZONE macros compile to nothing
+//
+// zone names must be string literals (only the pointer is recorded)
+//********************************************************************************
+
+
+// number of zones each thread keeps before the oldest ones are overwritten:
+// (must be a power of 2)
+
+const int TRACE_EVENTS_PER_THREAD = 65536;
+
+// most threads that can record zones:
+
+const int MAX_TRACE_THREADS = 64;
+
+
+struct TraceEvent
+{
+	const char *	name;
+	long long	startUs;
+	long long	durationUs;
+};
+
+
+// one per thread -- only its owning thread ever writes to it:
+
+struct TraceBuffer
+{
+	struct TraceEvent	events[TRACE_EVENTS_PER_THREAD];
+	std::atomic<unsigned int>	head;		// total number of events ever written
+	int			threadIndex;
+};
+
+
+class TraceZone
+{
+  private:
+	const char *	name;
+	long long	startUs;
+	bool		open;
+
+  public:
+	TraceZone( const char * );
+	~TraceZone( );
+	void	End( );
+};
+
+
+long long	TraceNowUs( );
+void		TraceRecord( const char *, long long, long long );
+bool		WriteChromeTrace( const char * );
+
+
+#ifdef TRACE_ZONES
+#define TRACE_CONCAT2( a, b )		a##b
+#define TRACE_CONCAT( a, b )		TRACE_CONCAT2( a, b )
+
+// a zone that lasts until the end of the enclosing scope:
+#define TRACE_ZONE( name )		TraceZone TRACE_CONCAT( traceZone, __LINE__ )( name )
+
+// a zone that can be ended before the end of the enclosing scope:
+#define TRACE_ZONE_BEGIN( var, name )	TraceZone var( name )
+#define TRACE_ZONE_END( var )		var.End( )
+#else
+#define TRACE_ZONE( name )
+#define TRACE_ZONE_BEGIN( var, name )
+#define TRACE_ZONE_END( var )
+#endif
+
+#endif	// TRACEZONES_H
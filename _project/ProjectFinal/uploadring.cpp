@@ -0,0 +1,157 @@
+#include "uploadring.h"
+
+
+UploadRing::UploadRing( )
+{
+	buffer = 0;
+	size = 0;
+	mapped = NULL;
+	persistent = false;
+	head = tail = 0;
+	frameUsed = false;
+}
+
+
+// room for bytes contiguous bytes, or NULL if the gpu is still reading too much of the ring:
+// (*offset is where they are in GetBuffer( ) -- call Commit( ) once they are written)
+
+unsigned char *
+UploadRing::Allocate( int bytes, int *offset )
+{
+	if( bytes <= 0  ||  bytes >= size )
+		return NULL;
+
+	// head == tail means the ring is empty, so no allocation may make them meet:
+	// the free space is head .. the end and 0 .. tail, or just head .. tail once head has wrapped
+	if( head == tail )
+		head = tail = 0;
+
+	int at;
+	if( head >= tail )
+	{
+		if( head + bytes < size  ||  ( head + bytes == size  &&  tail > 0 ) )
+			at = head;
+		else if( bytes < tail )
+			at = 0;
+		else
+			return NULL;
+	}
+	else
+	{
+		if( head + bytes < tail )
+			at = head;
+		else
+			return NULL;
+	}
+
+	head = ( at + bytes ) % size;
+	frameUsed = true;
+	*offset = at;
+	return mapped + at;
+}
+
+
+// the bytes at offset are written and may be read by the gpu:
+
+void
+UploadRing::Commit( int offset, int bytes )
+{
+	if( persistent )
+		return;		// coherent, so they already are
+
+	glBindBuffer( GL_COPY_WRITE_BUFFER, buffer );
+	glBufferSubData( GL_COPY_WRITE_BUFFER, offset, bytes, mapped + offset );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+}
+
+
+// fence off what this frame allocated, once the commands reading it have been issued:
+
+void
+UploadRing::EndFrame( )
+{
+	if( ! frameUsed )
+		return;
+
+	struct RingFence f;
+	f.sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	f.end = head;
+	fences.push_back( f );
+	frameUsed = false;
+}
+
+
+GLuint
+UploadRing::GetBuffer( )
+{
+	return buffer;
+}
+
+
+int
+UploadRing::GetSize( )
+{
+	return size;
+}
+
+
+// make a ring of _size bytes:
+
+bool
+UploadRing::Init( int _size )
+{
+	size = _size;
+	glGenBuffers( 1, &buffer );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, buffer );
+
+	persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	if( persistent )
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_COPY_WRITE_BUFFER, size, NULL, flags );
+		mapped = (unsigned char *)glMapBufferRange( GL_COPY_WRITE_BUFFER, 0, size, flags );
+		if( mapped == NULL )
+		{
+			fprintf( stderr, "Cannot map the upload ring persistently -- falling back to glBufferSubData( )\n" );
+			glDeleteBuffers( 1, &buffer );
+			glGenBuffers( 1, &buffer );
+			glBindBuffer( GL_COPY_WRITE_BUFFER, buffer );
+			persistent = false;
+		}
+	}
+	if( ! persistent )
+	{
+		glBufferData( GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW );
+		cpuCopy.resize( size );
+		mapped = &cpuCopy[0];
+	}
+
+	glBindBuffer( GL_COPY_WRITE_BUFFER, 0 );
+	head = tail = 0;
+	return true;
+}
+
+
+bool
+UploadRing::IsPersistent( )
+{
+	return persistent;
+}
+
+
+// free up what the gpu has finished with -- never waits:
+
+void
+UploadRing::Retire( )
+{
+	while( ! fences.empty( ) )
+	{
+		GLenum status = glClientWaitSync( fences.front( ).sync, 0, 0 );
+		if( status != GL_ALREADY_SIGNALED  &&  status != GL_CONDITION_SATISFIED )
+			break;
+
+		tail = fences.front( ).end;
+		glDeleteSync( fences.front( ).sync );
+		fences.pop_front( );
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef UPLOADRING_H
+#define UPLOADRING_H
+
+#include <stdio.h>
+#include <deque>
+#include <vector>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include "glew.h"
+#include <GL/gl.h>
+#endif
+
+
+//********************************************************************************
+// a staging buffer for streaming data to the gpu without ever waiting on it:
+//	the buffer is mapped once, persistently and coherently (ARB_buffer_storage),
+//	and handed out as a ring -- each frame's allocations are fenced at EndFrame( ),
+//	and only get reused once the gpu has passed that fence
+//
+// Allocate( ) never blocks: when the ring is full of data the gpu hasn't consumed
+//	yet, it says so and the caller tries again next frame
+//
+// without ARB_buffer_storage, the allocations come from a copy in cpu memory and
+//	Commit( ) sends them with glBufferSubData( ) instead -- the driver may then wait
+//********************************************************************************
+
+
+class UploadRing
+{
+  private:
+	struct RingFence
+	{
+		GLsync	sync;
+		int	end;		// where head was when the frame was fenced
+	};
+
+	GLuint			buffer;
+	int			size;
+	unsigned char *		mapped;		// the whole buffer, or the cpu copy without ARB_buffer_storage
+	std::vector<unsigned char>	cpuCopy;
+	bool			persistent;
+
+	int			head;		// where the next allocation goes
+	int			tail;		// the oldest byte the gpu may still be reading
+	bool			frameUsed;	// anything allocated since the last EndFrame( )
+	std::deque<struct RingFence>	fences;
+
+  public:
+	UploadRing( );
+	unsigned char *	Allocate( int, int * );
+	void		Commit( int, int );
+	void		EndFrame( );
+	GLuint		GetBuffer( );
+	int		GetSize( );
+	bool		Init( int );
+	bool		IsPersistent( );
+	void		Retire( );
+};
+
+#endif	// UPLOADRING_H